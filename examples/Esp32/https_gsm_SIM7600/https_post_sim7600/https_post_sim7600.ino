@@ -64,6 +64,10 @@ TinyGsmClient base_client(modem, 0);
 SSLClient secure_layer(&base_client);
 HttpClient client = HttpClient(secure_layer, server, port);
 
+// The records of a large POST body are encrypted into this buffer and handed to the
+// modem in one AT+CIPSEND instead of one per record
+uint8_t output_batch[4096];
+
 void setup()
 {
     // Set console baud rate
@@ -97,6 +101,9 @@ void setup()
    
     //Add CA Certificate
     secure_layer.setCACert(root_ca);
+
+    // Batch outgoing records to save modem round trips on uploads
+    secure_layer.setOutputBatchBuffer(output_batch, sizeof(output_batch));
 }
 
 void light_sleep(uint32_t sec )
@@ -0,0 +1,527 @@
+/* Fixed memory arenas for mbedtls allocations.
+ */
+
+#include "Arduino.h"
+#include <atomic>
+#include <mutex>
+#include "SSLArena.h"
+#include "mbedtls/platform.h"
+
+#define SSL_ARENA_HEADER SSL_ARENA_ALIGN // block header, padded so that payloads stay aligned
+
+// What mbedtls would use without the dispatcher, e.g. esp_mbedtls_mem_calloc on ESP-IDF, so
+// that allocations outside an arena keep their placement.
+#if defined(MBEDTLS_PLATFORM_STD_CALLOC) && defined(MBEDTLS_PLATFORM_STD_FREE)
+#define SSL_ARENA_HEAP_CALLOC MBEDTLS_PLATFORM_STD_CALLOC
+#define SSL_ARENA_HEAP_FREE MBEDTLS_PLATFORM_STD_FREE
+#else
+#define SSL_ARENA_HEAP_CALLOC calloc
+#define SSL_ARENA_HEAP_FREE free
+#endif
+
+/**
+ * \brief Header in front of every block; size includes the header.
+ */
+struct ssl_arena_block {
+  size_t size;
+  size_t used;
+};
+
+// Guards the arena and tracker lists and the blocks they hold. mbedtls may allocate and free
+// on any task while another one begins or ends an arena or tracker; recursive because
+// arena_free() holds it across owner().
+static std::recursive_mutex registry_lock;
+static SSLArena *arenas = NULL;
+static std::atomic<unsigned int> arena_count(0); // registered arenas, read without the lock
+static thread_local SSLArena *current_arena = NULL;
+static SSLMemoryTracker *trackers = NULL;
+static thread_local SSLMemoryTracker *current_tracker = NULL;
+static bool dispatcher_installed = false;
+
+static size_t align_up(size_t n) {
+  return (n + SSL_ARENA_ALIGN - 1) & ~((size_t)SSL_ARENA_ALIGN - 1);
+}
+
+static ssl_arena_block *block_at(uint8_t *base, size_t offset) {
+  return (ssl_arena_block *)(base + offset);
+}
+
+/**
+ * \brief           mbedtls calloc: the current arena of this task, or the heap.
+ */
+static void *arena_calloc(size_t n, size_t size) {
+  if (size != 0 && n > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  if (current_arena == NULL && current_tracker == NULL) {
+    return SSL_ARENA_HEAP_CALLOC(n, size);
+  }
+
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+  void *ptr = current_arena != NULL ? current_arena->allocate(n * size) : SSL_ARENA_HEAP_CALLOC(n, size);
+
+  if (ptr != NULL && current_tracker != NULL) {
+    current_tracker->allocated(ptr, n * size);
+  }
+  return ptr;
+}
+
+/**
+ * \brief           mbedtls free: back to whichever arena holds the block, or the heap. Only
+ *                  the tracker of the connection being served on this task hears about it.
+ */
+static void arena_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  if (current_tracker != NULL) {
+    std::lock_guard<std::recursive_mutex> guard(registry_lock);
+    (void)current_tracker->freed(ptr);
+  }
+
+  // An arena with live blocks stays registered, so with none registered the block is heap memory.
+  if (arena_count.load(std::memory_order_acquire) == 0) {
+    SSL_ARENA_HEAP_FREE(ptr);
+    return;
+  }
+
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+  SSLArena *owner = SSLArena::owner(ptr);
+  if (owner != NULL) {
+    owner->release(ptr);
+  } else {
+    SSL_ARENA_HEAP_FREE(ptr);
+  }
+}
+
+/**
+ * \brief           Route mbedtls allocations through arena_calloc() and arena_free().
+ *
+ * \return bool     False if mbedtls was built without MBEDTLS_PLATFORM_MEMORY.
+ */
+static bool install_dispatcher() {
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+  if (!dispatcher_installed) {
+    (void)mbedtls_platform_set_calloc_free(arena_calloc, arena_free);
+    dispatcher_installed = true;
+  }
+  return true;
+#else
+  log_e("Routing mbedtls allocations needs mbedtls built with MBEDTLS_PLATFORM_MEMORY");
+  return false;
+#endif
+}
+
+/**
+ * \brief Construct an arena without memory; begin() hands it a buffer.
+ */
+SSLArena::SSLArena() {
+  _base = NULL;
+  _size = 0;
+  _used = 0;
+  _peak = 0;
+  _allocations = 0;
+  _failures = 0;
+  _next = NULL;
+}
+
+/**
+ * \brief Destroy the arena. Nothing may still be allocated from it; if something is, the
+ *        arena stays registered so that those blocks are never handed to the heap's free().
+ */
+SSLArena::~SSLArena() {
+  if (_allocations > 0) {
+    log_e("SSLArena destroyed with %u blocks still allocated, leaving it registered", (unsigned int)_allocations);
+    return;
+  }
+  (void)end();
+}
+
+/**
+ * \brief           Start serving allocations from buffer. Installs the mbedtls allocator
+ *                  the first time an arena is started.
+ *
+ * \param buffer    void* - Memory for the arena; must outlive it.
+ * \param size      size_t - Size of the buffer in bytes.
+ * \return bool     False if the arena is already started, the buffer is too small or mbedtls
+ *                  was built without MBEDTLS_PLATFORM_MEMORY.
+ */
+bool SSLArena::begin(void *buffer, size_t size) {
+  if (_base != NULL || buffer == NULL || !install_dispatcher()) {
+    return false;
+  }
+
+  size_t skip = align_up((size_t)(uintptr_t)buffer) - (size_t)(uintptr_t)buffer;
+  if (size < skip + 2 * SSL_ARENA_HEADER) {
+    log_e("SSLArena buffer of %u bytes is too small", (unsigned int)size);
+    return false;
+  }
+
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+  _base = (uint8_t *)buffer + skip;
+  _size = (size - skip) & ~((size_t)SSL_ARENA_ALIGN - 1);
+  _used = 0;
+  _peak = 0;
+  _allocations = 0;
+  _failures = 0;
+  block_at(_base, 0)->size = _size;
+  block_at(_base, 0)->used = 0;
+
+  _next = arenas;
+  arenas = this;
+  arena_count.fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+/**
+ * \brief           Stop using the buffer.
+ *
+ * \return bool     False if blocks are still allocated from the arena.
+ */
+bool SSLArena::end() {
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+
+  if (_allocations > 0) {
+    log_e("SSLArena still has %u blocks allocated", (unsigned int)_allocations);
+    return false;
+  }
+
+  if (_base == NULL) {
+    return true;
+  }
+
+  if (arenas == this) {
+    arenas = _next;
+  } else {
+    for (SSLArena *arena = arenas; arena != NULL; arena = arena->_next) {
+      if (arena->_next == this) {
+        arena->_next = _next;
+        break;
+      }
+    }
+  }
+  arena_count.fetch_sub(1, std::memory_order_release);
+
+  _next = NULL;
+  _base = NULL;
+  _size = 0;
+  return true;
+}
+
+/**
+ * \brief           Whether ptr points into this arena.
+ */
+bool SSLArena::contains(const void *ptr) const {
+  return _base != NULL && (const uint8_t *)ptr >= _base && (const uint8_t *)ptr < _base + _size;
+}
+
+/**
+ * \brief           Find the arena a pointer was allocated from.
+ *
+ * \param ptr       const void* - The pointer.
+ * \return SSLArena* The owning arena, NULL for heap memory.
+ */
+SSLArena *SSLArena::owner(const void *ptr) {
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+
+  for (SSLArena *arena = arenas; arena != NULL; arena = arena->_next) {
+    if (arena->contains(ptr)) {
+      return arena;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * \brief           Make arena serve the allocations of the calling task.
+ *
+ * \param arena     SSLArena* - The arena, NULL for the heap.
+ * \return SSLArena* The arena that was serving before, for leave().
+ */
+SSLArena *SSLArena::enter(SSLArena *arena) {
+  SSLArena *previous = current_arena;
+  current_arena = arena != NULL && arena->ready() ? arena : NULL;
+  return previous;
+}
+
+/**
+ * \brief           Undo enter().
+ *
+ * \param previous  SSLArena* - What enter() returned.
+ */
+void SSLArena::leave(SSLArena *previous) {
+  current_arena = previous;
+}
+
+/**
+ * \brief           Merge the free blocks that follow the free block at offset into it.
+ */
+void SSLArena::_coalesce(size_t offset) {
+  ssl_arena_block *block = block_at(_base, offset);
+  size_t next = offset + block->size;
+
+  while (next < _size && !block_at(_base, next)->used) {
+    block->size += block_at(_base, next)->size;
+    next = offset + block->size;
+  }
+}
+
+/**
+ * \brief           First-fit allocation of zeroed memory, like calloc().
+ *
+ * \param size      size_t - Bytes wanted.
+ * \return void*    The memory, NULL if no free block is large enough.
+ */
+void *SSLArena::allocate(size_t size) {
+  size_t need = align_up(size) + SSL_ARENA_HEADER;
+
+  for (size_t offset = 0; _base != NULL && size < _size && offset < _size; ) {
+    ssl_arena_block *block = block_at(_base, offset);
+
+    if (!block->used) {
+      _coalesce(offset);
+    }
+
+    if (block->used || block->size < need) {
+      offset += block->size;
+      continue;
+    }
+
+    if (block->size - need >= 2 * SSL_ARENA_HEADER) {
+      ssl_arena_block *rest = block_at(_base, offset + need);
+      rest->size = block->size - need;
+      rest->used = 0;
+      block->size = need;
+    }
+
+    block->used = 1;
+    _used += block->size;
+    _peak = _used > _peak ? _used : _peak;
+    _allocations++;
+
+    uint8_t *payload = (uint8_t *)block + SSL_ARENA_HEADER;
+    memset(payload, 0, block->size - SSL_ARENA_HEADER);
+    return payload;
+  }
+
+  _failures++;
+  log_w("SSLArena exhausted: %u bytes requested, %u of %u in use", (unsigned int)size, (unsigned int)_used, (unsigned int)_size);
+  return NULL;
+}
+
+/**
+ * \brief           Return a block from allocate() to the arena.
+ *
+ * \param ptr       void* - The block.
+ */
+void SSLArena::release(void *ptr) {
+  if (!contains(ptr)) {
+    return;
+  }
+
+  size_t offset = (size_t)((uint8_t *)ptr - _base) - SSL_ARENA_HEADER;
+  ssl_arena_block *block = block_at(_base, offset);
+
+  if (!block->used) {
+    log_e("SSLArena block freed twice");
+    return;
+  }
+
+  block->used = 0;
+  _used -= block->size;
+  _allocations--;
+  _coalesce(offset);
+}
+
+/**
+ * \brief           Report usage, exhaustion and how fragmented the free memory is.
+ *
+ * \return ssl_arena_stats  The figures, all 0 before begin().
+ */
+ssl_arena_stats SSLArena::stats() const {
+  ssl_arena_stats stats;
+  size_t run = 0;
+
+  memset(&stats, 0, sizeof(stats));
+  stats.size = _size;
+  stats.used = _used;
+  stats.peak = _peak;
+  stats.free_total = _size - _used;
+  stats.allocations = _allocations;
+  stats.failures = _failures;
+
+  for (size_t offset = 0; _base != NULL && offset < _size; ) {
+    const ssl_arena_block *block = block_at(_base, offset);
+
+    if (block->used) {
+      run = 0;
+    } else {
+      stats.free_blocks += run == 0 ? 1 : 0;
+      run += block->size;
+      stats.largest_free = run > stats.largest_free ? run : stats.largest_free;
+    }
+    offset += block->size;
+  }
+
+  if (stats.free_total > 0) {
+    stats.fragmentation = (uint32_t)(100 - stats.largest_free * 100 / stats.free_total);
+  }
+  return stats;
+}
+
+/**
+ * \brief Construct a tracker that is not counting yet; see begin().
+ */
+SSLMemoryTracker::SSLMemoryTracker() {
+  _blockCount = 0;
+  _phase = SSL_MEMORY_PHASE_CONFIG;
+  _registered = false;
+  _next = NULL;
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+SSLMemoryTracker::~SSLMemoryTracker() {
+  end();
+}
+
+/**
+ * \brief           Start counting. Installs the mbedtls allocator if no arena has.
+ *
+ * \return bool     False if mbedtls was built without MBEDTLS_PLATFORM_MEMORY.
+ */
+bool SSLMemoryTracker::begin() {
+  if (_registered) {
+    return true;
+  }
+
+  if (!install_dispatcher()) {
+    return false;
+  }
+
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+  _next = trackers;
+  trackers = this;
+  _registered = true;
+  return true;
+}
+
+/**
+ * \brief           Stop counting. Blocks still live are freed normally later on.
+ */
+void SSLMemoryTracker::end() {
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+
+  if (!_registered) {
+    return;
+  }
+
+  if (trackers == this) {
+    trackers = _next;
+  } else {
+    for (SSLMemoryTracker *tracker = trackers; tracker != NULL; tracker = tracker->_next) {
+      if (tracker->_next == this) {
+        tracker->_next = _next;
+        break;
+      }
+    }
+  }
+
+  if (current_tracker == this) {
+    current_tracker = NULL;
+  }
+  _next = NULL;
+  _registered = false;
+  _blockCount = 0;
+}
+
+/**
+ * \brief           Restart the peaks and counts from what is live now.
+ */
+void SSLMemoryTracker::reset() {
+  std::lock_guard<std::recursive_mutex> guard(registry_lock);
+
+  memset(&_stats, 0, sizeof(_stats));
+
+  for (size_t i = 0; i < _blockCount; i++) {
+    _stats.phases[_blocks[i].phase].live += _blocks[i].size;
+    _stats.live += _blocks[i].size;
+  }
+
+  _stats.peak = _stats.live;
+  _stats.phases[_phase].peak = _stats.live;
+}
+
+/**
+ * \brief           Count the allocations of the calling task with tracker.
+ *
+ * \param tracker   SSLMemoryTracker* - The tracker, NULL to stop counting.
+ * \return SSLMemoryTracker* The tracker that was counting before, for leave().
+ */
+SSLMemoryTracker *SSLMemoryTracker::enter(SSLMemoryTracker *tracker) {
+  SSLMemoryTracker *previous = current_tracker;
+  current_tracker = tracker != NULL && tracker->_registered ? tracker : NULL;
+  return previous;
+}
+
+/**
+ * \brief           Undo enter().
+ *
+ * \param previous  SSLMemoryTracker* - What enter() returned.
+ */
+void SSLMemoryTracker::leave(SSLMemoryTracker *previous) {
+  current_tracker = previous;
+}
+
+/**
+ * \brief           Count a block allocated in the current phase.
+ *
+ * \param ptr       void* - The block.
+ * \param size      size_t - Its size in bytes.
+ */
+void SSLMemoryTracker::allocated(void *ptr, size_t size) {
+  if (_blockCount == SSL_MEMORY_TRACKED_BLOCKS) {
+    _stats.untracked++;
+    return;
+  }
+
+  _blocks[_blockCount].ptr = ptr;
+  _blocks[_blockCount].size = size;
+  _blocks[_blockCount].phase = _phase;
+  _blockCount++;
+
+  ssl_memory_phase_stats *phase = &_stats.phases[_phase];
+  phase->live += size;
+  phase->allocations++;
+  _stats.live += size;
+  _stats.allocations++;
+
+  if (_stats.live > _stats.peak) {
+    _stats.peak = _stats.live;
+  }
+  if (_stats.live > phase->peak) {
+    phase->peak = _stats.live;
+  }
+}
+
+/**
+ * \brief           Stop counting a block if this tracker counted it.
+ *
+ * \param ptr       const void* - The block being freed.
+ * \return bool     True if the block was counted here.
+ */
+bool SSLMemoryTracker::freed(const void *ptr) {
+  for (size_t i = 0; i < _blockCount; i++) {
+    if (_blocks[i].ptr != ptr) {
+      continue;
+    }
+
+    _stats.phases[_blocks[i].phase].live -= _blocks[i].size;
+    _stats.live -= _blocks[i].size;
+    _blocks[i] = _blocks[--_blockCount];
+    return true;
+  }
+  return false;
+}
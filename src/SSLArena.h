@@ -0,0 +1,178 @@
+/* Fixed memory arenas for mbedtls allocations.
+ *
+ * An SSLArena hands out memory from one caller-supplied buffer instead of the
+ * heap. Attach it to a client with SSLClient::setArena() and everything mbedtls
+ * allocates for that connection (parsed certificates, handshake state, record
+ * buffers) comes from the buffer, so reconnecting never fragments the heap.
+ *
+ * The first begin() installs a dispatcher with mbedtls_platform_set_calloc_free().
+ * It replaces calloc and free for every mbedtls user in the process, not only
+ * SSLClient, and stays installed for good. Allocations go to the arena of the
+ * connection being served on the calling task; everything else goes to
+ * MBEDTLS_PLATFORM_STD_CALLOC, so other mbedtls users keep the allocator they
+ * were built with. Frees are routed by address through the registered arenas;
+ * with none registered they go straight to the heap without locking. A lock
+ * guards the registry, so arenas and trackers can begin and end while other
+ * tasks use mbedtls. An arena destroyed with blocks still allocated stays
+ * registered, so the buffer must outlive every connection and session cache
+ * entry using it.
+ *
+ * An SSLMemoryTracker hooks into the same dispatcher to count what one
+ * connection allocates, split by the phase of the connection it happened in.
+ * It remembers each live block in a fixed table, so it is meant for sizing
+ * buffers and connection limits, not for production builds. It only sees the
+ * frees made while its connection is being served on the calling task.
+ */
+
+#ifndef SSL_ARENA_H
+#define SSL_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SSL_ARENA_ALIGN 16U
+
+#ifndef SSL_MEMORY_TRACKED_BLOCKS
+#define SSL_MEMORY_TRACKED_BLOCKS 256U // live blocks one tracker can follow
+#endif
+
+/**
+ * \brief Usage of one arena, in bytes unless noted.
+ */
+typedef struct ssl_arena_stats {
+  size_t size;                // usable bytes, after alignment
+  size_t used;                // allocated now, including block headers
+  size_t peak;                // highest value of used
+  size_t free_total;          // size - used
+  size_t largest_free;        // largest single allocation that would succeed, plus its header
+  size_t free_blocks;         // number of separate free blocks
+  uint32_t fragmentation;     // percent of free memory outside the largest free block
+  uint32_t allocations;       // blocks allocated now
+  uint32_t failures;          // requests that did not fit since begin()
+} ssl_arena_stats;
+
+/**
+ * \brief Phases of a connection, in the order they happen.
+ */
+typedef enum ssl_memory_phase {
+  SSL_MEMORY_PHASE_CONFIG = 0,  // configuration and context setup, including record buffers
+  SSL_MEMORY_PHASE_CERT_PARSE,  // parsing the CA certificate, client certificate and key, or the PSK
+  SSL_MEMORY_PHASE_HANDSHAKE,   // from the ClientHello until the peer is verified
+  SSL_MEMORY_PHASE_STEADY,      // reading and writing application data
+  SSL_MEMORY_PHASES
+} ssl_memory_phase;
+
+/**
+ * \brief Allocations made during one phase.
+ */
+typedef struct ssl_memory_phase_stats {
+  size_t live;                  // bytes allocated in this phase and not freed yet
+  size_t peak;                  // highest total live bytes of the connection during this phase
+  uint32_t allocations;         // blocks allocated in this phase
+} ssl_memory_phase_stats;
+
+/**
+ * \brief What one connection has allocated since tracking started or was reset.
+ */
+typedef struct ssl_memory_stats {
+  ssl_memory_phase_stats phases[SSL_MEMORY_PHASES];
+  size_t live;                  // bytes allocated now
+  size_t peak;                  // highest value of live
+  uint32_t allocations;         // blocks allocated
+  uint32_t untracked;           // blocks not counted because the table was full
+} ssl_memory_stats;
+
+class SSLArena {
+public:
+  SSLArena();
+  ~SSLArena();
+
+  bool begin(void *buffer, size_t size);
+  bool end();
+
+  bool ready() const { return _base != NULL; }
+  bool contains(const void *ptr) const;
+  ssl_arena_stats stats() const;
+
+  static SSLArena *owner(const void *ptr);
+  static SSLArena *enter(SSLArena *arena);
+  static void leave(SSLArena *previous);
+
+  void *allocate(size_t size);
+  void release(void *ptr);
+
+private:
+  SSLArena(const SSLArena&) = delete;
+  SSLArena& operator=(const SSLArena&) = delete;
+
+  void _coalesce(size_t offset);
+
+  uint8_t *_base;
+  size_t _size;
+  size_t _used;
+  size_t _peak;
+  uint32_t _allocations;
+  uint32_t _failures;
+  SSLArena *_next;
+};
+
+class SSLMemoryTracker {
+public:
+  SSLMemoryTracker();
+  ~SSLMemoryTracker();
+
+  bool begin();
+  void end();
+
+  void setPhase(ssl_memory_phase phase) { _phase = phase; }
+  ssl_memory_phase phase() const { return _phase; }
+  ssl_memory_stats stats() const { return _stats; }
+  void reset();
+
+  static SSLMemoryTracker *enter(SSLMemoryTracker *tracker);
+  static void leave(SSLMemoryTracker *previous);
+
+  void allocated(void *ptr, size_t size);
+  bool freed(const void *ptr);
+
+private:
+  SSLMemoryTracker(const SSLMemoryTracker&) = delete;
+  SSLMemoryTracker& operator=(const SSLMemoryTracker&) = delete;
+
+  struct block {
+    const void *ptr;
+    size_t size;
+    ssl_memory_phase phase;
+  };
+
+  block _blocks[SSL_MEMORY_TRACKED_BLOCKS];
+  size_t _blockCount;
+  ssl_memory_phase _phase;
+  ssl_memory_stats _stats;
+  bool _registered;
+  SSLMemoryTracker *_next;
+};
+
+/**
+ * \brief Serve the allocations of one block of code from an arena (or the heap for NULL),
+ *        optionally counting them with a tracker, and restore the previous choice when it
+ *        goes out of scope.
+ */
+class SSLArenaScope {
+public:
+  explicit SSLArenaScope(SSLArena *arena, SSLMemoryTracker *tracker = NULL)
+    : _previous(SSLArena::enter(arena)), _previousTracker(SSLMemoryTracker::enter(tracker)) {}
+  ~SSLArenaScope() {
+    SSLMemoryTracker::leave(_previousTracker);
+    SSLArena::leave(_previous);
+  }
+
+private:
+  SSLArenaScope(const SSLArenaScope&) = delete;
+  SSLArenaScope& operator=(const SSLArenaScope&) = delete;
+
+  SSLArena *_previous;
+  SSLMemoryTracker *_previousTracker;
+};
+
+#endif /* SSL_ARENA_H */
@@ -30,7 +30,9 @@ SSLClient::SSLClient() {
   _connected = false;
   sslclient = new sslclient_context;
   ssl_init(sslclient, nullptr);
-  sslclient->handshake_timeout = 120000;
+  sslclient->settings.handshake_timeout = 120000;
+  _host[0] = '\0';
+  _port = 0;
   _CA_cert = NULL;
   _cert = NULL;
   _private_key = NULL;
@@ -47,7 +49,9 @@ SSLClient::SSLClient(Client* client) {
   _connected = false;
   sslclient = new sslclient_context;
   ssl_init(sslclient, client);
-  sslclient->handshake_timeout = 120000;
+  sslclient->settings.handshake_timeout = 120000;
+  _host[0] = '\0';
+  _port = 0;
   _CA_cert = NULL;
   _cert = NULL;
   _private_key = NULL;
@@ -59,28 +63,116 @@ SSLClient::SSLClient(Client* client) {
  * @brief Destroy the SSLClient::SSLClient object.
  */
 SSLClient::~SSLClient() {
-  stop();
+  _teardown();
+  setConfig(nullptr);
+  (void)setMemoryStats(nullptr);
   delete sslclient;
 }
 
 /**
- * @brief Stops the SSL client.
+ * @brief Stops the SSL client. With warm reconnect enabled only the connection is closed;
+ *        the SSL context is kept for the next connect to the same host.
  */
 void SSLClient::stop() {
+  if (_connected && _writeBuffered > 0) {
+    (void)_flushWriteBuffer();
+  }
+  _writeBuffered = 0;
+  _readPos = 0;
+  _readLen = 0;
+
+  if (sslclient->settings.warm_reconnect && ssl_client_is_set_up(sslclient) && !sslclient->credentials_released) {
+    log_v("Closing ssl client, keeping context for reconnect");
+    close_ssl_socket(sslclient);
+    _connected = false;
+    _handshaking = false;
+    _peek = -1;
+    return;
+  }
+  _teardown();
+}
+
+/**
+ * @brief Stops the SSL client and frees the whole SSL context.
+ */
+void SSLClient::_teardown() {
   if (sslclient->client != nullptr) {
-    if (sslclient->client >= 0) {
-      log_v("Stopping ssl client");
-      stop_ssl_socket(sslclient, _CA_cert, _cert, _private_key);
-    } else {
-      log_v("stop() not called because client is < 0");
-    }
+    log_v("Stopping ssl client");
+    stop_ssl_socket(sslclient, _CA_cert, _cert, _private_key);
   } else {
     log_v("stop() not called because client is nullptr");
   }
   _connected = false;
+  _handshaking = false;
+  _writeBuffered = 0;
+  _readPos = 0;
+  _readLen = 0;
   _peek = -1;
 }
 
+/**
+ * @brief Whether the SSL context kept by a warm stop() was set up for this host with these
+ *        credentials and still holds them, so that it can be reused. Any other set up context
+ *        is torn down so that the next connect starts from scratch.
+ * 
+ * @param host 
+ * @param port 
+ * @param rootCABuff 
+ * @param cli_cert 
+ * @param cli_key 
+ * @param pskIdent 
+ * @param psKey 
+ * @return bool true if the kept context can be reset and reused.
+ */
+bool SSLClient::_canConnectWarm(const char *host, uint16_t port, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey) {
+  if (!ssl_client_is_set_up(sslclient)) {
+    return false;
+  }
+
+  if (!sslclient->settings.warm_reconnect || _port != port || strcmp(_host, host) != 0 ||
+      !ssl_client_can_restart(sslclient, rootCABuff, cli_cert, cli_key, pskIdent, psKey)) {
+    _teardown();
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Reconnects on the SSL context kept by a warm stop(), if it was set up for the same host
+ *        and credentials.
+ * 
+ * @param host 
+ * @param port 
+ * @param rootCABuff 
+ * @param cli_cert 
+ * @param cli_key 
+ * @param pskIdent 
+ * @param psKey 
+ * @return int 1 if reconnected warm, 0 if a full connect is needed, < 0 on error.
+ */
+int SSLClient::_connectWarm(const char *host, uint16_t port, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey) {
+  if (!_canConnectWarm(host, port, rootCABuff, cli_cert, cli_key, pskIdent, psKey)) {
+    return 0;
+  }
+
+  return restart_ssl_client(sslclient, host, port);
+}
+
+/**
+ * @brief Remembers the host and port of the last connect for reconnect() and poll().
+ * 
+ * @param host 
+ * @param port 
+ */
+void SSLClient::_rememberHost(const char *host, uint16_t port) {
+  if (host != _host) {
+    strncpy(_host, host, sizeof(_host) - 1);
+    _host[sizeof(_host) - 1] = '\0';
+  }
+  _port = port;
+}
+
 /**
  * @brief 
  * 
@@ -125,49 +217,432 @@ int SSLClient::connect(const char *host, uint16_t port, const char *_CA_cert, co
 {
     log_d("Connecting to %s:%d", host, port);
     if(_timeout > 0){
-        sslclient->handshake_timeout = _timeout;
+        sslclient->settings.handshake_timeout = _timeout;
+    }
+    int ret = _connectWarm(host, port, _CA_cert, _cert, _private_key, NULL, NULL);
+    if (ret == 0) {
+        ret = start_ssl_client(sslclient, host, port, _timeout, _CA_cert, _cert, _private_key, NULL, NULL);
     }
-    int ret = start_ssl_client(sslclient, host, port, _timeout, _CA_cert, _cert, _private_key, NULL, NULL);
     _lastError = ret;
     if (ret < 0) {
         log_e("start_ssl_client: %d", ret);
-        stop();
+        _teardown();
         _connected = false;
         return 0;
     }
     log_i("SSL connection established");
+    _rememberHost(host, port);
     _connected = true;
     return 1;
 }
 
 int SSLClient::connect(IPAddress ip, uint16_t port, const char *pskIdent, const char *psKey) {
-    return connect(ip.toString().c_str(), port,_pskIdent, _psKey);
+    return connect(ip.toString().c_str(), port, pskIdent, psKey);
 }
 
 int SSLClient::connect(const char *host, uint16_t port, const char *pskIdent, const char *psKey) {
     log_v("start_ssl_client with PSK");
     if(_timeout > 0){
-        sslclient->handshake_timeout = _timeout;
+        sslclient->settings.handshake_timeout = _timeout;
+    }
+    int ret = _connectWarm(host, port, NULL, NULL, NULL, pskIdent, psKey);
+    if (ret == 0) {
+        ret = start_ssl_client(sslclient, host, port, _timeout, NULL, NULL, NULL, pskIdent, psKey);
     }
-    int ret = start_ssl_client(sslclient, host, port, _timeout, NULL, NULL, NULL, _pskIdent, _psKey);
     _lastError = ret;
     if (ret < 0) {
         log_e("start_ssl_client: %d", ret);
-        stop();
+        _teardown();
         return 0;
     }
+    _rememberHost(host, port);
     _connected = true;
     return 1;
 }
 
+/**
+ * @brief Connects again to the host and port of the last successful connect. With warm
+ *        reconnect enabled the kept SSL context is reused and only the session is reset.
+ * 
+ * @return int 1 on success, 0 on failure.
+ */
+int SSLClient::reconnect() {
+  if (_host[0] == '\0') {
+    log_e("reconnect() called before a successful connect()");
+    return 0;
+  }
+  return connect(_host, _port);
+}
+
+/**
+ * @brief Starts a connection without waiting for the TLS handshake. The transport connect
+ *        itself is still blocking, as the Client interface offers nothing else. Call poll()
+ *        from the main loop until it returns SSL_CLIENT_HANDSHAKE_DONE or
+ *        SSL_CLIENT_HANDSHAKE_ERROR; the handshake timeout is checked by poll().
+ * 
+ * @param host 
+ * @param port 
+ * @return int 1 if the handshake has been started, 0 on failure.
+ */
+int SSLClient::connectAsync(const char *host, uint16_t port) {
+  log_d("Connecting to %s:%d without blocking", host, port);
+  if (_timeout > 0) {
+    sslclient->settings.handshake_timeout = _timeout;
+  }
+
+  bool psk = _pskIdent && _psKey;
+  const char *rootCABuff = psk ? NULL : _CA_cert;
+  const char *cli_cert = psk ? NULL : _cert;
+  const char *cli_key = psk ? NULL : _private_key;
+  const char *pskIdent = psk ? _pskIdent : NULL;
+  const char *psKey = psk ? _psKey : NULL;
+
+  int ret;
+  if (_canConnectWarm(host, port, rootCABuff, cli_cert, cli_key, pskIdent, psKey)) {
+    ret = reset_ssl_client(sslclient, host, port);
+  } else {
+    ret = begin_ssl_client(sslclient, host, port, rootCABuff, cli_cert, cli_key, pskIdent, psKey);
+  }
+
+  _lastError = ret;
+  if (ret < 0) {
+    log_e("begin_ssl_client: %d", ret);
+    _teardown();
+    return 0;
+  }
+
+  _rememberHost(host, port);
+  _connected = false;
+  _handshaking = true;
+  return 1;
+}
+
+/**
+ * @brief Advances a handshake started by connectAsync() without blocking. mbedtls is only
+ *        called when the transport has data for it, so an idle poll() is cheap.
+ * 
+ * @return int SSL_CLIENT_HANDSHAKE_IN_PROGRESS, SSL_CLIENT_HANDSHAKE_DONE once connected, or
+ *         SSL_CLIENT_HANDSHAKE_ERROR if the handshake failed, timed out or was never started;
+ *         lastError() has the details.
+ */
+int SSLClient::poll() {
+  if (_connected) {
+    return SSL_CLIENT_HANDSHAKE_DONE;
+  }
+
+  if (!_handshaking) {
+    return SSL_CLIENT_HANDSHAKE_ERROR;
+  }
+
+  int ret = poll_ssl_handshake(sslclient, _host, _port);
+  if (ret == SSL_CLIENT_HANDSHAKE_IN_PROGRESS) {
+    return SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  }
+
+  if (ret < 0) {
+    _lastError = ret;
+    log_e("poll_ssl_handshake: %d", ret);
+    _teardown();
+    return SSL_CLIENT_HANDSHAKE_ERROR;
+  }
+
+  log_i("SSL connection established");
+  _handshaking = false;
+  _lastError = 0;
+  _connected = true;
+  return SSL_CLIENT_HANDSHAKE_DONE;
+}
+
 int SSLClient::peek(){
     if(_peek >= 0){
         return _peek;
     }
+    if (_readBuffer != nullptr && available() > 0) {
+        return _readBuffer[_readPos];
+    }
     _peek = timedRead();
     return _peek;
 }
 
+/**
+ * \brief               Look at the received data without copying it. Hands out the peeked byte,
+ *                      the unread part of the read-ahead buffer, or the unread part of the current
+ *                      record inside mbedtls, in that order. The pointer is valid until the next
+ *                      call that reads, consumes or stops.
+ * 
+ * \param data          Set to the first unread byte, or nullptr if there is none.
+ * \return int          Number of bytes at *data, 0 if nothing has arrived, < 0 on error after
+ *                      the connection has been stopped.
+ */
+int SSLClient::peekSpan(const uint8_t **data) {
+  *data = nullptr;
+
+  if (_peek >= 0) {
+    _peekByte = (uint8_t)_peek;
+    *data = &_peekByte;
+    return 1;
+  }
+
+  if (_readPos < _readLen) {
+    *data = &_readBuffer[_readPos];
+    return (int)(_readLen - _readPos);
+  }
+
+  if (!_connected) {
+    return 0;
+  }
+
+  int len = peek_ssl_receive(sslclient, data);
+  if (len > 0) {
+    return len;
+  }
+
+  len = available(); // processes the next record if one has arrived
+  if (len <= 0) {
+    return len;
+  }
+
+  if (_readPos < _readLen) {
+    *data = &_readBuffer[_readPos];
+    return (int)(_readLen - _readPos);
+  }
+
+  return peek_ssl_receive(sslclient, data);
+}
+
+/**
+ * \brief               Drop bytes handed out by peekSpan().
+ * 
+ * \param size          Number of bytes to drop.
+ * \return size_t       Number of bytes dropped, less than size if less was available.
+ */
+size_t SSLClient::consume(size_t size) {
+  size_t done = 0;
+
+  if (size > 0 && _peek >= 0) {
+    _peek = -1;
+    done++;
+  }
+
+  if (done < size && _readPos < _readLen) {
+    size_t len = _readLen - _readPos;
+    if (len > size - done) {
+      len = size - done;
+    }
+    _readPos += len;
+    done += len;
+  }
+
+  if (done < size && _connected) {
+    done += consume_ssl_receive(sslclient, size - done);
+  }
+
+  return done;
+}
+
+/**
+ * \brief               Waits for received data like Stream::timedRead(), but for a whole span.
+ * 
+ * \param data          Set to the first unread byte, or nullptr if there is none.
+ * \return int          Number of bytes at *data, 0 on timeout or when the connection has closed.
+ */
+int SSLClient::_timedSpan(const uint8_t **data) {
+  _startMillis = millis();
+
+  do {
+    int len = peekSpan(data);
+    if (len > 0) {
+      return len;
+    }
+
+    if (len < 0 || !connected()) {
+      break;
+    }
+  } while (millis() - _startMillis < Stream::_timeout);
+
+  *data = nullptr;
+  return 0;
+}
+
+/**
+ * \brief               Length of the longest prefix of target that ends the matched prefix
+ *                      followed by c. Lets the search carry a partial match across spans.
+ * 
+ * \param target        The string searched for.
+ * \param matched       Number of target bytes matched so far, less than its length.
+ * \param c             The next received byte.
+ * \return size_t       The new number of matched bytes.
+ */
+static size_t nextMatch(const char *target, size_t matched, uint8_t c) {
+  for (size_t k = matched + 1; k > 0; k--) {
+    if ((uint8_t)target[k - 1] == c && memcmp(target, target + matched + 1 - k, k - 1) == 0) {
+      return k;
+    }
+  }
+  return 0;
+}
+
+/**
+ * \brief               Skips the first byte of data that can start a match, using memchr.
+ * 
+ * \return size_t       Offset of that byte, or len if there is none.
+ */
+static size_t skipToCandidate(const uint8_t *data, size_t len, const char *target, size_t targetLen, const char *terminator, size_t termLen) {
+  size_t offset = len;
+
+  if (targetLen > 0) {
+    const uint8_t *hit = (const uint8_t *)memchr(data, (uint8_t)target[0], len);
+    if (hit != nullptr) {
+      offset = hit - data;
+    }
+  }
+
+  if (termLen > 0) {
+    const uint8_t *hit = (const uint8_t *)memchr(data, (uint8_t)terminator[0], offset);
+    if (hit != nullptr) {
+      offset = hit - data;
+    }
+  }
+
+  return offset;
+}
+
+bool SSLClient::find(const char *target) {
+  return findUntil(target, strlen(target), NULL, 0);
+}
+
+bool SSLClient::find(const char *target, size_t length) {
+  return findUntil(target, length, NULL, 0);
+}
+
+bool SSLClient::findUntil(const char *target, const char *terminator) {
+  return findUntil(target, strlen(target), terminator, terminator != NULL ? strlen(terminator) : 0);
+}
+
+/**
+ * \brief               Reads until target is found, the terminator is found or the stream times
+ *                      out, like Stream::findUntil(). Scans the decrypted data span by span instead
+ *                      of one timedRead() per byte.
+ * 
+ * \param target        The string searched for.
+ * \param targetLen     Length of target.
+ * \param terminator    Stop searching after this string, may be NULL.
+ * \param termLen       Length of terminator, 0 for none.
+ * \return bool         True if target was found; everything up to its end has been consumed.
+ */
+bool SSLClient::findUntil(const char *target, size_t targetLen, const char *terminator, size_t termLen) {
+  if (targetLen == 0) {
+    return true;
+  }
+
+  size_t matched = 0;
+  size_t termMatched = 0;
+  const uint8_t *data = nullptr;
+  int len = 0;
+
+  while ((len = _timedSpan(&data)) > 0) {
+    size_t i = 0;
+
+    while (i < (size_t)len) {
+      if (matched == 0 && termMatched == 0) {
+        i += skipToCandidate(&data[i], len - i, target, targetLen, terminator, termLen);
+        if (i == (size_t)len) {
+          break;
+        }
+      }
+
+      matched = nextMatch(target, matched, data[i]);
+      if (termLen > 0) {
+        termMatched = nextMatch(terminator, termMatched, data[i]);
+      }
+      i++;
+
+      if (matched == targetLen) {
+        (void)consume(i);
+        return true;
+      }
+
+      if (termLen > 0 && termMatched == termLen) {
+        (void)consume(i);
+        return false;
+      }
+    }
+
+    (void)consume(len);
+  }
+
+  return false;
+}
+
+/**
+ * \brief               Reads into buffer until the terminator, like Stream::readBytesUntil(). The
+ *                      terminator is consumed but not stored. Whole spans are scanned with memchr
+ *                      and copied in one go.
+ * 
+ * \param terminator    Byte that ends the read.
+ * \param buffer        Buffer to read into.
+ * \param length        Size of the buffer.
+ * \return size_t       Number of bytes stored, 0 on timeout with nothing read.
+ */
+size_t SSLClient::readBytesUntil(char terminator, char *buffer, size_t length) {
+  size_t index = 0;
+
+  while (index < length) {
+    const uint8_t *data = nullptr;
+    int len = _timedSpan(&data);
+    if (len <= 0) {
+      break;
+    }
+
+    size_t n = length - index < (size_t)len ? length - index : (size_t)len;
+    const uint8_t *hit = (const uint8_t *)memchr(data, (uint8_t)terminator, n);
+
+    if (hit != nullptr) {
+      n = hit - data;
+      memcpy(&buffer[index], data, n);
+      index += n;
+      (void)consume(n + 1);
+      break;
+    }
+
+    memcpy(&buffer[index], data, n);
+    index += n;
+    (void)consume(n);
+  }
+
+  return index;
+}
+
+/**
+ * \brief               Reads a String until the terminator, like Stream::readStringUntil().
+ * 
+ * \param terminator    Byte that ends the read, consumed but not stored.
+ * \return String       The bytes read before the terminator or the timeout.
+ */
+String SSLClient::readStringUntil(char terminator) {
+  String ret;
+
+  for (;;) {
+    const uint8_t *data = nullptr;
+    int len = _timedSpan(&data);
+    if (len <= 0) {
+      break;
+    }
+
+    const uint8_t *hit = (const uint8_t *)memchr(data, (uint8_t)terminator, len);
+    size_t n = hit != nullptr ? (size_t)(hit - data) : (size_t)len;
+
+    (void)ret.concat((const char *)data, n);
+    if (hit != nullptr) {
+      (void)consume(n + 1);
+      break;
+    }
+    (void)consume(n);
+  }
+
+  return ret;
+}
+
 size_t SSLClient::write(uint8_t data)
 {
     return write(&data, 1);
@@ -175,6 +650,9 @@ size_t SSLClient::write(uint8_t data)
 
 int SSLClient::read()
 {
+    if (_peek < 0 && _readPos < _readLen) {
+        return _readBuffer[_readPos++];
+    }
     uint8_t data = -1;
     int res = read(&data, 1);
     if (res < 0) {
@@ -183,17 +661,173 @@ int SSLClient::read()
     return data;
 }
 
+/**
+ * \brief               Writes data to the sslclient. Without a write buffer every call becomes
+ *                      its own TLS record. With one, small writes are gathered and sent as one
+ *                      record on flush(), when the buffer fills, before reading, or once the
+ *                      write delay has passed.
+ * 
+ * \param buf           Data to write.
+ * \param size          Number of bytes.
+ * \return size_t       The number of bytes written or buffered, 0 on error.
+ */
 size_t SSLClient::write(const uint8_t *buf, size_t size)
 {
     if (!_connected) {
         return 0;
     }
-    int res = send_ssl_data(sslclient, buf, size);
-    if (res < 0) {
-        stop();
-        res = 0;
+
+    if (_writeBuffer == nullptr) {
+        int res = send_ssl_data(sslclient, buf, size);
+        if (res == MBEDTLS_ERR_SSL_WANT_WRITE || res == MBEDTLS_ERR_SSL_WANT_READ) {
+            return 0; // stalled past the send timeout, write the same data again to go on
+        }
+        if (res < 0) {
+            stop();
+            res = 0;
+        }
+        return res;
     }
-    return res;
+
+    if (_writeBuffered + size > _writeBufferSize && !_flushWriteBuffer()) {
+        return 0;
+    }
+
+    if (size >= _writeBufferSize) {
+        return _sendAll(buf, size); // nothing to gather, skip the copy
+    }
+
+    if (_writeBuffered == 0) {
+        _writeBufferedSince = millis();
+    }
+    memcpy(&_writeBuffer[_writeBuffered], buf, size);
+    _writeBuffered += size;
+
+    if (_writeBuffered == _writeBufferSize) {
+        (void)_flushWriteBuffer();
+    } else {
+        _flushIfDue();
+    }
+    return size;
+}
+
+/**
+ * \brief               Writes several buffers in order as if they were one. With a write buffer set
+ *                      they go through write(). Otherwise pieces smaller than
+ *                      SSL_CLIENT_WRITEV_STAGE_SIZE are gathered on the stack and sent as one
+ *                      record, and larger pieces are encrypted in place without a copy.
+ * 
+ * \param iov           The buffers to write.
+ * \param count         Number of buffers.
+ * \return size_t       The number of bytes written; less than the total if the connection failed.
+ */
+size_t SSLClient::writev(const ssl_iovec *iov, size_t count) {
+  size_t total = 0;
+
+  if (!_connected) {
+    return 0;
+  }
+
+  if (_writeBuffer != nullptr) {
+    for (size_t i = 0; i < count; i++) {
+      size_t written = write((const uint8_t *)iov[i].iov_base, iov[i].iov_len);
+      total += written;
+      if (written < iov[i].iov_len) {
+        break;
+      }
+    }
+    return total;
+  }
+
+  uint8_t stage[SSL_CLIENT_WRITEV_STAGE_SIZE];
+  size_t staged = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *piece = (const uint8_t *)iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+
+    if (staged > 0 && (len >= sizeof(stage) || staged + len > sizeof(stage))) {
+      size_t sent = _sendAll(stage, staged);
+      total += sent;
+      if (sent < staged) {
+        return total;
+      }
+      staged = 0;
+    }
+
+    if (len >= sizeof(stage)) {
+      size_t sent = _sendAll(piece, len);
+      total += sent;
+      if (sent < len) {
+        return total;
+      }
+      continue;
+    }
+
+    memcpy(&stage[staged], piece, len);
+    staged += len;
+  }
+
+  if (staged > 0) {
+    total += _sendAll(stage, staged);
+  }
+  return total;
+}
+
+/**
+ * \brief               Sends the whole buffer, as mbedtls may take less than asked per call.
+ *                      A send that stalls past the send timeout stops the connection, as the
+ *                      data cannot be handed back to the caller.
+ * 
+ * \param buf           Data to send.
+ * \param size          Number of bytes.
+ * \return size_t       The number of bytes sent; less than size if the connection failed.
+ */
+size_t SSLClient::_sendAll(const uint8_t *buf, size_t size) {
+  size_t sent = 0;
+
+  while (sent < size) {
+    int res = send_ssl_data(sslclient, &buf[sent], size - sent);
+    if (res <= 0) {
+      stop();
+      break;
+    }
+    sent += res;
+  }
+  return sent;
+}
+
+/**
+ * \brief               Sends the buffered bytes as one record (or as few as the fragment size allows).
+ * 
+ * \return bool         False if the connection failed and has been stopped.
+ */
+bool SSLClient::_flushWriteBuffer() {
+  size_t pending = _writeBuffered;
+  _writeBuffered = 0; // stop() must not flush again if the send fails
+
+  if (pending == 0) {
+    return true;
+  }
+  return _sendAll(_writeBuffer, pending) == pending;
+}
+
+/**
+ * \brief               Flushes the write buffer if data has waited longer than the write delay.
+ */
+void SSLClient::_flushIfDue() {
+  if (_writeDelay > 0 && _writeBuffered > 0 && millis() - _writeBufferedSince >= _writeDelay) {
+    (void)_flushWriteBuffer();
+  }
+}
+
+/**
+ * \brief               Sends any buffered writes.
+ */
+void SSLClient::flush() {
+  if (_connected && _flushWriteBuffer()) {
+    (void)flush_ssl_output(sslclient);
+  }
 }
 
 /**
@@ -207,6 +841,10 @@ size_t SSLClient::write(const uint8_t *buf, size_t size)
  */
 int SSLClient::read(uint8_t *buf, size_t size) {
   log_v("This is the iClient->read() implementation");
+  if (_readBuffer != nullptr && buf != nullptr && size > 0) {
+    return _readBuffered(buf, size);
+  }
+
   int peeked = 0;
   int avail = available();
 
@@ -240,10 +878,100 @@ int SSLClient::read(uint8_t *buf, size_t size) {
   return res + peeked; // Return the number of bytes read + the number of bytes peeked.
 }
 
+/**
+ * \brief               Reads through the read-ahead buffer. A peeked byte comes first; reads at
+ *                      least as large as the buffer go straight to mbedtls when it is empty.
+ * 
+ * \param buf           Buffer to read into. 
+ * \param size          Size of the buffer, at least 1.
+ * \return int          The number of bytes read, -1 if there is nothing to read or on error.
+ */
+int SSLClient::_readBuffered(uint8_t *buf, size_t size) {
+  int peeked = 0;
+
+  _flushIfDue();
+
+  if (_peek >= 0) {
+    buf[0] = _peek;
+    _peek = -1;
+    if (--size == 0) {
+      return 1;
+    }
+    buf++;
+    peeked = 1;
+  }
+
+  if (_readPos == _readLen && size >= _readBufferSize && _connected) {
+    if (_writeBuffered > 0) {
+      (void)_flushWriteBuffer();
+    }
+    int res = get_ssl_receive(sslclient, buf, size);
+    if (res > 0) {
+      return res + peeked;
+    }
+    if (res != MBEDTLS_ERR_SSL_WANT_READ && res != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      stop();
+    }
+    return peeked ? peeked : -1;
+  }
+
+  if (_readPos == _readLen) {
+    (void)_fillReadBuffer();
+  }
+
+  size_t len = _readLen - _readPos;
+  if (len > size) {
+    len = size;
+  }
+
+  if (len == 0) {
+    return peeked ? peeked : -1;
+  }
+
+  memcpy(buf, &_readBuffer[_readPos], len);
+  _readPos += len;
+  return (int)len + peeked;
+}
+
+/**
+ * \brief               Refills the empty read-ahead buffer with the decrypted contents of the
+ *                      next record (or as much of it as fits).
+ * 
+ * \return int          The number of bytes buffered, 0 if nothing has arrived, < 0 on error
+ *                      after the connection has been stopped.
+ */
+int SSLClient::_fillReadBuffer() {
+  _readPos = 0;
+  _readLen = 0;
+
+  if (!_connected) {
+    return 0;
+  }
+
+  if (_writeBuffered > 0) {
+    (void)_flushWriteBuffer();
+  }
+
+  int res = get_ssl_receive(sslclient, _readBuffer, _readBufferSize);
+  if (res > 0) {
+    _readLen = res;
+    return res;
+  }
+
+  if (res == 0 || res == MBEDTLS_ERR_SSL_WANT_READ || res == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    return 0;
+  }
+
+  stop();
+  return res;
+}
+
 /**
  * \brief               Returns how many bytes of data are available to be read from the sslclient.
  *                      It takes into account both directly readable bytes and a potentially "peeked" byte.
- *                      If there's an error or the client is not connected, it handles these scenarios appropriately.
+ *                      Records are only processed when ciphertext is waiting in the transport and
+ *                      nothing decrypted is left, so polling an idle connection does no crypto work
+ *                      and no receive BIO calls.
  * 
  * \return int           1 if a byte has been peeked and the client is not connected.
  * \return int          < 1 if client is connected and there is an error from data_to_read().
@@ -255,8 +983,43 @@ int SSLClient::available() {
   if (!_connected) {
     return peeked;
   }
+
+  if (_writeBuffered > 0) {
+    (void)_flushWriteBuffer(); // the peer is unlikely to answer a request it has not received
+  }
+
+  if (_readBuffer != nullptr) {
+    if (_readPos < _readLen) {
+      return peeked + (int)(_readLen - _readPos);
+    }
+
+    if (data_decrypted(sslclient) == 0 && !data_incoming(sslclient)) {
+      if (_idleRelease > 0) {
+        (void)release_idle_ssl_buffers(sslclient, _idleRelease);
+      }
+      return peeked;
+    }
+
+    int res = _fillReadBuffer();
+    if (res < 0) {
+      return peeked ? peeked : res;
+    }
+    return peeked + (int)(_readLen - _readPos);
+  }
+
+  int res = data_decrypted(sslclient);
+  if (res > 0) {
+    return res + peeked;
+  }
+
+  if (!data_incoming(sslclient)) {
+    if (_idleRelease > 0) {
+      (void)release_idle_ssl_buffers(sslclient, _idleRelease);
+    }
+    return peeked;
+  }
   
-  int res = data_to_read(sslclient); // how many bytes available to read.
+  res = data_to_read(sslclient); // how many bytes available to read.
   
   if (res < 0) {
     stop();
@@ -266,12 +1029,26 @@ int SSLClient::available() {
   return res+peeked;
 }
 
+/**
+ * \brief               Whether the connection is up, from tracked state and the transport's own
+ *                      connected(). Nothing is read or decrypted; buffered writes older than the
+ *                      write delay are sent, so a sketch that only polls connected() still gets
+ *                      them out. After the transport has closed it stays true while received
+ *                      data is left to read.
+ * 
+ * \return uint8_t      1 if connected or data is left to read, 0 otherwise.
+ */
 uint8_t SSLClient::connected()
 {
-    uint8_t dummy = 0;
-    read(&dummy, 0);
+    if (!_connected) {
+        return 0;
+    }
 
-    return _connected;
+    if (sslclient->client->connected()) {
+        return 1;
+    }
+
+    return _peek >= 0 || _readPos < _readLen || data_decrypted(sslclient) > 0 || data_incoming(sslclient);
 }
 
 void SSLClient::setCACert (const char *rootCA)
@@ -365,9 +1142,349 @@ int SSLClient::lastError(char *buf, const size_t size)
 
 void SSLClient::setHandshakeTimeout(unsigned long handshake_timeout)
 {
-    sslclient->handshake_timeout = handshake_timeout * 1000;
+    sslclient->settings.handshake_timeout = handshake_timeout * 1000;
 }
 
 void SSLClient::setClient(Client* client){
     sslclient->client = client;
 }
+
+/**
+ * \brief           Share a TLS session cache with this client. Sessions are offered on
+ *                  connect and saved after every successful handshake.
+ * 
+ * \param cache     SSLSessionCache* - The cache, or nullptr to disable resumption.
+ */
+void SSLClient::setSessionCache(SSLSessionCache *cache) {
+  sslclient->settings.session_cache = cache;
+}
+
+/**
+ * \brief               Use pre-parsed credentials instead of the PEM buffers and hex PSK.
+ *                      When set, setCACert(), setCertificate(), setPrivateKey() and
+ *                      setPreSharedKey() are ignored on connect.
+ * 
+ * \param credentials   SSLCredentials* - The shared credentials, or nullptr to parse the buffers again.
+ */
+void SSLClient::setCredentials(SSLCredentials *credentials) {
+  sslclient->settings.credentials = credentials;
+}
+
+/**
+ * \brief           Attach a shared, frozen SSLConfig. It replaces the per-connection
+ *                  configuration, credentials and certificate setters on connect.
+ * 
+ * \param config    SSLConfig* - The shared configuration, or nullptr to detach.
+ */
+void SSLClient::setConfig(SSLConfig *config) {
+  if (sslclient->settings.config == config) {
+    return;
+  }
+
+  if (sslclient->settings.config != nullptr) {
+    sslclient->settings.config->release();
+  }
+
+  if (config != nullptr) {
+    config->retain();
+  }
+  sslclient->settings.config = config;
+}
+
+/**
+ * \brief           Keep the SSL context across stop() so that the next connect to the same
+ *                  host only resets the session (mbedtls_ssl_session_reset) instead of
+ *                  rebuilding configuration, credentials and record buffers.
+ *                  The context is freed when the client is destroyed or the mode is turned off.
+ *                  Enabled during a connection, it takes effect from the next connect, as the
+ *                  parsed credentials of the current one are already freed. A connect with
+ *                  other credentials always starts from scratch.
+ * 
+ * \param enable    bool - True to keep the context across stop().
+ */
+void SSLClient::setWarmReconnect(bool enable) {
+  sslclient->settings.warm_reconnect = enable;
+
+  if (!enable && !_connected && ssl_client_is_set_up(sslclient)) {
+    _teardown();
+  }
+}
+
+/**
+ * \brief           Wait for transport data with a hook instead of polling available() every
+ *                  SSL_CLIENT_RECV_POLL_INTERVAL ms while a read timeout is running.
+ * 
+ * \param hook      ssl_client_ready_fn - Blocks until data may be available, or nullptr to poll.
+ * \param arg       void* - Passed to the hook, e.g. a semaphore handle.
+ */
+void SSLClient::setReceiveReadyHook(ssl_client_ready_fn hook, void *arg) {
+  sslclient->settings.recv_ready = hook;
+  sslclient->settings.recv_ready_arg = arg;
+}
+
+/**
+ * \brief           Longest time a write may wait for a full transport before giving up.
+ * 
+ * \param ms        unsigned long - The send timeout in milliseconds, 0 to never wait.
+ */
+void SSLClient::setSendTimeout(unsigned long ms) {
+  sslclient->settings.send_timeout = ms;
+}
+
+/**
+ * \brief           Wait for room in the transport with a hook instead of sleeping
+ *                  SSL_CLIENT_SEND_POLL_INTERVAL ms between send attempts.
+ * 
+ * \param hook      ssl_client_ready_fn - Blocks until the transport may take data, or nullptr.
+ * \param arg       void* - Passed to the hook.
+ */
+void SSLClient::setSendReadyHook(ssl_client_ready_fn hook, void *arg) {
+  sslclient->settings.send_ready = hook;
+  sslclient->settings.send_ready_arg = arg;
+}
+
+/**
+ * \brief           Be told when a write finds the transport full, e.g. to slow down a producer.
+ * 
+ * \param callback  ssl_client_backpressure_fn - Returns false to give up the write at once.
+ * \param arg       void* - Passed to the callback.
+ */
+void SSLClient::setBackpressureCallback(ssl_client_backpressure_fn callback, void *arg) {
+  sslclient->settings.backpressure = callback;
+  sslclient->settings.backpressure_arg = arg;
+}
+
+/**
+ * \brief           Gather small writes into one TLS record instead of sending one record per
+ *                  write(). Pending data is sent first. No memory is allocated; the buffer
+ *                  must outlive the client or be replaced. A size of up to the maximum
+ *                  fragment length (16384 bytes by default) fills whole records.
+ * 
+ * \param buffer    uint8_t* - The buffer, or nullptr to send every write() at once.
+ * \param size      size_t - Size of the buffer in bytes.
+ */
+void SSLClient::setWriteBuffer(uint8_t *buffer, size_t size) {
+  flush();
+  _writeBuffered = 0;
+
+  if (buffer == nullptr || size == 0) {
+    _writeBuffer = nullptr;
+    _writeBufferSize = 0;
+    return;
+  }
+  _writeBuffer = buffer;
+  _writeBufferSize = size;
+}
+
+/**
+ * \brief           Nagle-style deadline for the write buffer. Buffered data older than this
+ *                  is sent by the next write() or read(); available() and a read that goes
+ *                  to the transport send it at once. connected() never sends. There is no
+ *                  timer, so a sketch that only writes and checks connected() must call
+ *                  flush().
+ * 
+ * \param ms        uint32_t - The deadline in milliseconds, 0 to only send on flush(), a full
+ *                  buffer or a read.
+ */
+void SSLClient::setWriteDelay(uint32_t ms) {
+  _writeDelay = ms;
+}
+
+/**
+ * \brief           Encrypt large writes record by record into one contiguous buffer and hand
+ *                  it to the transport in as few writes as possible, e.g. to save AT+CIPSEND
+ *                  round trips on a modem. The buffer bounds how much ciphertext is held
+ *                  back; a few records' worth (a record is the fragment length plus up to
+ *                  about 90 bytes) is enough. No memory is allocated. A write returns once
+ *                  the batch is out; if the transport does not take it within the send
+ *                  timeout (see setSendTimeout()), the write fails and the connection stops.
+ * 
+ * \param buffer    uint8_t* - The buffer, or nullptr to send every record on its own.
+ * \param size      size_t - Size of the buffer in bytes.
+ */
+void SSLClient::setOutputBatchBuffer(uint8_t *buffer, size_t size) {
+  if (_connected) {
+    (void)flush_ssl_output(sslclient);
+  }
+
+  sslclient->settings.out_batch = size > 0 ? buffer : nullptr;
+  sslclient->settings.out_batch_size = buffer != nullptr ? size : 0;
+  sslclient->out_batch_len = 0;
+}
+
+/**
+ * \brief           Read ahead into a plaintext buffer so that byte-wise read(), peek() and
+ *                  available() are served from memory instead of going through mbedtls for
+ *                  every byte. The buffer is refilled from whole records once it is empty.
+ *                  No memory is allocated; buffered data is dropped.
+ * 
+ * \param buffer    uint8_t* - The buffer, or nullptr to read straight from mbedtls.
+ * \param size      size_t - Size of the buffer in bytes.
+ */
+void SSLClient::setReadBuffer(uint8_t *buffer, size_t size) {
+  _readBuffer = size > 0 ? buffer : nullptr;
+  _readBufferSize = _readBuffer != nullptr ? size : 0;
+  _readPos = 0;
+  _readLen = 0;
+}
+
+/**
+ * \brief           Negotiate smaller records (RFC 6066) on the next connect, if the server
+ *                  supports it. Ignored while a shared SSLConfig is attached; use
+ *                  SSLConfig::setMaxFragmentLength() there.
+ * 
+ * \param length    size_t - 512, 1024, 2048 or 4096 bytes, 0 for full 16 KiB records.
+ * \return bool     False if the length is not allowed.
+ */
+bool SSLClient::setMaxFragmentLength(size_t length) {
+  int code = ssl_max_frag_len_code(length);
+
+  if (code < 0) {
+    log_e("Maximum fragment length %u not supported", (unsigned int)length);
+    return false;
+  }
+  sslclient->settings.max_frag_len = (unsigned char)code;
+  return true;
+}
+
+/**
+ * \brief           Shrink the record buffers while the connection is idle, see
+ *                  release_idle_ssl_buffers(). The check runs from available(), and the
+ *                  buffers grow back before the next record is read or written.
+ *                  Only works with mbedtls built with MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH,
+ *                  which the stock ESP32 Arduino core does not set.
+ * 
+ * \param idle_ms   unsigned long - Quiet time before the buffers are released, 0 to keep them.
+ * \return bool     False if idle_ms is not 0 and mbedtls cannot resize its buffers.
+ */
+bool SSLClient::setIdleBufferRelease(unsigned long idle_ms) {
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+  _idleRelease = idle_ms;
+  return true;
+#else
+  _idleRelease = 0;
+  if (idle_ms > 0) {
+    log_e("Releasing idle buffers needs mbedtls built with MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH");
+    return false;
+  }
+  return true;
+#endif
+}
+
+/**
+ * \brief           Take the memory of the next connections from an arena instead of the heap.
+ *                  Change it only while disconnected: blocks already allocated stay where
+ *                  they are and are returned to their own arena when freed.
+ * 
+ * \param arena     SSLArena* - A started arena, NULL for the heap.
+ */
+void SSLClient::setArena(SSLArena *arena) {
+  sslclient->settings.arena = arena;
+}
+
+/**
+ * \brief           Count what mbedtls allocates for this client, split by connection phase,
+ *                  in a caller-owned tracker. The tracker holds a table of
+ *                  SSL_MEMORY_TRACKED_BLOCKS entries; give each client its own and keep it
+ *                  until it is detached or the client is destroyed. No memory is allocated.
+ * 
+ * \param tracker   SSLMemoryTracker* - The tracker to start, nullptr to stop counting and
+ *                  detach the current one.
+ * \return bool     False if mbedtls was built without MBEDTLS_PLATFORM_MEMORY.
+ */
+bool SSLClient::setMemoryStats(SSLMemoryTracker *tracker) {
+  if (_memory != nullptr && _memory != tracker) {
+    sslclient->settings.memory = NULL;
+    _memory->end();
+    _memory = nullptr;
+  }
+
+  if (tracker == nullptr) {
+    return true;
+  }
+
+  if (!tracker->begin()) {
+    return false;
+  }
+  _memory = tracker;
+  sslclient->settings.memory = tracker;
+  return true;
+}
+
+/**
+ * \brief           Live bytes, peak bytes and allocation counts since setMemoryStats() or
+ *                  resetMemoryStats(), in total and per phase.
+ * 
+ * \return ssl_memory_stats  The figures, all 0 while counting is off.
+ */
+ssl_memory_stats SSLClient::getMemoryStats() {
+  ssl_memory_stats stats;
+
+  if (_memory == nullptr) {
+    memset(&stats, 0, sizeof(stats));
+    return stats;
+  }
+  return _memory->stats();
+}
+
+/**
+ * \brief           Restart peaks and counts, e.g. between two connections; live bytes stay.
+ */
+void SSLClient::resetMemoryStats() {
+  if (_memory != nullptr) {
+    _memory->reset();
+  }
+}
+
+/**
+ * \brief           Where the time of the last handshake went: connect, setup, and for each
+ *                  handshake state the time waiting on I/O and the time computing. Kept after
+ *                  stop(), so a failed or timed out handshake can be examined too.
+ * 
+ * \return ssl_handshake_timing  The breakdown; result is SSL_CLIENT_HANDSHAKE_IN_PROGRESS
+ *                  while a handshake is running.
+ */
+ssl_handshake_timing SSLClient::getHandshakeTiming() {
+  return sslclient->timing;
+}
+
+/**
+ * \brief           Report each handshake's timing when it succeeds or fails, e.g. to
+ *                  aggregate it across devices.
+ * 
+ * \param callback  ssl_client_timing_fn - Called from connect() or poll(), NULL to remove it.
+ * \param arg       void* - Passed to the callback.
+ */
+void SSLClient::setHandshakeTimingCallback(ssl_client_timing_fn callback, void *arg) {
+  sslclient->settings.timing_callback = callback;
+  sslclient->settings.timing_callback_arg = arg;
+}
+
+/**
+ * \brief           Snapshot of the I/O counters: bytes before and after encryption, records,
+ *                  transport calls, retries and handshakes. They are always kept and cost an
+ *                  increment per event.
+ * 
+ * \return ssl_client_counters  The counters since the client was created or resetCounters().
+ */
+ssl_client_counters SSLClient::getCounters() {
+  return sslclient->counters;
+}
+
+/**
+ * \brief           Start the I/O counters again from zero.
+ */
+void SSLClient::resetCounters() {
+  memset(&sslclient->counters, 0, sizeof(sslclient->counters));
+}
+
+/**
+ * \brief           Memory this connection holds right now, see get_ssl_footprint().
+ * 
+ * \return ssl_client_footprint  Sizes in bytes; the record buffers are 0 while not connected.
+ */
+ssl_client_footprint SSLClient::getFootprint() {
+  ssl_client_footprint footprint;
+  get_ssl_footprint(sslclient, &footprint);
+  return footprint;
+}
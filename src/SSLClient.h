@@ -22,6 +22,14 @@
 #include "IPAddress.h"
 #include "ssl_client.h"
 
+/**
+ * One buffer of a writev() call, laid out like POSIX struct iovec.
+ */
+struct ssl_iovec {
+  const void *iov_base;
+  size_t iov_len;
+};
+
 class SSLClient : public Client
 {
 protected:
@@ -29,6 +37,7 @@ protected:
 
   int _lastError = 0;
 	int _peek = -1;
+  uint8_t _peekByte = 0;
   int _timeout = 0;
   const char *_CA_cert;
   const char *_cert;
@@ -37,6 +46,24 @@ protected:
   const char *_psKey; // key in hex for PSK cipher suites
 
   bool _connected = false;
+  bool _handshaking = false;
+
+  uint8_t *_writeBuffer = nullptr;
+  size_t _writeBufferSize = 0;
+  size_t _writeBuffered = 0;
+  uint32_t _writeDelay = 0;
+  unsigned long _writeBufferedSince = 0;
+
+  uint8_t *_readBuffer = nullptr;
+  size_t _readBufferSize = 0;
+  size_t _readPos = 0;
+  size_t _readLen = 0;
+
+  unsigned long _idleRelease = 0;
+  SSLMemoryTracker *_memory = nullptr;
+
+  char _host[SSL_CLIENT_MAX_HOST_LENGTH + 1];
+  uint16_t _port;
 
   Client* _client = nullptr;
 
@@ -53,14 +80,20 @@ public:
   int connect(const char *host, uint16_t port, const char *rootCABuff, const char *cli_cert, const char *cli_key);
   int connect(IPAddress ip, uint16_t port, const char *pskIdent, const char *psKey);
   int connect(const char *host, uint16_t port, const char *pskIdent, const char *psKey);
+  int reconnect();
+  int connectAsync(const char *host, uint16_t port);
+  int poll();
 
 	int peek();
+  int peekSpan(const uint8_t **data);
+  size_t consume(size_t size);
   size_t write(uint8_t data);
   size_t write(const uint8_t *buf, size_t size);
+  size_t writev(const ssl_iovec *iov, size_t count);
   int available();
   int read();
   int read(uint8_t *buf, size_t size);
-  void flush() {}
+  void flush();
   void stop();
   uint8_t connected();
   int lastError(char *buf, const size_t size);
@@ -75,8 +108,43 @@ public:
   bool verify(const char* fingerprint, const char* domain_name);
   void setHandshakeTimeout(unsigned long handshake_timeout);
   void setClient(Client* client);
+  void setSessionCache(SSLSessionCache *cache);
+  void setCredentials(SSLCredentials *credentials);
+  void setConfig(SSLConfig *config);
+  void setWarmReconnect(bool enable);
+  void setReceiveReadyHook(ssl_client_ready_fn hook, void *arg);
+  void setSendTimeout(unsigned long ms);
+  void setSendReadyHook(ssl_client_ready_fn hook, void *arg);
+  void setBackpressureCallback(ssl_client_backpressure_fn callback, void *arg);
+  void setWriteBuffer(uint8_t *buffer, size_t size);
+  void setWriteDelay(uint32_t ms);
+  void setOutputBatchBuffer(uint8_t *buffer, size_t size);
+  void setReadBuffer(uint8_t *buffer, size_t size);
+  bool setMaxFragmentLength(size_t length);
+  bool setIdleBufferRelease(unsigned long idle_ms);
+  void setArena(SSLArena *arena);
+  bool setMemoryStats(SSLMemoryTracker *tracker);
+  ssl_memory_stats getMemoryStats();
+  void resetMemoryStats();
+  ssl_handshake_timing getHandshakeTiming();
+  void setHandshakeTimingCallback(ssl_client_timing_fn callback, void *arg);
+  ssl_client_counters getCounters();
+  void resetCounters();
+  ssl_client_footprint getFootprint();
   int setTimeout(uint32_t seconds){ return 0; }
 
+  using Stream::find;
+  using Stream::findUntil;
+  using Stream::readBytesUntil;
+  bool find(const char *target);
+  bool find(const char *target, size_t length);
+  bool find(char target) { return find(&target, 1); }
+  bool findUntil(const char *target, const char *terminator);
+  bool findUntil(const char *target, size_t targetLen, const char *terminator, size_t termLen);
+  size_t readBytesUntil(char terminator, char *buffer, size_t length);
+  size_t readBytesUntil(char terminator, uint8_t *buffer, size_t length) { return readBytesUntil(terminator, (char *)buffer, length); }
+  String readStringUntil(char terminator);
+
   operator bool() {
     return connected();
   }
@@ -91,6 +159,16 @@ public:
 
 private:
   char *_streamLoad(Stream& stream, size_t size);
+  void _teardown();
+  bool _canConnectWarm(const char *host, uint16_t port, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey);
+  int _connectWarm(const char *host, uint16_t port, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey);
+  void _rememberHost(const char *host, uint16_t port);
+  size_t _sendAll(const uint8_t *buf, size_t size);
+  bool _flushWriteBuffer();
+  void _flushIfDue();
+  int _fillReadBuffer();
+  int _readBuffered(uint8_t *buf, size_t size);
+  int _timedSpan(const uint8_t **data);
 
   //friend class GprsServer;
   using Print::write;
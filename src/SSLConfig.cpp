@@ -0,0 +1,213 @@
+/* Immutable TLS configuration shared by many SSLClient connections.
+ */
+
+#include "Arduino.h"
+#include "SSLConfig.h"
+#include "ssl_client.h"
+
+/**
+ * \brief Construct an empty, unfrozen configuration.
+ */
+SSLConfig::SSLConfig() : _references(0) {
+  mbedtls_ssl_config_init(&_conf);
+  _credentials = NULL;
+  _ciphersuites = NULL;
+  _curves = NULL;
+  _readTimeout = 0;
+  _handshakeTimeout = 0;
+  _maxFragLen = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+  _ready = false;
+}
+
+/**
+ * \brief Destroy the configuration. Every client using it must have been detached.
+ */
+SSLConfig::~SSLConfig() {
+  if (_references.load() > 0) {
+    log_e("SSLConfig destroyed while still used by %u clients", (unsigned int)_references.load());
+  }
+  mbedtls_ssl_config_free(&_conf);
+}
+
+/**
+ * \brief           Report and refuse changes once the configuration is frozen.
+ * 
+ * \param setting   const char* - Name of the setting, for the log. 
+ * \return bool     True if the setting may still be changed. 
+ */
+bool SSLConfig::_mutable(const char *setting) const {
+  if (_ready) {
+    log_w("SSLConfig is frozen, %s ignored", setting);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief               Trust anchors and client identity; must outlive the configuration.
+ * 
+ * \param credentials   SSLCredentials* - Pre-parsed credentials, or nullptr for no verification. 
+ * \return bool         False if the configuration is already frozen. 
+ */
+bool SSLConfig::setCredentials(SSLCredentials *credentials) {
+  if (!_mutable("setCredentials")) {
+    return false;
+  }
+  _credentials = credentials;
+  return true;
+}
+
+/**
+ * \brief               Restrict the ciphersuites offered.
+ * 
+ * \param ciphersuites  const int* - Zero terminated list of MBEDTLS_TLS_* ids; must outlive the configuration. 
+ * \return bool         False if the configuration is already frozen. 
+ */
+bool SSLConfig::setCiphersuites(const int *ciphersuites) {
+  if (!_mutable("setCiphersuites")) {
+    return false;
+  }
+  _ciphersuites = ciphersuites;
+  return true;
+}
+
+/**
+ * \brief           Restrict the elliptic curves offered.
+ * 
+ * \param curves    const mbedtls_ecp_group_id* - MBEDTLS_ECP_DP_NONE terminated list; must outlive the configuration. 
+ * \return bool     False if the configuration is already frozen. 
+ */
+bool SSLConfig::setCurves(const mbedtls_ecp_group_id *curves) {
+  if (!_mutable("setCurves")) {
+    return false;
+  }
+  _curves = curves;
+  return true;
+}
+
+/**
+ * \brief               How long the receive callback waits for data, 0 to return immediately.
+ * 
+ * \param timeout_ms    uint32_t - The timeout in milliseconds. 
+ * \return bool         False if the configuration is already frozen. 
+ */
+bool SSLConfig::setReadTimeout(uint32_t timeout_ms) {
+  if (!_mutable("setReadTimeout")) {
+    return false;
+  }
+  _readTimeout = timeout_ms;
+  return true;
+}
+
+/**
+ * \brief               Handshake timeout for attached clients, 0 keeps each client's own setting.
+ * 
+ * \param timeout_ms    unsigned long - The timeout in milliseconds. 
+ * \return bool         False if the configuration is already frozen. 
+ */
+bool SSLConfig::setHandshakeTimeout(unsigned long timeout_ms) {
+  if (!_mutable("setHandshakeTimeout")) {
+    return false;
+  }
+  _handshakeTimeout = timeout_ms;
+  return true;
+}
+
+/**
+ * \brief           Negotiate smaller records (RFC 6066) for attached clients.
+ * 
+ * \param length    size_t - 512, 1024, 2048 or 4096 bytes, 0 for full 16 KiB records. 
+ * \return bool     False if the configuration is frozen or the length is not allowed. 
+ */
+bool SSLConfig::setMaxFragmentLength(size_t length) {
+  if (!_mutable("setMaxFragmentLength")) {
+    return false;
+  }
+
+  int code = ssl_max_frag_len_code(length);
+  if (code < 0) {
+    log_e("Maximum fragment length %u not supported", (unsigned int)length);
+    return false;
+  }
+  _maxFragLen = (unsigned char)code;
+  return true;
+}
+
+/**
+ * \brief           Build the mbedtls configuration and freeze it.
+ * 
+ * \return int      0 on success, otherwise the mbedtls error code. 
+ */
+int SSLConfig::begin() {
+  if (_ready) {
+    return 0;
+  }
+
+  int ret = configure_ssl_defaults(&_conf);
+
+  if (ret == 0 && _credentials != NULL) {
+    ret = configure_ssl_credentials(&_conf, _credentials);
+  } else if (ret == 0) {
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_NONE);
+    log_i("WARNING: Use certificates for a more secure communication!");
+  }
+
+  if (ret != 0) {
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_ssl_config_init(&_conf);
+    return ret;
+  }
+
+  if (_ciphersuites != NULL) {
+    mbedtls_ssl_conf_ciphersuites(&_conf, _ciphersuites);
+  }
+
+#if defined(MBEDTLS_ECP_C)
+  if (_curves != NULL) {
+    mbedtls_ssl_conf_curves(&_conf, _curves);
+  }
+#endif
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+  if (_maxFragLen != MBEDTLS_SSL_MAX_FRAG_LEN_NONE) {
+    (void)mbedtls_ssl_conf_max_frag_len(&_conf, _maxFragLen); // the code is checked by the setter
+  }
+#endif
+
+  mbedtls_ssl_conf_read_timeout(&_conf, _readTimeout);
+  _ready = true;
+  return 0;
+}
+
+/**
+ * \brief           Free the mbedtls configuration so that it can be changed and built again.
+ * 
+ * \return bool     False if clients still reference the configuration. 
+ */
+bool SSLConfig::end() {
+  if (_references.load() > 0) {
+    log_w("SSLConfig still used by %u clients", (unsigned int)_references.load());
+    return false;
+  }
+
+  mbedtls_ssl_config_free(&_conf);
+  mbedtls_ssl_config_init(&_conf);
+  _ready = false;
+  return true;
+}
+
+/**
+ * \brief Take a reference; called by SSLClient::setConfig().
+ */
+void SSLConfig::retain() {
+  _references++;
+}
+
+/**
+ * \brief Drop a reference; called when a client is detached or destroyed.
+ */
+void SSLConfig::release() {
+  if (_references.load() > 0) {
+    _references--;
+  }
+}
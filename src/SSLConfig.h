@@ -0,0 +1,59 @@
+/* Immutable TLS configuration shared by many SSLClient connections.
+ *
+ * An SSLConfig is filled in once with the setters, frozen with begin() and
+ * then attached to any number of clients with SSLClient::setConfig(). Every
+ * attached client calls mbedtls_ssl_setup() on the same mbedtls_ssl_config,
+ * so defaults, authmode, CA chain, own certificate and RNG are not rebuilt
+ * per connection. Clients hold a reference while attached; end() refuses to
+ * free the configuration while any reference is outstanding.
+ */
+
+#ifndef SSL_CONFIG_H
+#define SSL_CONFIG_H
+
+#include <atomic>
+#include <stdint.h>
+#include "mbedtls/ssl.h"
+#include "SSLCredentials.h"
+
+class SSLConfig {
+public:
+  SSLConfig();
+  ~SSLConfig();
+
+  bool setCredentials(SSLCredentials *credentials);
+  bool setCiphersuites(const int *ciphersuites);
+  bool setCurves(const mbedtls_ecp_group_id *curves);
+  bool setReadTimeout(uint32_t timeout_ms);
+  bool setHandshakeTimeout(unsigned long timeout_ms);
+  bool setMaxFragmentLength(size_t length);
+
+  int begin();
+  bool end();
+
+  bool ready() const { return _ready; }
+  const mbedtls_ssl_config *conf() const { return &_conf; }
+  unsigned long handshakeTimeout() const { return _handshakeTimeout; }
+
+  void retain();
+  void release();
+  uint32_t references() const { return _references.load(); }
+
+private:
+  SSLConfig(const SSLConfig&) = delete;
+  SSLConfig& operator=(const SSLConfig&) = delete;
+
+  bool _mutable(const char *setting) const;
+
+  mbedtls_ssl_config _conf;
+  SSLCredentials *_credentials;
+  const int *_ciphersuites;
+  const mbedtls_ecp_group_id *_curves;
+  uint32_t _readTimeout;
+  unsigned long _handshakeTimeout;
+  unsigned char _maxFragLen;
+  bool _ready;
+  std::atomic<uint32_t> _references;
+};
+
+#endif /* SSL_CONFIG_H */
@@ -0,0 +1,142 @@
+/* Parse-once credential store for SSLClient.
+ */
+
+#include "Arduino.h"
+#include <string.h>
+#include "SSLCredentials.h"
+#include "ssl_client.h"
+
+/**
+ * \brief Construct an empty credential store.
+ */
+SSLCredentials::SSLCredentials() {
+  mbedtls_x509_crt_init(&_ca);
+  mbedtls_x509_crt_init(&_cert);
+  mbedtls_pk_init(&_key);
+  memset(_psk, 0, sizeof(_psk));
+  _pskLen = 0;
+  _pskIdent = NULL;
+  _hasCA = false;
+  _hasCert = false;
+}
+
+/**
+ * \brief Destroy the credential store, freeing every parsed object.
+ */
+SSLCredentials::~SSLCredentials() {
+  clear();
+}
+
+/**
+ * \brief Free every parsed object. Clients still referencing this store must be stopped first.
+ */
+void SSLCredentials::clear() {
+  _clearCA();
+  _clearCertificate();
+  _clearPreSharedKey();
+}
+
+void SSLCredentials::_clearCA() {
+  mbedtls_x509_crt_free(&_ca);
+  mbedtls_x509_crt_init(&_ca);
+  _hasCA = false;
+}
+
+void SSLCredentials::_clearCertificate() {
+  mbedtls_x509_crt_free(&_cert);
+  mbedtls_pk_free(&_key);
+  mbedtls_x509_crt_init(&_cert);
+  mbedtls_pk_init(&_key);
+  _hasCert = false;
+}
+
+void SSLCredentials::_clearPreSharedKey() {
+  memset(_psk, 0, sizeof(_psk));
+  _pskLen = 0;
+  _pskIdent = NULL;
+}
+
+/**
+ * \brief           Parse the root CA chain.
+ * 
+ * \param rootCA    const char* - PEM (or DER) encoded CA chain; only needed during this call.
+ * \return int      0 on success, otherwise the mbedtls error code. 
+ */
+int SSLCredentials::setCACert(const char *rootCA) {
+  _clearCA();
+
+  if (rootCA == NULL) {
+    return 0;
+  }
+
+  log_v("Parsing CA cert");
+  int ret = mbedtls_x509_crt_parse(&_ca, (const unsigned char *)rootCA, strlen(rootCA) + 1);
+  if (ret < 0) {
+    log_e("Unable to parse CA cert (%d)", ret);
+    _clearCA();
+    return ret;
+  }
+
+  _hasCA = true;
+  return 0;
+}
+
+/**
+ * \brief           Parse the client certificate and its private key.
+ * 
+ * \param cli_cert  const char* - PEM encoded client certificate; only needed during this call.
+ * \param cli_key   const char* - PEM encoded private key; only needed during this call.
+ * \return int      0 on success, otherwise the mbedtls error code. 
+ */
+int SSLCredentials::setCertificate(const char *cli_cert, const char *cli_key) {
+  _clearCertificate();
+
+  if (cli_cert == NULL || cli_key == NULL) {
+    return 0;
+  }
+
+  log_v("Parsing client cert");
+  int ret = mbedtls_x509_crt_parse(&_cert, (const unsigned char *)cli_cert, strlen(cli_cert) + 1);
+  if (ret < 0) {
+    log_e("Unable to parse client cert (%d)", ret);
+    _clearCertificate();
+    return ret;
+  }
+
+  log_v("Parsing private key");
+  ret = mbedtls_pk_parse_key(&_key, (const unsigned char *)cli_key, strlen(cli_key) + 1, NULL, 0);
+  if (ret != 0) {
+    log_e("Unable to parse private key (%d)", ret);
+    _clearCertificate();
+    return ret;
+  }
+
+  _hasCert = true;
+  return 0;
+}
+
+/**
+ * \brief           Decode a pre-shared key once.
+ * 
+ * \param pskIdent  const char* - The PSK identity; must outlive the store.
+ * \param psKey     const char* - The key in hex; only needed during this call.
+ * \return int      0 on success, -1 if the key is not valid hex or too long. 
+ */
+int SSLCredentials::setPreSharedKey(const char *pskIdent, const char *psKey) {
+  _clearPreSharedKey();
+
+  if (pskIdent == NULL || psKey == NULL) {
+    return 0;
+  }
+
+  size_t len = 0;
+  if (decode_psk(psKey, _psk, &len) != 0) {
+    log_e("pre-shared key not valid hex or too long");
+    _clearPreSharedKey();
+    return -1;
+  }
+
+  _pskIdent = pskIdent;
+  _pskLen = len;
+  return 0;
+}
@@ -0,0 +1,58 @@
+/* Parse-once credential store for SSLClient.
+ *
+ * Holds the CA chain, client certificate, private key and binary PSK in their
+ * parsed mbedtls form so that connects do not have to parse PEM or decode hex
+ * again. Any number of SSLClient instances may reference one SSLCredentials
+ * object; it is owned by the application and must outlive every client that
+ * uses it. The parsed keys are not locked, so share one object only between
+ * clients that are driven from the same task.
+ */
+
+#ifndef SSL_CREDENTIALS_H
+#define SSL_CREDENTIALS_H
+
+#include <stddef.h>
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+class SSLCredentials {
+public:
+  SSLCredentials();
+  ~SSLCredentials();
+
+  int setCACert(const char *rootCA);
+  int setCertificate(const char *cli_cert, const char *cli_key);
+  int setPreSharedKey(const char *pskIdent, const char *psKey); // psKey in Hex
+  void clear();
+
+  bool hasCACert() const { return _hasCA; }
+  bool hasCertificate() const { return _hasCert; }
+  bool hasPreSharedKey() const { return _pskLen > 0; }
+
+  mbedtls_x509_crt *caCert() { return &_ca; }
+  mbedtls_x509_crt *clientCert() { return &_cert; }
+  mbedtls_pk_context *clientKey() { return &_key; }
+  const unsigned char *psk() const { return _psk; }
+  size_t pskLength() const { return _pskLen; }
+  const char *pskIdentity() const { return _pskIdent; }
+
+private:
+  SSLCredentials(const SSLCredentials&) = delete;
+  SSLCredentials& operator=(const SSLCredentials&) = delete;
+
+  void _clearCA();
+  void _clearCertificate();
+  void _clearPreSharedKey();
+
+  mbedtls_x509_crt _ca;
+  mbedtls_x509_crt _cert;
+  mbedtls_pk_context _key;
+  unsigned char _psk[MBEDTLS_PSK_MAX_LEN];
+  size_t _pskLen;
+  const char *_pskIdent;
+  bool _hasCA;
+  bool _hasCert;
+};
+
+#endif /* SSL_CREDENTIALS_H */
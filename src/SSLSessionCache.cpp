@@ -0,0 +1,333 @@
+/* TLS session cache for SSLClient.
+ *
+ * Sessions are serialised with mbedtls_ssl_session_save() so that every
+ * backend only has to deal with opaque byte strings.
+ */
+
+#include "Arduino.h"
+#include <stdio.h>
+#include <string.h>
+#include "SSLSessionCache.h"
+
+/**
+ * \brief Construct an empty RAM store.
+ */
+SSLSessionMemoryStore::SSLSessionMemoryStore() {
+  clear();
+}
+
+/**
+ * \brief Drop every stored session and wipe the slots.
+ */
+void SSLSessionMemoryStore::clear() {
+  memset(_slots, 0, sizeof(_slots));
+  _clock = 0;
+}
+
+/**
+ * \brief             Find the slot holding key.
+ *
+ * \param key         const char* - The host:port key.
+ * \return Slot*      The slot, or nullptr if the key is not stored.
+ */
+SSLSessionMemoryStore::Slot *SSLSessionMemoryStore::_find(const char *key) {
+  for (size_t i = 0; i < SSL_CLIENT_SESSION_CACHE_SLOTS; i++) {
+    if (_slots[i].len > 0 && strcmp(_slots[i].key, key) == 0) {
+      return &_slots[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * \brief             Pick the slot to overwrite: an empty one, otherwise the least recently used.
+ *
+ * \return Slot*      The slot to reuse.
+ */
+SSLSessionMemoryStore::Slot *SSLSessionMemoryStore::_victim() {
+  Slot *victim = &_slots[0];
+  for (size_t i = 0; i < SSL_CLIENT_SESSION_CACHE_SLOTS; i++) {
+    if (_slots[i].len == 0) {
+      return &_slots[i];
+    }
+
+    if (_slots[i].stamp < victim->stamp) {
+      victim = &_slots[i];
+    }
+  }
+  return victim;
+}
+
+size_t SSLSessionMemoryStore::load(const char *key, uint8_t *buf, size_t size) {
+  Slot *slot = _find(key);
+
+  if (!slot || slot->len > size) {
+    return 0;
+  }
+
+  memcpy(buf, slot->data, slot->len);
+  slot->stamp = ++_clock;
+  return slot->len;
+}
+
+bool SSLSessionMemoryStore::save(const char *key, const uint8_t *buf, size_t len) {
+  if (len == 0 || len > SSL_CLIENT_SESSION_MAX_SIZE || strlen(key) >= SSL_CLIENT_SESSION_KEY_SIZE) {
+    return false;
+  }
+
+  Slot *slot = _find(key);
+  if (!slot) {
+    slot = _victim();
+  }
+
+  strncpy(slot->key, key, SSL_CLIENT_SESSION_KEY_SIZE - 1);
+  slot->key[SSL_CLIENT_SESSION_KEY_SIZE - 1] = '\0';
+  memcpy(slot->data, buf, len);
+  slot->len = len;
+  slot->stamp = ++_clock;
+  return true;
+}
+
+void SSLSessionMemoryStore::remove(const char *key) {
+  Slot *slot = _find(key);
+
+  if (slot) {
+    memset(slot, 0, sizeof(Slot));
+  }
+}
+
+/**
+ * \brief             Construct a file store.
+ *
+ * \param directory   const char* - Directory the session files are kept in; must outlive the store.
+ */
+SSLSessionFileStore::SSLSessionFileStore(const char *directory) {
+  _directory = directory;
+}
+
+/**
+ * \brief             Build the file name for key, replacing characters that are not file system safe.
+ *
+ * \param key         const char* - The host:port key.
+ * \param path        char* - Output buffer.
+ * \param size        size_t - Size of the output buffer.
+ * \return bool       True if the path fitted into the buffer.
+ */
+bool SSLSessionFileStore::_path(const char *key, char *path, size_t size) {
+  int len = snprintf(path, size, "%s/", _directory);
+  if (len < 0 || (size_t)len >= size) {
+    return false;
+  }
+
+  size_t pos = len;
+  for (size_t i = 0; key[i] != '\0' && i < SSL_CLIENT_SESSION_KEY_SIZE; i++) {
+    char c = key[i];
+    bool safe = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '.' || c == '-';
+
+    if (pos + 1 >= size) {
+      return false;
+    }
+    path[pos++] = safe ? c : '_';
+  }
+
+  len = snprintf(&path[pos], size - pos, ".tls");
+  return len >= 0 && (size_t)len < size - pos;
+}
+
+size_t SSLSessionFileStore::load(const char *key, uint8_t *buf, size_t size) {
+  char path[128];
+  if (!_path(key, path, sizeof(path))) {
+    return 0;
+  }
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return 0;
+  }
+
+  size_t len = fread(buf, 1, size, file);
+  int more = fgetc(file);
+  (void)fclose(file);
+
+  if (more != EOF) {
+    log_w("Session file %s is larger than %zu bytes", path, size);
+    return 0;
+  }
+  return len;
+}
+
+bool SSLSessionFileStore::save(const char *key, const uint8_t *buf, size_t len) {
+  char path[128];
+  if (!_path(key, path, sizeof(path))) {
+    return false;
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    log_w("Unable to open %s for writing", path);
+    return false;
+  }
+
+  size_t written = fwrite(buf, 1, len, file);
+  int closed = fclose(file);
+
+  if (written != len || closed != 0) {
+    (void)::remove(path);
+    return false;
+  }
+  return true;
+}
+
+void SSLSessionFileStore::remove(const char *key) {
+  char path[128];
+
+  if (_path(key, path, sizeof(path))) {
+    (void)::remove(path);
+  }
+}
+
+/**
+ * \brief             Construct a session cache on top of the given store.
+ *
+ * \param store       SSLSessionStore& - Backend; must outlive the cache.
+ */
+SSLSessionCache::SSLSessionCache(SSLSessionStore &store) {
+  _store = &store;
+  _hits = 0;
+  _misses = 0;
+}
+
+/**
+ * \brief             Build the cache key for a host and port.
+ *
+ * \param host        const char* - The host name or IP address.
+ * \param port        uint16_t - The port.
+ * \param key         char* - Output buffer of SSL_CLIENT_SESSION_KEY_SIZE bytes.
+ * \return bool       False if host:port does not fit; a truncated key could match another host.
+ */
+bool SSLSessionCache::_key(const char *host, uint16_t port, char *key) {
+  int len = snprintf(key, SSL_CLIENT_SESSION_KEY_SIZE, "%s:%u", host, (unsigned int)port);
+
+  if (len < 0 || (size_t)len >= SSL_CLIENT_SESSION_KEY_SIZE) {
+    log_v("Not caching sessions for %s, the host name is too long", host);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief             Offer the cached session for host:port on a freshly set up SSL context.
+ *                    Must be called after mbedtls_ssl_setup() and before the handshake.
+ *
+ * \param host        const char* - The host name or IP address.
+ * \param port        uint16_t - The port.
+ * \param ssl         mbedtls_ssl_context* - The SSL context to resume on.
+ * \return bool       True if a session was offered.
+ */
+bool SSLSessionCache::restore(const char *host, uint16_t port, mbedtls_ssl_context *ssl) {
+  char key[SSL_CLIENT_SESSION_KEY_SIZE];
+  if (!_key(host, port, key)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  size_t len = _store->load(key, _scratch, sizeof(_scratch));
+  if (len == 0) {
+    log_v("No cached session for %s", key);
+    return false;
+  }
+
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  int ret = mbedtls_ssl_session_load(&session, _scratch, len);
+
+  if (ret == 0) {
+    ret = mbedtls_ssl_set_session(ssl, &session);
+  }
+
+  mbedtls_ssl_session_free(&session);
+  memset(_scratch, 0, len);
+
+  if (ret != 0) {
+    log_w("Dropping unusable cached session for %s (%d)", key, ret);
+    _store->remove(key);
+    return false;
+  }
+
+  log_v("Offering cached session for %s", key);
+  return true;
+}
+
+/**
+ * \brief             Save the session negotiated on ssl for host:port.
+ *
+ * \param host        const char* - The host name or IP address.
+ * \param port        uint16_t - The port.
+ * \param ssl         const mbedtls_ssl_context* - A context that has completed the handshake.
+ * \return bool       True if the session was stored.
+ */
+bool SSLSessionCache::save(const char *host, uint16_t port, const mbedtls_ssl_context *ssl) {
+  char key[SSL_CLIENT_SESSION_KEY_SIZE];
+  if (!_key(host, port, key)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  size_t len = 0;
+  int ret = mbedtls_ssl_get_session(ssl, &session);
+
+  if (ret == 0) {
+    ret = mbedtls_ssl_session_save(&session, _scratch, sizeof(_scratch), &len);
+  }
+
+  mbedtls_ssl_session_free(&session);
+
+  if (ret != 0) {
+    log_w("Unable to serialise session for %s (%d), raise SSL_CLIENT_SESSION_MAX_SIZE?", key, ret);
+    return false;
+  }
+
+  bool saved = _store->save(key, _scratch, len);
+  memset(_scratch, 0, len);
+  log_v("Session for %s %s (%zu bytes)", key, saved ? "saved" : "not saved", len);
+  return saved;
+}
+
+/**
+ * \brief             Forget the session for host:port.
+ *
+ * \param host        const char* - The host name or IP address.
+ * \param port        uint16_t - The port.
+ */
+void SSLSessionCache::remove(const char *host, uint16_t port) {
+  char key[SSL_CLIENT_SESSION_KEY_SIZE];
+  if (!_key(host, port, key)) {
+    return; // never cached
+  }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  _store->remove(key);
+}
+
+/**
+ * \brief             Count a completed handshake as a hit (resumed) or a miss (full handshake).
+ *
+ * \param resumed     bool - True if the server accepted the offered session.
+ */
+void SSLSessionCache::recordHandshake(bool resumed) {
+  if (resumed) {
+    _hits++;
+  } else {
+    _misses++;
+  }
+}
+
+/**
+ * \brief Reset the hit and miss counters.
+ */
+void SSLSessionCache::resetStats() {
+  _hits = 0;
+  _misses = 0;
+}
@@ -0,0 +1,130 @@
+/* TLS session cache for SSLClient.
+ *
+ * Keeps serialised mbedtls sessions keyed by "host:port" so that a reconnect
+ * can offer the previous session (session ID or session ticket) and skip the
+ * full handshake. Storage is pluggable: SSLSessionMemoryStore keeps sessions
+ * in RAM, SSLSessionFileStore writes them to any mounted file system so they
+ * survive a reboot or deep sleep.
+ *
+ * Note: a serialised session contains the master secret of the connection.
+ * Only persist it to storage that is as trusted as the device itself.
+ */
+
+#ifndef SSL_SESSION_CACHE_H
+#define SSL_SESSION_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include "mbedtls/ssl.h"
+
+#ifndef SSL_CLIENT_SESSION_MAX_SIZE
+#define SSL_CLIENT_SESSION_MAX_SIZE 2048U
+#endif
+
+#ifndef SSL_CLIENT_SESSION_CACHE_SLOTS
+#define SSL_CLIENT_SESSION_CACHE_SLOTS 4U
+#endif
+
+#define SSL_CLIENT_SESSION_KEY_SIZE 72U // host:port keys that do not fit are not cached
+
+/**
+ * \brief Storage backend for serialised sessions.
+ */
+class SSLSessionStore {
+public:
+  virtual ~SSLSessionStore() {}
+
+  /**
+   * \brief         Load the session stored under key.
+   * \return size_t Number of bytes copied into buf, 0 if there is no entry or it does not fit.
+   */
+  virtual size_t load(const char *key, uint8_t *buf, size_t size) = 0;
+
+  /**
+   * \brief         Store len bytes under key, replacing any previous entry.
+   * \return bool   True if the session was stored.
+   */
+  virtual bool save(const char *key, const uint8_t *buf, size_t len) = 0;
+
+  /**
+   * \brief         Drop the entry stored under key, if any.
+   */
+  virtual void remove(const char *key) = 0;
+};
+
+/**
+ * \brief RAM backend with a fixed number of slots, evicting the least recently used entry.
+ */
+class SSLSessionMemoryStore : public SSLSessionStore {
+public:
+  SSLSessionMemoryStore();
+
+  size_t load(const char *key, uint8_t *buf, size_t size) override;
+  bool save(const char *key, const uint8_t *buf, size_t len) override;
+  void remove(const char *key) override;
+  void clear();
+
+private:
+  struct Slot {
+    char key[SSL_CLIENT_SESSION_KEY_SIZE];
+    uint8_t data[SSL_CLIENT_SESSION_MAX_SIZE];
+    size_t len;
+    uint32_t stamp;
+  };
+
+  Slot *_find(const char *key);
+  Slot *_victim();
+
+  Slot _slots[SSL_CLIENT_SESSION_CACHE_SLOTS];
+  uint32_t _clock;
+};
+
+/**
+ * \brief File backend, one file per host:port inside the given directory.
+ *
+ * On the native build this is any directory; on the ESP32 it is a mount point
+ * such as "/spiffs" or "/littlefs" that has been mounted by the application.
+ */
+class SSLSessionFileStore : public SSLSessionStore {
+public:
+  SSLSessionFileStore(const char *directory);
+
+  size_t load(const char *key, uint8_t *buf, size_t size) override;
+  bool save(const char *key, const uint8_t *buf, size_t len) override;
+  void remove(const char *key) override;
+
+private:
+  bool _path(const char *key, char *path, size_t size);
+
+  const char *_directory;
+};
+
+/**
+ * \brief Session cache shared by any number of SSLClient instances, also across tasks:
+ *        restore(), save() and remove() take turns on the store and the scratch buffer.
+ */
+class SSLSessionCache {
+public:
+  SSLSessionCache(SSLSessionStore &store);
+
+  bool restore(const char *host, uint16_t port, mbedtls_ssl_context *ssl);
+  bool save(const char *host, uint16_t port, const mbedtls_ssl_context *ssl);
+  void remove(const char *host, uint16_t port);
+  void recordHandshake(bool resumed);
+
+  uint32_t hits() const { return _hits; }
+  uint32_t misses() const { return _misses; }
+  void resetStats();
+
+private:
+  bool _key(const char *host, uint16_t port, char *key);
+
+  SSLSessionStore *_store;
+  std::mutex _lock;   // guards _scratch and the store
+  uint8_t _scratch[SSL_CLIENT_SESSION_MAX_SIZE]; // too large for the stack of a TLS task
+  uint32_t _hits;
+  uint32_t _misses;
+};
+
+#endif /* SSL_SESSION_CACHE_H */
@@ -10,9 +10,13 @@
 #include "Arduino.h"
 #include <mbedtls/sha256.h>
 #include <mbedtls/oid.h>
+#include <mbedtls/platform_util.h>
+#include <mbedtls/ssl_internal.h>
 #include <algorithm>
+#include <cstddef>
 #include <string>
 #include "ssl_client.h"
+#include "ssl_trace.h"
 
 //#define ARDUHAL_LOG_LEVEL 5
 //#include <esp32-hal-log.h>
@@ -21,8 +25,6 @@
 #  error "Please configure IDF framework to include mbedTLS -> Enable pre-shared-key ciphersuites and activate at least one cipher"
 #endif
 
-const char *pers = "esp32-tls";
-
 /**
  * \brief           Handle the error.
  * 
@@ -35,6 +37,7 @@ static int _handle_error(int err, const char * function, int line) {
     if(err == -30848){
         return err;
     }
+    SSL_TRACE_E(SSL_TRACE_ERROR, err, line);
 #ifdef MBEDTLS_ERROR_C
     char error_buf[100];
     mbedtls_strerror(err, error_buf, 100);
@@ -47,11 +50,93 @@ static int _handle_error(int err, const char * function, int line) {
 
 #define handle_error(e) _handle_error(e, __FUNCTION__, __LINE__)
 
+/**
+ * \brief             Ask the transport how much it has, counting the call.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return int        What Client::available() returns. 
+ */
+static int transport_available(sslclient_context *ssl_client) {
+  ssl_client->counters.transport_availables++;
+  return ssl_client->client->available();
+}
+
+/**
+ * \brief             Read from the transport, counting the call, the bytes and, when the read
+ *                    starts at the record header, the record.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \param buf         unsigned char* - The buffer to read into. 
+ * \param len         size_t - The most bytes to read. 
+ * \return int        What Client::read() returns. 
+ */
+static int transport_read(sslclient_context *ssl_client, unsigned char *buf, size_t len) {
+  ssl_client->counters.transport_reads++;
+  int result = ssl_client->client->read(buf, len);
+
+  if (result > 0) {
+    ssl_client->counters.ciphertext_in += result;
+    if (buf == ssl_client->ssl_ctx.in_hdr) {
+      ssl_client->counters.records_in++;
+    }
+  }
+  return result;
+}
+
+/**
+ * \brief             Count the records in bytes the transport took by following the 5 byte
+ *                    record headers in the outgoing stream, so that short writes and
+ *                    batched records are counted once, when they actually leave.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \param buf         const unsigned char* - The bytes the transport took. 
+ * \param len         size_t - How many. 
+ */
+static void count_records_sent(sslclient_context *ssl_client, const unsigned char *buf, size_t len) {
+  size_t i = 0;
+
+  while (i < len) {
+    if (ssl_client->out_record_left > 0) {
+      size_t skip = len - i < ssl_client->out_record_left ? len - i : ssl_client->out_record_left;
+      ssl_client->out_record_left -= skip;
+      i += skip;
+      continue;
+    }
+
+    ssl_client->out_record_header[ssl_client->out_record_header_len++] = buf[i++];
+    if (ssl_client->out_record_header_len == sizeof(ssl_client->out_record_header)) {
+      ssl_client->out_record_left = ((size_t)ssl_client->out_record_header[3] << 8) | ssl_client->out_record_header[4];
+      ssl_client->out_record_header_len = 0;
+      ssl_client->counters.records_out++;
+    }
+  }
+}
+
+/**
+ * \brief             Write to the transport, counting the call, the bytes and the records.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \param buf         const unsigned char* - The bytes to write. 
+ * \param len         size_t - How many. 
+ * \return size_t     The bytes the transport took, at most len. 
+ */
+static size_t transport_write(sslclient_context *ssl_client, const unsigned char *buf, size_t len) {
+  ssl_client->counters.transport_writes++;
+  size_t written = ssl_client->client->write(buf, len);
+
+  if (written > len) {
+    written = len;
+  }
+  ssl_client->counters.ciphertext_out += written;
+  count_records_sent(ssl_client, buf, written);
+  return written;
+}
+
 /**
  * \brief          Read at most 'len' characters. If no error occurs,
  *                 the actual amount read is returned.
  *
- * \param ctx      Client*
+ * \param ctx      sslclient_context*
  * \param buf      The buffer to write to
  * \param len      Maximum length of the buffer
  *
@@ -60,19 +145,21 @@ static int _handle_error(int err, const char * function, int line) {
  *                 MBEDTLS_ERR_SSL_WANT_READ indicates read() would block.
  */
 static int client_net_recv( void *ctx, unsigned char *buf, size_t len ) {
-  Client *client = (Client*)ctx;
-  if (!client) { 
+  sslclient_context *ssl_client = (sslclient_context*)ctx;
+  if (!ssl_client || !ssl_client->client) { 
     log_e("Uninitialised!");
     return -1;
   }
+
+  Client *client = ssl_client->client;
   
   if (!client->connected()) {
      log_e("Not connected!");
      return -2;
   }
 
-  int result = client->read(buf, len);
-  log_v("SSL client RX res=%d len=%zu", result, len);
+  int result = transport_read(ssl_client, buf, len);
+  SSL_TRACE_V(SSL_TRACE_NET_RECV, result, len);
 
   if (result > 0) {
     //esp_log_buffer_hexdump_internal("SSL.RD", buf, (uint16_t)result, ESP_LOG_VERBOSE);
@@ -82,42 +169,86 @@ static int client_net_recv( void *ctx, unsigned char *buf, size_t len ) {
 }
 
 /**
- * \brief           Read at most 'len' characters. If no error occurs,
- *                  the actual amount read is returned.
+ * \brief           Sleep until the transport may have data or the timeout expires. Uses the
+ *                  readiness hook if one is set, otherwise polls every
+ *                  SSL_CLIENT_RECV_POLL_INTERVAL milliseconds.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \param timeout   uint32_t - The longest time to wait in milliseconds. 
+ */
+static void wait_for_data(sslclient_context *ssl_client, uint32_t timeout) {
+  if (ssl_client->settings.recv_ready != NULL) {
+    (void)ssl_client->settings.recv_ready(ssl_client->settings.recv_ready_arg, timeout);
+    return;
+  }
+
+  delay(timeout < SSL_CLIENT_RECV_POLL_INTERVAL ? timeout : SSL_CLIENT_RECV_POLL_INTERVAL);
+}
+
+/**
+ * \brief           Sleep until the transport may take more data or the timeout expires. Uses
+ *                  the send readiness hook if one is set, otherwise sleeps
+ *                  SSL_CLIENT_SEND_POLL_INTERVAL milliseconds.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \param timeout   uint32_t - The longest time to wait in milliseconds. 
+ */
+static void wait_for_send_window(sslclient_context *ssl_client, uint32_t timeout) {
+  if (ssl_client->settings.send_ready != NULL) {
+    (void)ssl_client->settings.send_ready(ssl_client->settings.send_ready_arg, timeout);
+    return;
+  }
+
+  delay(timeout < SSL_CLIENT_SEND_POLL_INTERVAL ? timeout : SSL_CLIENT_SEND_POLL_INTERVAL);
+}
+
+/**
+ * \brief           Read at most 'len' characters. Whatever the transport has is returned at
+ *                  once, even if it is less than 'len'; mbedtls asks again for the rest of a
+ *                  record. Only when nothing is pending does it wait, for at most 'timeout'.
  * 
- * \param ctx       Client* - The client context. 
+ * \param ctx       sslclient_context* - The ssl client context. 
  * \param buf       unsigned char* - The buffer to write to. 
  * \param len       size_t - The maximum length of the buffer. 
- * \param timeout   uint32_t - The timeout in milliseconds. 
- * \return int      The number of bytes received, or a non-zero error code;
- *                  with a non-blocking socket, MBEDTLS_ERR_SSL_WANT_READ
- *                  indicates read() would block. 
+ * \param timeout   uint32_t - The read timeout set with mbedtls_ssl_conf_read_timeout(),
+ *                  0 to return without waiting.
+ * \return int      The number of bytes received, MBEDTLS_ERR_SSL_WANT_READ if nothing
+ *                  arrived in time, or MBEDTLS_ERR_NET_CONN_RESET if the transport is closed
+ *                  and drained.
  */
 int client_net_recv_timeout(void *ctx, unsigned char *buf, size_t len, uint32_t timeout) {
-  Client *client = (Client*)ctx;
+  sslclient_context *ssl_client = (sslclient_context*)ctx;
 
-  if (!client) { 
+  if (!ssl_client || !ssl_client->client) { 
     log_e("Uninitialised!");
     return -1;
   }
 
+  Client *client = ssl_client->client;
   unsigned long start = millis();
-  unsigned long tms = start + timeout;
-  
-  do {
-    int pending = client->available();
-    if (pending < len && timeout > 0) {
-      delay(1);
-    } else break;
-  } while (millis() < tms);
+  int pending = transport_available(ssl_client);
+
+  while (pending <= 0 && timeout > 0 && client->connected()) {
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= timeout) {
+      break;
+    }
+
+    wait_for_data(ssl_client, timeout - elapsed);
+    pending = transport_available(ssl_client);
+  }
+
+  if (pending <= 0) {
+    return client->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+  }
   
-  int result = client->read(buf, len);
+  int result = transport_read(ssl_client, buf, len);
   
-  if (!result) {
+  if (result <= 0) {
     return MBEDTLS_ERR_SSL_WANT_READ;
   }
 
-  log_v("SSL client RX (received=%d expected=%zu in %lums)", result, len, millis()-start);
+  SSL_TRACE_V(SSL_TRACE_NET_RECV, result, len);
 
   if (result > 0) {
     //esp_log_buffer_hexdump_internal("SSL.RD", buf, (uint16_t)result, ESP_LOG_VERBOSE);
@@ -127,55 +258,155 @@ int client_net_recv_timeout(void *ctx, unsigned char *buf, size_t len, uint32_t
 }
 
 /**
- * \brief         Write at most 'len' characters. If no error occurs,
- *                the actual amount read is returned.
+ * \brief         Write at most 'len' characters straight from mbedtls's output buffer,
+ *                in chunks of at most SSL_CLIENT_SEND_BUFFER_SIZE bytes. A short write
+ *                ends the call and the bytes written so far are reported; mbedtls
+ *                calls again with the rest of the record. While send_ssl_data() is
+ *                batching, whole records are appended to the output batch instead.
  *
- * \param ctx     Client*
+ * \param ctx     sslclient_context*
  * \param buf     The buffer to read from
  * \param len     The length of the buffer
- * \return        The number of bytes sent, or a non-zero
- *                error code; with a non-blocking socket,
- *                MBEDTLS_ERR_SSL_WANT_WRITE indicates write() would block.
+ * \return        The number of bytes sent, MBEDTLS_ERR_SSL_WANT_WRITE if the
+ *                transport took nothing but is still connected, or a negative
+ *                error code.
  */
 static int client_net_send( void *ctx, const unsigned char *buf, size_t len ) {
-  Client *client = (Client*)ctx;
-  if (!client) { 
+  sslclient_context *ssl_client = (sslclient_context*)ctx;
+  if (!ssl_client || !ssl_client->client) { 
     log_e("Uninitialised!");
     return -1;
   }
+
+  Client *client = ssl_client->client;
   
   if (!client->connected()) {
     log_e("Not connected!");
     return -2;
   }
   
-  // esp_log_buffer_hexdump_internal("SSL.WR", buf, (uint16_t)len, ESP_LOG_VERBOSE);BEDTLS_ERR_NET_SEND_FAILED;
+  // esp_log_buffer_hexdump_internal("SSL.WR", buf, (uint16_t)len, ESP_LOG_VERBOSE);
+
+  // batched records go out first so that the stream stays in order
+  if (ssl_client->out_batch_len > 0 &&
+      (!ssl_client->out_batching || len > ssl_client->settings.out_batch_size - ssl_client->out_batch_len)) {
+    int ret = flush_ssl_output(ssl_client);
+    if (ret != 0) {
+      return ret;
+    }
+  }
 
-  int result = 0;
-  for (int i = 0; i < len; i += SSL_CLIENT_SEND_BUFFER_SIZE) {
-    int bytesToWrite;
+  if (ssl_client->out_batching && len <= ssl_client->settings.out_batch_size - ssl_client->out_batch_len) {
+    memcpy(&ssl_client->settings.out_batch[ssl_client->out_batch_len], buf, len);
+    ssl_client->out_batch_len += len;
+    return (int)len;
+  }
 
-    if (SSL_CLIENT_SEND_BUFFER_SIZE > len - i) {
-      bytesToWrite = len - i;
-    } else {
-      bytesToWrite = SSL_CLIENT_SEND_BUFFER_SIZE;
+  size_t sent = 0;
+  while (sent < len) {
+    size_t chunk = len - sent;
+    if (chunk > SSL_CLIENT_SEND_BUFFER_SIZE) {
+      chunk = SSL_CLIENT_SEND_BUFFER_SIZE;
     }
 
-    // Create a new buffer for each chunk
-    unsigned char buffer[bytesToWrite];
-    memcpy(buffer, &buf[i], bytesToWrite);
+    size_t written = transport_write(ssl_client, &buf[sent], chunk);
+    sent += written;
 
-    // Send the buffer to the client
-    result += client->write(buffer, bytesToWrite);
-    if (result == 0) {
-      log_e("write failed");
-      result = MBEDTLS_ERR_NET_SEND_FAILED;
-      break;
+    if (written < chunk) {
+      break; // the transport is full, report what it took
+    }
+  }
+
+  if (sent == 0 && len > 0) {
+    if (client->connected()) {
+      return MBEDTLS_ERR_SSL_WANT_WRITE;
     }
+    log_e("write failed");
+    return MBEDTLS_ERR_NET_SEND_FAILED;
   }
   
-  log_d("SSL client TX res=%d len=%zu", result, len);
-  return result;
+  SSL_TRACE_V(SSL_TRACE_NET_SEND, sent, len);
+  return (int)sent;
+}
+
+/**
+ * \brief         client_net_send() for the handshake, adding its time to the I/O time of
+ *                the current handshake step.
+ */
+static int timed_net_send(void *ctx, const unsigned char *buf, size_t len) {
+  sslclient_context *ssl_client = (sslclient_context*)ctx;
+  unsigned long start = millis();
+  int ret = client_net_send(ctx, buf, len);
+
+  ssl_client->timing_io += millis() - start;
+  return ret;
+}
+
+/**
+ * \brief         client_net_recv_timeout() for the handshake, adding its time, including
+ *                any wait for data, to the I/O time of the current handshake step.
+ */
+static int timed_net_recv_timeout(void *ctx, unsigned char *buf, size_t len, uint32_t timeout) {
+  sslclient_context *ssl_client = (sslclient_context*)ctx;
+  unsigned long start = millis();
+  int ret = client_net_recv_timeout(ctx, buf, len, timeout);
+
+  ssl_client->timing_io += millis() - start;
+  return ret;
+}
+
+/**
+ * \brief             Hand the batched records to the transport in as few writes as it accepts.
+ *                    Whatever it does not take stays at the front of the batch.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return int        0 once the batch is empty, MBEDTLS_ERR_SSL_WANT_WRITE if the transport
+ *                    is full, or MBEDTLS_ERR_NET_SEND_FAILED if it is closed.
+ */
+int flush_ssl_output(sslclient_context *ssl_client) {
+  Client *client = ssl_client->client;
+  size_t sent = 0;
+
+  while (sent < ssl_client->out_batch_len) {
+    size_t written = transport_write(ssl_client, &ssl_client->settings.out_batch[sent], ssl_client->out_batch_len - sent);
+    if (written == 0) {
+      break;
+    }
+    sent += written;
+  }
+
+  if (sent > 0) {
+    memmove(ssl_client->settings.out_batch, &ssl_client->settings.out_batch[sent], ssl_client->out_batch_len - sent);
+    ssl_client->out_batch_len -= sent;
+  }
+
+  if (ssl_client->out_batch_len == 0) {
+    return 0;
+  }
+
+  if (!client->connected()) {
+    log_e("write failed, dropping %zu batched bytes", ssl_client->out_batch_len);
+    ssl_client->out_batch_len = 0;
+    return MBEDTLS_ERR_NET_SEND_FAILED;
+  }
+  return MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+/**
+ * \brief             Send what is left in the output batch before reading, so that no request
+ *                    is held back while its response is awaited. Does not wait; a full
+ *                    transport leaves the rest for the next read or send.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return int        0, or MBEDTLS_ERR_NET_SEND_FAILED if the transport is closed.
+ */
+static int drain_ssl_output(sslclient_context *ssl_client) {
+  if (ssl_client->out_batch_len == 0) {
+    return 0;
+  }
+
+  int ret = flush_ssl_output(ssl_client);
+  return ret == MBEDTLS_ERR_SSL_WANT_WRITE ? 0 : ret;
 }
 
 /**
@@ -190,63 +421,71 @@ void ssl_init(sslclient_context *ssl_client, Client *client)
   // reset embedded pointers to zero
   memset(ssl_client, 0, sizeof(sslclient_context));
   ssl_client->client = client;
+  ssl_client->settings.send_timeout = SSL_CLIENT_DEFAULT_SEND_TIMEOUT;
   mbedtls_ssl_init(&ssl_client->ssl_ctx);
   mbedtls_ssl_config_init(&ssl_client->ssl_conf);
-  mbedtls_ctr_drbg_init(&ssl_client->drbg_ctx);
 }
 
 /**
- * \brief             Start the ssl client.
+ * \brief           Get the ssl receive object with timeout.
  * 
- * \param ssl_client  sslclient_context* - The ssl client context.
- * \param host        const char* - The host to connect to.
- * \param port        uint32_t - The port to connect to.
- * \param timeout     int - The timeout in milliseconds.
- * \param rootCABuff  const char* - The root CA certificate.
- * \param cli_cert    const char* - The client certificate.
- * \param cli_key     const char*- The client key.
- * \param pskIdent    const char* - The PSK identity.
- * \param psKey       const char* - The PSK key.
- * \return int        1 if successful. 
+ * \param pb        sslclient_context* - The ssl client context. 
+ * \param res       uint8_t* - The data to receive. 
+ * \return bool     True if the data was received, false otherwise. 
  */
-int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, int timeout, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey)
-{
-  char buf[512];
-  int ret, flags;
-  //int enable = 1;
-  log_v("Free internal heap before TLS %u", ESP.getFreeHeap());
-
-  log_d("Connecting to %s:%d", host, port);
+static bool parseHexNibble(char pb, uint8_t* res) {
+  if (pb >= '0' && pb <= '9') {
+    *res = (uint8_t) (pb - '0'); return true;
+  } else if (pb >= 'a' && pb <= 'f') {
+    *res = (uint8_t) (pb - 'a' + 10); return true;
+  } else if (pb >= 'A' && pb <= 'F') {
+    *res = (uint8_t) (pb - 'A' + 10); return true;
+  }
+  return false;
+}
 
-  Client *pClient = ssl_client->client;
+/**
+ * \brief           Convert a hex encoded pre-shared key to binary.
+ * 
+ * \param psKey     const char* - The key in hex. 
+ * \param psk       unsigned char* - Output buffer of MBEDTLS_PSK_MAX_LEN bytes. 
+ * \param psk_len   size_t* - Receives the key length in bytes. 
+ * \return int      0 on success, -1 if the key is not valid hex or too long. 
+ */
+int decode_psk(const char *psKey, unsigned char *psk, size_t *psk_len) {
+  size_t len = strlen(psKey);
 
-  if (!pClient) {
-    log_e("Client provider not initialised");
+  if ((len & 1) != 0 || len > 2*MBEDTLS_PSK_MAX_LEN) {
     return -1;
   }
 
-  if (!pClient->connect(host, port)) {
-    log_e("Connect to Server failed!");
-    return -2;
-  }
-
-  log_v("Seeding the random number generator");
-  mbedtls_entropy_init(&ssl_client->entropy_ctx);
+  for (size_t j = 0; j < len; j += 2) {
+    uint8_t high, low;
 
-  ret = mbedtls_ctr_drbg_seed(&ssl_client->drbg_ctx, mbedtls_entropy_func,
-                              &ssl_client->entropy_ctx, (const unsigned char *) pers, strlen(pers));
-  if (ret < 0) {
-    return handle_error(ret);
+    if (!parseHexNibble(psKey[j], &high) || !parseHexNibble(psKey[j+1], &low)) {
+      return -1;
+    }
+    psk[j/2] = (high << 4) | low;
   }
 
-  log_v("Setting up the SSL/TLS structure...");
+  *psk_len = len/2;
+  return 0;
+}
 
-  if ((ret = mbedtls_ssl_config_defaults(&ssl_client->ssl_conf,
-                                          MBEDTLS_SSL_IS_CLIENT,
-                                          MBEDTLS_SSL_TRANSPORT_STREAM,
-                                          MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
-    return handle_error(ret);
-  }
+/**
+ * \brief             Configure trust and identity by parsing the PEM buffers and hex PSK.
+ *                    The parsed objects live in the context and are freed after the handshake.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param rootCABuff  const char* - The root CA certificate.
+ * \param cli_cert    const char* - The client certificate.
+ * \param cli_key     const char*- The client key.
+ * \param pskIdent    const char* - The PSK identity.
+ * \param psKey       const char* - The PSK key.
+ * \return int        0 if successful, otherwise an error code.
+ */
+static int configure_from_buffers(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey) {
+  int ret;
 
   // MBEDTLS_SSL_VERIFY_REQUIRED if a CA certificate is defined on Arduino IDE and
   // MBEDTLS_SSL_VERIFY_NONE if not.
@@ -263,27 +502,12 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
     }
   } else if (pskIdent != NULL && psKey != NULL) {
     log_v("Setting up PSK");
-    // convert PSK from hex to binary
-    if ((strlen(psKey) & 1) != 0 || strlen(psKey) > 2*MBEDTLS_PSK_MAX_LEN) {
+    unsigned char psk[MBEDTLS_PSK_MAX_LEN];
+    size_t psk_len = 0;
+    if (decode_psk(psKey, psk, &psk_len) != 0) {
       log_e("pre-shared key not valid hex or too long");
       return -1;
     }
-    unsigned char psk[MBEDTLS_PSK_MAX_LEN];
-    size_t psk_len = strlen(psKey)/2;
-    for (int j=0; j<strlen(psKey); j+= 2) {
-      char c = psKey[j];
-      if (c >= '0' && c <= '9') c -= '0';
-      else if (c >= 'A' && c <= 'F') c -= 'A' - 10;
-      else if (c >= 'a' && c <= 'f') c -= 'a' - 10;
-      else return -1;
-      psk[j/2] = c<<4;
-      c = psKey[j+1];
-      if (c >= '0' && c <= '9') c -= '0';
-      else if (c >= 'A' && c <= 'F') c -= 'A' - 10;
-      else if (c >= 'a' && c <= 'f') c -= 'a' - 10;
-      else return -1;
-      psk[j/2] |= c;
-    }
     // set mbedtls config
     ret = mbedtls_ssl_conf_psk(&ssl_client->ssl_conf, psk, psk_len,
                                (const unsigned char *)pskIdent, strlen(pskIdent));
@@ -318,103 +542,877 @@ int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t p
     mbedtls_ssl_conf_own_cert(&ssl_client->ssl_conf, &ssl_client->client_cert, &ssl_client->client_key);
   }
 
-  log_v("Setting hostname for TLS session...");
+  return 0;
+}
 
-  // Hostname set here should match CN in server certificate
-  if ((ret = mbedtls_ssl_set_hostname(&ssl_client->ssl_ctx, host)) != 0) {
-    return handle_error(ret);
+/**
+ * \brief             Configure trust and identity from pre-parsed credentials. Nothing is
+ *                    parsed or copied; the credentials must outlive the configuration.
+ * 
+ * \param conf        mbedtls_ssl_config* - The configuration to fill in.
+ * \param creds       SSLCredentials* - The shared credentials.
+ * \return int        0 if successful, otherwise an error code.
+ */
+int configure_ssl_credentials(mbedtls_ssl_config *conf, SSLCredentials *creds) {
+  int ret;
+
+  if (creds->hasCACert()) {
+    log_v("Using shared CA cert");
+    mbedtls_ssl_conf_authmode(conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(conf, creds->caCert(), NULL);
+  } else if (creds->hasPreSharedKey()) {
+    log_v("Using shared PSK");
+    ret = mbedtls_ssl_conf_psk(conf, creds->psk(), creds->pskLength(),
+                               (const unsigned char *)creds->pskIdentity(), strlen(creds->pskIdentity()));
+    if (ret != 0) {
+      return handle_error(ret);
+    }
+  } else {
+    mbedtls_ssl_conf_authmode(conf, MBEDTLS_SSL_VERIFY_NONE);
+    log_i("WARNING: Use certificates for a more secure communication!");
+  }
+
+  if (creds->hasCertificate()) {
+    log_v("Using shared client certificate");
+    ret = mbedtls_ssl_conf_own_cert(conf, creds->clientCert(), creds->clientKey());
+    if (ret != 0) {
+      return handle_error(ret);
+    }
   }
 
-  mbedtls_ssl_conf_rng(&ssl_client->ssl_conf, mbedtls_ctr_drbg_random, &ssl_client->drbg_ctx);
+  return 0;
+}
 
-  if ((ret = mbedtls_ssl_setup(&ssl_client->ssl_ctx, &ssl_client->ssl_conf)) != 0) {
+/**
+ * \brief             Apply the client defaults shared by every configuration: TLS client
+ *                    over a stream transport, the default preset and the shared DRBG.
+ * 
+ * \param conf        mbedtls_ssl_config* - An initialised configuration.
+ * \return int        0 if successful, otherwise an error code.
+ */
+int configure_ssl_defaults(mbedtls_ssl_config *conf) {
+  int ret = mbedtls_ssl_config_defaults(conf, MBEDTLS_SSL_IS_CLIENT,
+                                        MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+  if (ret != 0) {
     return handle_error(ret);
   }
 
-  log_v("Setting up IO callbacks...");
-  mbedtls_ssl_set_bio(&ssl_client->ssl_ctx, ssl_client->client,
-                      client_net_send, NULL, client_net_recv_timeout );
+  mbedtls_ssl_conf_rng(conf, ssl_random, NULL);
+  return 0;
+}
 
-  log_v("Performing the SSL/TLS handshake...");
-  unsigned long handshake_start_time=millis();
-  while ((ret = mbedtls_ssl_handshake(&ssl_client->ssl_ctx)) != 0) {
-    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
-      return handle_error(ret);
-    }
-    if((millis()-handshake_start_time)>ssl_client->handshake_timeout) {
+/**
+ * \brief             Map a maximum fragment length in bytes to its RFC 6066 code.
+ * 
+ * \param length      size_t - 512, 1024, 2048 or 4096, or 0 for no limit.
+ * \return int        The MBEDTLS_SSL_MAX_FRAG_LEN_* code, -1 for any other length.
+ */
+int ssl_max_frag_len_code(size_t length) {
+  switch (length) {
+    case 0:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+    case 512:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_512;
+    case 1024:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+    case 2048:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+    case 4096:
+      return MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+    default:
       return -1;
-    }
-    vTaskDelay(10 / portTICK_PERIOD_MS);
   }
+}
 
-  if (cli_cert != NULL && cli_key != NULL) {
-    log_d("Protocol is %s Ciphersuite is %s", mbedtls_ssl_get_version(&ssl_client->ssl_ctx), mbedtls_ssl_get_ciphersuite(&ssl_client->ssl_ctx));
-    if ((ret = mbedtls_ssl_get_record_expansion(&ssl_client->ssl_ctx)) >= 0) {
-      log_d("Record expansion is %d", ret);
-    } else {
-      log_w("Record expansion is unknown (compression)");
-    }
+/**
+ * \brief             Attribute the allocations that follow to a phase, if they are counted.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param phase       ssl_memory_phase - The phase the connection is entering.
+ */
+static void set_memory_phase(sslclient_context *ssl_client, ssl_memory_phase phase) {
+  if (ssl_client->settings.memory != NULL) {
+    ssl_client->settings.memory->setPhase(phase);
   }
+}
 
-  log_v("Verifying peer X.509 certificate...");
+/**
+ * \brief             Build the per-connection configuration embedded in the context.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param rootCABuff  const char* - The root CA certificate.
+ * \param cli_cert    const char* - The client certificate.
+ * \param cli_key     const char*- The client key.
+ * \param pskIdent    const char* - The PSK identity.
+ * \param psKey       const char* - The PSK key.
+ * \return int        0 if successful, otherwise an error code.
+ */
+static int configure_connection(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey) {
+  int ret = configure_ssl_defaults(&ssl_client->ssl_conf);
 
-  if ((flags = mbedtls_ssl_get_verify_result(&ssl_client->ssl_ctx)) != 0) {
-    memset(buf, 0, sizeof(buf));
-    mbedtls_x509_crt_verify_info(buf, sizeof(buf), "  ! ", flags);
-    log_e("Failed to verify peer certificate! verification info: %s", buf);
-    stop_ssl_socket(ssl_client, rootCABuff, cli_cert, cli_key);  //It's not safe continue.
-    return handle_error(ret);
-  } else {
-    log_v("Certificate verified.");
-  }
-  
-  if (rootCABuff != NULL) {
-    mbedtls_x509_crt_free(&ssl_client->ca_cert);
+  if (ret != 0) {
+    return ret;
   }
 
-  if (cli_cert != NULL) {
-    mbedtls_x509_crt_free(&ssl_client->client_cert);
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+  if (ssl_client->settings.max_frag_len != MBEDTLS_SSL_MAX_FRAG_LEN_NONE) {
+    ret = mbedtls_ssl_conf_max_frag_len(&ssl_client->ssl_conf, ssl_client->settings.max_frag_len);
+    if (ret != 0) {
+      return handle_error(ret);
+    }
   }
+#endif
 
-  if (cli_key != NULL) {
-    mbedtls_pk_free(&ssl_client->client_key);
-  }    
-
-  log_v("Free internal heap after TLS %u", ESP.getFreeHeap());
+  if (ssl_client->settings.credentials != NULL) {
+    return configure_ssl_credentials(&ssl_client->ssl_conf, ssl_client->settings.credentials);
+  }
 
-  //return ssl_client->socket;
-  return 1;
+  set_memory_phase(ssl_client, SSL_MEMORY_PHASE_CERT_PARSE);
+  ret = configure_from_buffers(ssl_client, rootCABuff, cli_cert, cli_key, pskIdent, psKey);
+  set_memory_phase(ssl_client, SSL_MEMORY_PHASE_CONFIG);
+  return ret;
 }
 
 /**
- * \brief             Stop the ssl socket.
+ * \brief             Free the certificates and key parsed into the context once the handshake
+ *                    no longer needs them. Shared credentials are left alone.
  * 
  * \param ssl_client  sslclient_context* - The ssl client context. 
- * \param rootCABuff  const char* - The root CA certificate. 
- * \param cli_cert    const char* - The client certificate. 
- * \param cli_key     const char* - The client key. 
  */
-void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key) {
-  log_v("Cleaning SSL connection.");
-
-  ssl_client->client->stop();
-
-  // avoid memory leak if ssl connection attempt failed
-  if (ssl_client->ssl_conf.ca_chain != NULL) {
+static void release_parsed_credentials(sslclient_context *ssl_client) {
+  if (ssl_client->ssl_conf.ca_chain == &ssl_client->ca_cert) {
     mbedtls_x509_crt_free(&ssl_client->ca_cert);
+    ssl_client->credentials_released = true;
   }
-  if (ssl_client->ssl_conf.key_cert != NULL) {
+
+  if (ssl_client->ssl_conf.key_cert != NULL && ssl_client->settings.credentials == NULL) {
     mbedtls_x509_crt_free(&ssl_client->client_cert);
     mbedtls_pk_free(&ssl_client->client_key);
+    ssl_client->credentials_released = true;
+  }
+}
+
+/**
+ * \brief             Whether the credential buffers are the ones the configuration was built
+ *                    from, by address and length, so that a kept context is only reused for the
+ *                    same credentials. Without record, compare only.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param rootCABuff  const char* - The root CA certificate.
+ * \param cli_cert    const char* - The client certificate.
+ * \param cli_key     const char*- The client key.
+ * \param pskIdent    const char* - The PSK identity.
+ * \param psKey       const char* - The PSK key.
+ * \param record      bool - Remember these buffers as the ones the configuration is built from.
+ * \return bool       True if they match what was remembered.
+ */
+static bool match_credentials(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey, bool record) {
+  const char *parts[SSL_CLIENT_CREDENTIAL_PARTS] = { rootCABuff, cli_cert, cli_key, pskIdent, psKey };
+  bool same = true;
+
+  for (size_t i = 0; i < SSL_CLIENT_CREDENTIAL_PARTS; i++) {
+    size_t len = parts[i] != NULL ? strlen(parts[i]) : 0;
+    same = same && parts[i] == ssl_client->credential_bufs[i] && len == ssl_client->credential_lens[i];
+    if (record) {
+      ssl_client->credential_bufs[i] = parts[i];
+      ssl_client->credential_lens[i] = len;
+    }
+  }
+  return same;
+}
+
+/**
+ * \brief             Timing slot of the handshake state the context is in.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return ssl_handshake_state_time* The slot; states past the table share the last one.
+ */
+static ssl_handshake_state_time *state_time(sslclient_context *ssl_client) {
+  int state = ssl_client->ssl_ctx.state;
+  return &ssl_client->timing.states[state < SSL_CLIENT_HANDSHAKE_STATES ? state : SSL_CLIENT_HANDSHAKE_STATES - 1];
+}
+
+/**
+ * \brief             Advance the handshake by one state, noting whether a full key exchange
+ *                    takes place. A resumed handshake never reaches CLIENT_KEY_EXCHANGE.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return int        0 if the state completed, otherwise the mbedtls error code. 
+ */
+static int handshake_step(sslclient_context *ssl_client) {
+  if (ssl_client->ssl_ctx.state == MBEDTLS_SSL_CLIENT_KEY_EXCHANGE) {
+    ssl_client->full_handshake = true;
+  }
+
+  // time since the previous step is spent waiting for the peer
+  ssl_handshake_state_time *time = state_time(ssl_client);
+  unsigned long start = millis();
+  time->io_ms += start - ssl_client->timing_mark;
+  ssl_client->timing_io = 0;
+
+  int ret = mbedtls_ssl_handshake_step(&ssl_client->ssl_ctx);
+  SSL_TRACE_D(SSL_TRACE_HANDSHAKE_STEP, ssl_client->ssl_ctx.state, ret);
+
+  unsigned long end = millis();
+  unsigned long io = ssl_client->timing_io < end - start ? ssl_client->timing_io : end - start;
+  time->io_ms += io;
+  time->crypto_ms += (end - start) - io;
+  time->steps++;
+  ssl_client->timing_mark = end;
+  return ret;
+}
+
+/**
+ * \brief             Handshake timeout for this connection: the shared config's, if it sets one.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return unsigned long The timeout in milliseconds. 
+ */
+static unsigned long handshake_timeout_for(sslclient_context *ssl_client) {
+  if (ssl_client->settings.config != NULL && ssl_client->settings.config->handshakeTimeout() > 0) {
+    return ssl_client->settings.config->handshakeTimeout();
+  }
+  return ssl_client->settings.handshake_timeout;
+}
+
+/**
+ * \brief             Attach the transport and offer a cached session. The SSL context must
+ *                    have been set up; the handshake itself is run by poll_ssl_handshake().
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host, used as session cache key.
+ * \param port        uint32_t - The port, used as session cache key.
+ */
+static void begin_ssl_handshake(sslclient_context *ssl_client, const char *host, uint32_t port) {
+  set_memory_phase(ssl_client, SSL_MEMORY_PHASE_HANDSHAKE);
+  log_v("Setting up IO callbacks...");
+  mbedtls_ssl_set_bio(&ssl_client->ssl_ctx, ssl_client,
+                      timed_net_send, NULL, timed_net_recv_timeout );
+
+  ssl_client->full_handshake = false;
+  ssl_client->handshake_want_read = false;
+  if (ssl_client->settings.session_cache != NULL) {
+    (void)ssl_client->settings.session_cache->restore(host, port, &ssl_client->ssl_ctx);
+  }
+
+  log_v("Performing the SSL/TLS handshake...");
+  ssl_client->handshake_start = millis();
+  ssl_client->timing.setup_ms = ssl_client->handshake_start - ssl_client->timing_start - ssl_client->timing.connect_ms;
+  ssl_client->timing_mark = ssl_client->handshake_start;
+}
+
+/**
+ * \brief             Verify the peer of a completed handshake and save its session.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host, used as session cache key.
+ * \param port        uint32_t - The port, used as session cache key.
+ * \return int        0 if successful, MBEDTLS_ERR_X509_CERT_VERIFY_FAILED if the peer
+ *                    is not trusted.
+ */
+static int finish_ssl_handshake(sslclient_context *ssl_client, const char *host, uint32_t port) {
+  char buf[512];
+  int ret, flags;
+
+  log_d("Protocol is %s Ciphersuite is %s", mbedtls_ssl_get_version(&ssl_client->ssl_ctx), mbedtls_ssl_get_ciphersuite(&ssl_client->ssl_ctx));
+  if ((ret = mbedtls_ssl_get_record_expansion(&ssl_client->ssl_ctx)) >= 0) {
+    log_d("Record expansion is %d", ret);
+  } else {
+    log_w("Record expansion is unknown (compression)");
+  }
+
+  log_v("Verifying peer X.509 certificate...");
+
+  if ((flags = mbedtls_ssl_get_verify_result(&ssl_client->ssl_ctx)) != 0) {
+    memset(buf, 0, sizeof(buf));
+    mbedtls_x509_crt_verify_info(buf, sizeof(buf), "  ! ", flags);
+    log_e("Failed to verify peer certificate! verification info: %s", buf);
+    return handle_error(MBEDTLS_ERR_X509_CERT_VERIFY_FAILED);
+  } else {
+    log_v("Certificate verified.");
+  }
+
+  if (ssl_client->settings.session_cache != NULL) {
+    ssl_client->settings.session_cache->recordHandshake(!ssl_client->full_handshake);
+    (void)ssl_client->settings.session_cache->save(host, port, &ssl_client->ssl_ctx);
+  }
+
+  // a warm reconnect handshakes again with the same configuration, so keep what it points to;
+  // once released, ssl_client_can_restart() refuses the context
+  if (!ssl_client->settings.warm_reconnect) {
+    release_parsed_credentials(ssl_client);
+  }
+
+  ssl_client->last_io = millis();
+  set_memory_phase(ssl_client, SSL_MEMORY_PHASE_STEADY);
+  return 0;
+}
+
+/**
+ * \brief             Start timing a handshake from the transport connect().
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ */
+static void start_handshake_timing(sslclient_context *ssl_client) {
+  memset(&ssl_client->timing, 0, sizeof(ssl_client->timing));
+  ssl_client->timing.result = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  ssl_client->timing_start = millis();
+}
+
+/**
+ * \brief             Complete the timing of a handshake that succeeded or failed, hand the
+ *                    transport back to the untimed callbacks and report to the callback.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param result      int - What poll_ssl_handshake() returns.
+ */
+static void end_handshake_timing(sslclient_context *ssl_client, int result) {
+  ssl_handshake_timing *timing = &ssl_client->timing;
+
+  timing->result = result == SSL_CLIENT_HANDSHAKE_DONE ? 0 : result;
+  timing->resumed = result == SSL_CLIENT_HANDSHAKE_DONE && !ssl_client->full_handshake;
+  unsigned long now = millis();
+  timing->total_ms = now - ssl_client->timing_start;
+
+  // a handshake that failed while waiting for the peer has that wait still unaccounted for
+  if (result != SSL_CLIENT_HANDSHAKE_DONE) {
+    state_time(ssl_client)->io_ms += now - ssl_client->timing_mark;
+  }
+
+  timing->io_ms = 0;
+  timing->crypto_ms = 0;
+  for (int i = 0; i < SSL_CLIENT_HANDSHAKE_STATES; i++) {
+    timing->io_ms += timing->states[i].io_ms;
+    timing->crypto_ms += timing->states[i].crypto_ms;
+  }
+
+  mbedtls_ssl_set_bio(&ssl_client->ssl_ctx, ssl_client, client_net_send, NULL, client_net_recv_timeout);
+
+  if (ssl_client->settings.timing_callback != NULL) {
+    ssl_client->settings.timing_callback(ssl_client->settings.timing_callback_arg, timing);
+  }
+}
+
+/**
+ * \brief             One poll of the handshake, see poll_ssl_handshake().
+ */
+static int advance_ssl_handshake(sslclient_context *ssl_client, const char *host, uint32_t port) {
+  int ret;
+
+  for (int i = 0; i < SSL_CLIENT_MAX_HANDSHAKE_STEPS && ssl_client->ssl_ctx.state != MBEDTLS_SSL_HANDSHAKE_OVER; i++) {
+    if (ssl_client->handshake_want_read && transport_available(ssl_client) <= 0) {
+      if (!ssl_client->client->connected()) {
+        log_e("Connection closed during the handshake");
+        return handle_error(MBEDTLS_ERR_NET_CONN_RESET);
+      }
+      break;
+    }
+
+    ret = handshake_step(ssl_client);
+    ssl_client->handshake_want_read = (ret == MBEDTLS_ERR_SSL_WANT_READ);
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      ssl_client->counters.handshake_retries++;
+      break;
+    }
+
+    if (ret != 0) {
+      if (ssl_client->settings.session_cache != NULL) {
+        ssl_client->settings.session_cache->remove(host, port); // never offer a session that broke a handshake twice
+      }
+      return handle_error(ret);
+    }
+  }
+
+  if (ssl_client->ssl_ctx.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+    unsigned long start = millis();
+    ret = finish_ssl_handshake(ssl_client, host, port);
+    ssl_client->timing.finish_ms = millis() - start;
+    return ret == 0 ? SSL_CLIENT_HANDSHAKE_DONE : ret;
+  }
+
+  if ((millis() - ssl_client->handshake_start) > handshake_timeout_for(ssl_client)) {
+    log_e("Handshake timed out");
+    return MBEDTLS_ERR_SSL_TIMEOUT;
+  }
+
+  return SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+}
+
+/**
+ * \brief             Advance the handshake as far as it goes without waiting. Once mbedtls
+ *                    has asked for input, it is only called again when the transport has
+ *                    data, so polling an idle connection costs one available() call.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host, used as session cache key.
+ * \param port        uint32_t - The port, used as session cache key.
+ * \return int        SSL_CLIENT_HANDSHAKE_IN_PROGRESS, SSL_CLIENT_HANDSHAKE_DONE once the
+ *                    peer has been verified, otherwise a negative error code.
+ */
+int poll_ssl_handshake(sslclient_context *ssl_client, const char *host, uint32_t port) {
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
+  int ret = advance_ssl_handshake(ssl_client, host, port);
+
+  if (ret == SSL_CLIENT_HANDSHAKE_DONE) {
+    ssl_client->counters.handshakes++;
+    ssl_client->counters.resumed_handshakes += ssl_client->full_handshake ? 0 : 1;
+  } else if (ret != SSL_CLIENT_HANDSHAKE_IN_PROGRESS) {
+    ssl_client->counters.failed_handshakes++;
+  }
+
+  if (ret != SSL_CLIENT_HANDSHAKE_IN_PROGRESS) {
+    end_handshake_timing(ssl_client, ret);
+  }
+  return ret;
+}
+
+/**
+ * \brief             Run the handshake started by begin_ssl_handshake() to completion,
+ *                    blocking the calling task.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host, used as session cache key.
+ * \param port        uint32_t - The port, used as session cache key.
+ * \return int        0 if successful, MBEDTLS_ERR_X509_CERT_VERIFY_FAILED if the peer
+ *                    is not trusted, otherwise an error code.
+ */
+static int perform_ssl_handshake(sslclient_context *ssl_client, const char *host, uint32_t port) {
+  int ret;
+
+  while ((ret = poll_ssl_handshake(ssl_client, host, port)) == SSL_CLIENT_HANDSHAKE_IN_PROGRESS) {
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  }
+
+  return ret == SSL_CLIENT_HANDSHAKE_DONE ? 0 : ret;
+}
+
+/**
+ * \brief             Connect the transport, set up the SSL context and start the handshake
+ *                    without waiting for it. Drive it with poll_ssl_handshake().
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host to connect to.
+ * \param port        uint32_t - The port to connect to.
+ * \param rootCABuff  const char* - The root CA certificate.
+ * \param cli_cert    const char* - The client certificate.
+ * \param cli_key     const char*- The client key.
+ * \param pskIdent    const char* - The PSK identity.
+ * \param psKey       const char* - The PSK key.
+ * \return int        0 if the handshake has been started, otherwise an error code.
+ */
+int begin_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey)
+{
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
+  int ret;
+  log_v("Free internal heap before TLS %u", ESP.getFreeHeap());
+  set_memory_phase(ssl_client, SSL_MEMORY_PHASE_CONFIG);
+
+  log_d("Connecting to %s:%d", host, port);
+
+  Client *pClient = ssl_client->client;
+
+  if (!pClient) {
+    log_e("Client provider not initialised");
+    return -1;
+  }
+
+  start_handshake_timing(ssl_client);
+  if (!pClient->connect(host, port)) {
+    log_e("Connect to Server failed!");
+    return -2;
+  }
+  ssl_client->timing.connect_ms = millis() - ssl_client->timing_start;
+
+  log_v("Setting up the SSL/TLS structure...");
+  const mbedtls_ssl_config *conf = &ssl_client->ssl_conf;
+  (void)match_credentials(ssl_client, rootCABuff, cli_cert, cli_key, pskIdent, psKey, true);
+
+  if (ssl_client->settings.config != NULL) {
+    if (!ssl_client->settings.config->ready()) {
+      log_e("Shared SSLConfig has not been built");
+      return -1;
+    }
+    conf = ssl_client->settings.config->conf();
+  } else if ((ret = configure_connection(ssl_client, rootCABuff, cli_cert, cli_key, pskIdent, psKey)) != 0) {
+    return ret;
+  }
+
+  log_v("Setting hostname for TLS session...");
+
+  // Hostname set here should match CN in server certificate
+  if ((ret = mbedtls_ssl_set_hostname(&ssl_client->ssl_ctx, host)) != 0) {
+    return handle_error(ret);
+  }
+
+  if ((ret = mbedtls_ssl_setup(&ssl_client->ssl_ctx, conf)) != 0) {
+    return handle_error(ret);
+  }
+
+  begin_ssl_handshake(ssl_client, host, port);
+  return 0;
+}
+
+/**
+ * \brief             Start the ssl client.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host to connect to.
+ * \param port        uint32_t - The port to connect to.
+ * \param timeout     int - The timeout in milliseconds.
+ * \param rootCABuff  const char* - The root CA certificate.
+ * \param cli_cert    const char* - The client certificate.
+ * \param cli_key     const char*- The client key.
+ * \param pskIdent    const char* - The PSK identity.
+ * \param psKey       const char* - The PSK key.
+ * \return int        1 if successful. 
+ */
+int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, int timeout, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey)
+{
+  int ret = begin_ssl_client(ssl_client, host, port, rootCABuff, cli_cert, cli_key, pskIdent, psKey);
+
+  if (ret == 0) {
+    ret = perform_ssl_handshake(ssl_client, host, port);
+  }
+
+  if (ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
+    stop_ssl_socket(ssl_client, rootCABuff, cli_cert, cli_key);  //It's not safe continue.
+  }
+
+  if (ret != 0) {
+    return ret;
+  }
+
+  log_v("Free internal heap after TLS %u", ESP.getFreeHeap());
+
+  //return ssl_client->socket;
+  return 1;
+}
+
+/**
+ * \brief             Reset a context that is still set up from a previous connection and start
+ *                    a new handshake on it without waiting. Configuration, credentials, RNG and
+ *                    record buffers are kept; only the session is reset with
+ *                    mbedtls_ssl_session_reset() and the transport is connected again.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host to connect to.
+ * \param port        uint32_t - The port to connect to.
+ * \return int        0 if the handshake has been started, otherwise an error code.
+ */
+int reset_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port) {
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
+  int ret;
+
+  if (!ssl_client_is_set_up(ssl_client)) {
+    log_e("Nothing to restart, the SSL context is not set up");
+    return -1;
+  }
+
+  if (ssl_client->credentials_released) {
+    log_e("Cannot restart, the credentials of the SSL context have been freed");
+    return -1;
+  }
+
+  log_d("Warm reconnect to %s:%d", host, port);
+  Client *pClient = ssl_client->client;
+  pClient->stop();
+
+  if ((ret = wake_ssl_buffers(ssl_client)) != 0) {
+    return ret;
+  }
+
+  if ((ret = mbedtls_ssl_session_reset(&ssl_client->ssl_ctx)) != 0) {
+    return handle_error(ret);
+  }
+  ssl_client->out_record_header_len = 0;
+  ssl_client->out_record_left = 0;
+
+  start_handshake_timing(ssl_client);
+  if (!pClient->connect(host, port)) {
+    log_e("Connect to Server failed!");
+    return -2;
+  }
+  ssl_client->timing.connect_ms = millis() - ssl_client->timing_start;
+
+  if ((ret = mbedtls_ssl_set_hostname(&ssl_client->ssl_ctx, host)) != 0) {
+    return handle_error(ret);
+  }
+
+  begin_ssl_handshake(ssl_client, host, port);
+  return 0;
+}
+
+/**
+ * \brief             Reconnect a context that is still set up from a previous connection,
+ *                    see reset_ssl_client().
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param host        const char* - The host to connect to.
+ * \param port        uint32_t - The port to connect to.
+ * \return int        1 if successful, otherwise an error code.
+ */
+int restart_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port) {
+  int ret = reset_ssl_client(ssl_client, host, port);
+
+  if (ret == 0) {
+    ret = perform_ssl_handshake(ssl_client, host, port);
+  }
+  return ret == 0 ? 1 : ret;
+}
+
+/**
+ * \brief             Close the connection but keep the SSL context for restart_ssl_client().
+ *                    A close_notify alert is sent if the transport is still up.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ */
+void close_ssl_socket(sslclient_context *ssl_client) {
+  log_v("Closing SSL connection, keeping context.");
+
+  if (ssl_client->client == NULL) {
+    return;
+  }
+
+  if (ssl_client_is_set_up(ssl_client) && ssl_client->client->connected() && wake_ssl_buffers(ssl_client) == 0) {
+    (void)mbedtls_ssl_close_notify(&ssl_client->ssl_ctx);
   }
 
+  ssl_client->client->stop();
+}
+
+/**
+ * \brief             Whether the SSL context has been set up and can be restarted.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \return bool       True if mbedtls_ssl_setup() has run on the context.
+ */
+bool ssl_client_is_set_up(sslclient_context *ssl_client) {
+  return ssl_client->ssl_ctx.conf != NULL;
+}
+
+/**
+ * \brief             Whether reset_ssl_client() can reuse the context for a connection with the
+ *                    given credentials: it is set up, still holds the credentials its
+ *                    configuration points to, and was built from the same credential buffers
+ *                    (same addresses and lengths; contents changed in place are not noticed).
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param rootCABuff  const char* - The root CA certificate.
+ * \param cli_cert    const char* - The client certificate.
+ * \param cli_key     const char*- The client key.
+ * \param pskIdent    const char* - The PSK identity.
+ * \param psKey       const char* - The PSK key.
+ * \return bool       True if a warm reconnect is safe.
+ */
+bool ssl_client_can_restart(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey) {
+  if (!ssl_client_is_set_up(ssl_client) || ssl_client->credentials_released) {
+    return false;
+  }
+
+  return match_credentials(ssl_client, rootCABuff, cli_cert, cli_key, pskIdent, psKey, false);
+}
+
+/**
+ * \brief             Stop the ssl socket.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \param rootCABuff  const char* - The root CA certificate. 
+ * \param cli_cert    const char* - The client certificate. 
+ * \param cli_key     const char* - The client key. 
+ */
+void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key) {
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
+  log_v("Cleaning SSL connection.");
+
+  ssl_client->client->stop();
+
+  // avoid memory leak if ssl connection attempt failed
+  release_parsed_credentials(ssl_client);
+
   mbedtls_ssl_free(&ssl_client->ssl_ctx);
   mbedtls_ssl_config_free(&ssl_client->ssl_conf);
-  mbedtls_ctr_drbg_free(&ssl_client->drbg_ctx);
-  mbedtls_entropy_free(&ssl_client->entropy_ctx);
 
-  // reset embedded pointers to zero
-  memset(ssl_client, 0, sizeof(sslclient_context));
+  // reset the per-connection state; the transport, settings, timing and counters stay
+  memset(&ssl_client->ssl_ctx, 0, sizeof(sslclient_context) - offsetof(sslclient_context, ssl_ctx));
+}
+
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+/**
+ * \brief             Move a record buffer to a new allocation of another size. The start of the
+ *                    buffer is kept, as it holds the record sequence number.
+ * 
+ * \param buf         unsigned char** - The buffer, replaced on success.
+ * \param buf_len     size_t* - Its length, updated on success.
+ * \param new_len     size_t - The new length.
+ * \return int        0 if successful, MBEDTLS_ERR_SSL_ALLOC_FAILED otherwise.
+ */
+static int resize_record_buffer(unsigned char **buf, size_t *buf_len, size_t new_len) {
+  unsigned char *resized = (unsigned char *)mbedtls_calloc(1, new_len);
+
+  if (resized == NULL) {
+    return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+  }
+
+  memcpy(resized, *buf, *buf_len < new_len ? *buf_len : new_len);
+  mbedtls_platform_zeroize(*buf, *buf_len);
+  mbedtls_free(*buf);
+  *buf = resized;
+  *buf_len = new_len;
+  return 0;
+}
+
+/**
+ * \brief             Resize both record buffers of an established connection that has nothing
+ *                    buffered, the way mbedtls does after the handshake.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param in_len      size_t - New input buffer length.
+ * \param out_len     size_t - New output buffer length.
+ * \return int        0 if successful, MBEDTLS_ERR_SSL_ALLOC_FAILED otherwise.
+ */
+static int resize_record_buffers(sslclient_context *ssl_client, size_t in_len, size_t out_len) {
+  mbedtls_ssl_context *ssl = &ssl_client->ssl_ctx;
+  int ret = resize_record_buffer(&ssl->in_buf, &ssl->in_buf_len, in_len);
+
+  if (ret == 0) {
+    ret = resize_record_buffer(&ssl->out_buf, &ssl->out_buf_len, out_len);
+  }
+
+  mbedtls_ssl_reset_in_out_pointers(ssl);
+  return ret;
+}
+#endif
+
+/**
+ * \brief             Shrink the record buffers to SSL_CLIENT_IDLE_BUFFER_SIZE once nothing has
+ *                    been sent or received for idle_ms and nothing is buffered in either
+ *                    direction. wake_ssl_buffers() grows them back before the next record.
+ *                    Needs mbedtls built with MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \param idle_ms     unsigned long - How long the connection must have been quiet.
+ * \return bool       True if the buffers are shrunk.
+ */
+bool release_idle_ssl_buffers(sslclient_context *ssl_client, unsigned long idle_ms) {
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
+  mbedtls_ssl_context *ssl = &ssl_client->ssl_ctx;
+
+  if (ssl_client->buffers_idle) {
+    return true;
+  }
+
+  if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER || millis() - ssl_client->last_io < idle_ms) {
+    return false;
+  }
+
+  if (mbedtls_ssl_check_pending(ssl) != 0 || ssl->out_left > 0 || ssl_client->out_batch_len > 0) {
+    return false;
+  }
+
+  size_t in_len = ssl->in_buf_len;
+  size_t out_len = ssl->out_buf_len;
+
+  if (resize_record_buffers(ssl_client, SSL_CLIENT_IDLE_BUFFER_SIZE, SSL_CLIENT_IDLE_BUFFER_SIZE) != 0) {
+    (void)resize_record_buffers(ssl_client, in_len, out_len);
+    return false;
+  }
+
+  log_d("Idle, record buffers %zu + %zu -> %u + %u bytes", in_len, out_len, SSL_CLIENT_IDLE_BUFFER_SIZE, SSL_CLIENT_IDLE_BUFFER_SIZE);
+  ssl_client->in_buf_active_len = in_len;
+  ssl_client->out_buf_active_len = out_len;
+  ssl_client->buffers_idle = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * \brief             Grow record buffers released by release_idle_ssl_buffers() back to their
+ *                    size. Called before every read or write on the context.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context.
+ * \return int        0 if the buffers are usable, MBEDTLS_ERR_SSL_ALLOC_FAILED otherwise.
+ */
+int wake_ssl_buffers(sslclient_context *ssl_client) {
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
+  if (!ssl_client->buffers_idle) {
+    return 0;
+  }
+
+  int ret = resize_record_buffers(ssl_client, ssl_client->in_buf_active_len, ssl_client->out_buf_active_len);
+  if (ret != 0) {
+    return handle_error(ret);
+  }
+
+  ssl_client->buffers_idle = false;
+#endif
+  return 0;
+}
+
+/**
+ * \brief             Report the memory one connection holds. The record buffers only exist
+ *                    between mbedtls_ssl_setup() and stop_ssl_socket(). Their size follows the
+ *                    negotiated fragment length only when mbedtls is built with
+ *                    MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH; otherwise it is fixed at build time.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \param footprint   ssl_client_footprint* - Filled in with sizes in bytes. 
+ */
+void get_ssl_footprint(sslclient_context *ssl_client, ssl_client_footprint *footprint) {
+  mbedtls_ssl_context *ssl = &ssl_client->ssl_ctx;
+
+  memset(footprint, 0, sizeof(ssl_client_footprint));
+  footprint->context = sizeof(sslclient_context);
+  footprint->out_batch = ssl_client->settings.out_batch != NULL ? ssl_client->settings.out_batch_size : 0;
+
+  if (ssl->in_buf != NULL) {
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    footprint->in_buffer = ssl->in_buf_len;
+    footprint->out_buffer = ssl->out_buf_len;
+#else
+    footprint->in_buffer = MBEDTLS_SSL_IN_BUFFER_LEN;
+    footprint->out_buffer = MBEDTLS_SSL_OUT_BUFFER_LEN;
+#endif
+  }
+
+  if (ssl->conf != NULL) {
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    footprint->in_max_frag = mbedtls_ssl_get_input_max_frag_len(ssl);
+    footprint->out_max_frag = mbedtls_ssl_get_output_max_frag_len(ssl);
+#else
+    footprint->in_max_frag = MBEDTLS_SSL_IN_CONTENT_LEN;
+    footprint->out_max_frag = MBEDTLS_SSL_OUT_CONTENT_LEN;
+#endif
+  }
+
+  footprint->total = footprint->context + footprint->in_buffer + footprint->out_buffer;
+}
+
+/**
+ * \brief             Number of bytes already decrypted and waiting in the SSL context.
+ *                    Does no I/O and processes no records.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return int        The number of bytes that can be read without decrypting. 
+ */
+int data_decrypted(sslclient_context *ssl_client) {
+  return (int)mbedtls_ssl_get_bytes_avail(&ssl_client->ssl_ctx);
+}
+
+/**
+ * \brief             Whether data_to_read() could make progress: part of a record is waiting
+ *                    in the SSL context or ciphertext is waiting in the transport. Only asks
+ *                    the transport for available(); nothing is read or decrypted.
+ * 
+ * \param ssl_client  sslclient_context* - The ssl client context. 
+ * \return bool       True if there is input to process. 
+ */
+bool data_incoming(sslclient_context *ssl_client) {
+  return mbedtls_ssl_check_pending(&ssl_client->ssl_ctx) != 0 || transport_available(ssl_client) > 0;
 }
 
 /**
@@ -424,7 +1422,17 @@ void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, cons
  * \return int        The number of bytes to read. 
  */
 int data_to_read(sslclient_context *ssl_client) {
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
   int ret, res;
+
+  if ((ret = wake_ssl_buffers(ssl_client)) != 0) {
+    return ret;
+  }
+
+  if ((ret = drain_ssl_output(ssl_client)) != 0) {
+    return handle_error(ret);
+  }
+
   ret = mbedtls_ssl_read(&ssl_client->ssl_ctx, NULL, 0);
   //log_e("RET: %i",ret);   //for low level debug
   res = mbedtls_ssl_get_bytes_avail(&ssl_client->ssl_ctx);
@@ -433,30 +1441,107 @@ int data_to_read(sslclient_context *ssl_client) {
     return handle_error(ret);
   }
 
+  if (res > 0) {
+    ssl_client->last_io = millis();
+  }
   return res;
 }
 
  /**
-  * \brief              Send data to the ssl server. 
+  * \brief              Send data to the ssl server. With an output batch buffer set, the whole
+  *                     payload is encrypted record by record into the batch, which goes to the
+  *                     transport whenever it is full and once at the end. Without one, only the
+  *                     first record is sent and the caller sends the rest. Batched records are
+  *                     already counted as sent, so a batch that cannot be flushed before the
+  *                     deadline is a fatal error.
+  *                     While the transport is full it sleeps between attempts (see
+  *                     wait_for_send_window()) and gives up after send_timeout milliseconds or
+  *                     when the backpressure callback says so. A timeout of 0 never waits.
   * 
   * \param ssl_client   sslclient_context* - The ssl client context. 
   * \param data         const uint8_t* - The data to send. 
   * \param len          size_t - The length of the data. 
-  * \return int         The number of bytes sent. 
+  * \return int         The number of bytes sent, which may be less than len. 
+  *                     MBEDTLS_ERR_SSL_WANT_WRITE or MBEDTLS_ERR_SSL_WANT_READ if nothing could be
+  *                     sent in time; call again with the same data to complete the write.
+  *                     Any other negative value is a fatal error. 
   */
 int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, size_t len) {
-  log_v("Writing SSL (%zu bytes)...", len);  //for low level debug
+  SSL_TRACE_V(SSL_TRACE_SEND_BEGIN, len, 0);
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
   int ret = -1;
+  size_t sent = 0;
+  unsigned long start = millis();
+
+  if (len == 0) {
+    return 0;
+  }
+
+  if ((ret = wake_ssl_buffers(ssl_client)) != 0) {
+    return ret;
+  }
+
+  ssl_client->out_batching = ssl_client->settings.out_batch != NULL;
+
+  while (sent < len && (sent == 0 || ssl_client->out_batching)) {
+    ret = mbedtls_ssl_write(&ssl_client->ssl_ctx, &data[sent], len - sent);
+
+    if (ret > 0) {
+      sent += ret;
+      continue;
+    }
 
-  while ((ret = mbedtls_ssl_write(&ssl_client->ssl_ctx, data, len)) <= 0) {
     if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      ssl_client->out_batching = false;
       return handle_error(ret);
     }
+    ssl_client->counters.send_retries++;
+
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= ssl_client->settings.send_timeout) {
+      log_d("Send stalled for %lums, %zu of %zu bytes sent", elapsed, sent, len);
+      break;
+    }
+
+    if (ssl_client->settings.backpressure != NULL && !ssl_client->settings.backpressure(ssl_client->settings.backpressure_arg, sent, len - sent)) {
+      break;
+    }
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ) {
+      wait_for_data(ssl_client, ssl_client->settings.send_timeout - elapsed);
+    } else {
+      wait_for_send_window(ssl_client, ssl_client->settings.send_timeout - elapsed);
+    }
   }
 
-  len = ret;
-  log_v("%zu bytes written", len);  //for low level debug
-  return ret;
+  // the batched records count as sent, so they have to leave before the deadline
+  ssl_client->out_batching = false;
+  int flushed = flush_ssl_output(ssl_client);
+  while (flushed == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    unsigned long elapsed = millis() - start;
+    if (elapsed >= ssl_client->settings.send_timeout) {
+      log_e("Send stalled for %lums, dropping %zu batched bytes", elapsed, ssl_client->out_batch_len);
+      ssl_client->out_batch_len = 0;
+      flushed = MBEDTLS_ERR_SSL_TIMEOUT;
+      break;
+    }
+
+    wait_for_send_window(ssl_client, ssl_client->settings.send_timeout - elapsed);
+    flushed = flush_ssl_output(ssl_client);
+  }
+
+  if (flushed != 0) {
+    return handle_error(flushed);
+  }
+
+  if (sent == 0) {
+    return ret; // MBEDTLS_ERR_SSL_WANT_WRITE or MBEDTLS_ERR_SSL_WANT_READ
+  }
+
+  ssl_client->last_io = millis();
+  ssl_client->counters.plaintext_out += sent;
+  SSL_TRACE_V(SSL_TRACE_SEND_END, sent, ssl_client->counters.send_retries);
+  return (int)sent;
 }
 
 /**
@@ -468,31 +1553,84 @@ int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, size_t len
  * \return int            The number of bytes received. 
  */
 int get_ssl_receive(sslclient_context *ssl_client, uint8_t *data, int length) {
-  log_v( "Reading SSL (%d bytes)", length);   //for low level debug
-  int ret = -1;
+  SSL_TRACE_V(SSL_TRACE_RECEIVE_BEGIN, length, 0);
+  SSLArenaScope scope(ssl_client->settings.arena, ssl_client->settings.memory);
+  int ret = wake_ssl_buffers(ssl_client);
+
+  if (ret != 0) {
+    return ret;
+  }
+
+  if ((ret = drain_ssl_output(ssl_client)) != 0) {
+    return handle_error(ret);
+  }
 
   ret = mbedtls_ssl_read(&ssl_client->ssl_ctx, data, length);
+  if (ret > 0) {
+    ssl_client->last_io = millis();
+    ssl_client->counters.plaintext_in += ret;
+  }
 
-  log_v( "%d bytes read", ret);   //for low level debug
+  SSL_TRACE_V(SSL_TRACE_RECEIVE_END, ret, 0);
   return ret;
 }
 
 /**
- * \brief           Get the ssl receive object with timeout.
+ * \brief               Get the decrypted data of the current record without copying it. The data
+ *                      stays in the mbedtls input buffer until consume_ssl_receive() is called;
+ *                      any other read on the context invalidates the pointer.
  * 
- * \param pb        sslclient_context* - The ssl client context. 
- * \param res       uint8_t* - The data to receive. 
- * \return bool     True if the data was received, false otherwise. 
+ * \param ssl_client    sslclient_context* - The ssl client context. 
+ * \param data          const uint8_t** - Set to the first unread byte, or NULL if there is none. 
+ * \return int          Number of bytes at *data, 0 if nothing is decrypted yet, or a negative
+ *                      error code if batched output could not be sent. 
  */
-static bool parseHexNibble(char pb, uint8_t* res) {
-  if (pb >= '0' && pb <= '9') {
-    *res = (uint8_t) (pb - '0'); return true;
-  } else if (pb >= 'a' && pb <= 'f') {
-    *res = (uint8_t) (pb - 'a' + 10); return true;
-  } else if (pb >= 'A' && pb <= 'F') {
-    *res = (uint8_t) (pb - 'A' + 10); return true;
+int peek_ssl_receive(sslclient_context *ssl_client, const uint8_t **data) {
+  int ret = drain_ssl_output(ssl_client);
+
+  if (ret != 0) {
+    *data = NULL;
+    return handle_error(ret);
   }
-  return false;
+
+  size_t len = mbedtls_ssl_get_bytes_avail(&ssl_client->ssl_ctx);
+
+  *data = len > 0 ? ssl_client->ssl_ctx.in_offt : NULL;
+  return (int)len;
+}
+
+/**
+ * \brief               Mark bytes returned by peek_ssl_receive() as read. Updates the record
+ *                      state the same way mbedtls_ssl_read() does after copying.
+ * 
+ * \param ssl_client    sslclient_context* - The ssl client context. 
+ * \param length        size_t - Number of bytes to drop, clamped to what is available. 
+ * \return size_t       Number of bytes dropped. 
+ */
+size_t consume_ssl_receive(sslclient_context *ssl_client, size_t length) {
+  mbedtls_ssl_context *ssl = &ssl_client->ssl_ctx;
+  size_t avail = mbedtls_ssl_get_bytes_avail(ssl);
+
+  if (length > avail) {
+    length = avail;
+  }
+
+  if (length == 0) {
+    return 0;
+  }
+
+  mbedtls_platform_zeroize(ssl->in_offt, length);
+  ssl->in_msglen -= length;
+  ssl_client->counters.plaintext_in += length;
+
+  if (ssl->in_msglen == 0) {
+    ssl->in_offt = NULL;
+    ssl->keep_current_message = 0;
+  } else {
+    ssl->in_offt += length;
+  }
+
+  return length;
 }
 
 /**
@@ -15,29 +15,197 @@
 #include "mbedtls/error.h"
 
 #include <Client.h>
+#include "SSLSessionCache.h"
+#include "SSLCredentials.h"
+#include "ssl_random.h"
+#include "SSLConfig.h"
+#include "SSLArena.h"
 
 #define SSL_CLIENT_LOW_LATENCY_NETWORK_HANDSHAKE_TIMEOUT 5000U
 #define SSL_CLIENT_DEFAULT_HANDSHAKE_TIMEOUT 15000U
 #define SSL_CLIENT_SLOW_NETWORK_HANDSHAKE_TIMEOUT 30000U
 #define SSL_CLIENT_UNRELIABLE_NETWORK_HANDSHAKE_TIMEOUT 45000U
+#define SSL_CLIENT_DEFAULT_SEND_TIMEOUT 5000U
 #define SSL_CLIENT_SEND_BUFFER_SIZE 1024U
+#define SSL_CLIENT_MAX_HOST_LENGTH 253U
+#define SSL_CLIENT_MAX_HANDSHAKE_STEPS 32
+#define SSL_CLIENT_CREDENTIAL_PARTS 5 // CA certificate, client certificate, client key, PSK identity, PSK
+
+#ifndef SSL_CLIENT_WRITEV_STAGE_SIZE
+#define SSL_CLIENT_WRITEV_STAGE_SIZE 512U // stack bytes writev() gathers small pieces in
+#endif
+
+#ifndef SSL_CLIENT_RECV_POLL_INTERVAL
+#define SSL_CLIENT_RECV_POLL_INTERVAL 1U
+#endif
+
+#ifndef SSL_CLIENT_IDLE_BUFFER_SIZE
+#define SSL_CLIENT_IDLE_BUFFER_SIZE 128U // record buffer bytes kept per direction while idle
+#endif
+
+#ifndef SSL_CLIENT_HANDSHAKE_STATES
+#define SSL_CLIENT_HANDSHAKE_STATES 20 // mbedtls_ssl_states values timed; later states share the last slot
+#endif
+
+#ifndef SSL_CLIENT_SEND_POLL_INTERVAL
+#define SSL_CLIENT_SEND_POLL_INTERVAL 1U
+#endif
+
+#define SSL_CLIENT_HANDSHAKE_ERROR -1
+#define SSL_CLIENT_HANDSHAKE_IN_PROGRESS 0
+#define SSL_CLIENT_HANDSHAKE_DONE 1
 
 using namespace std;
 
+/**
+ * \brief Transport readiness hook: block for at most timeout_ms until the transport may
+ *        have data, e.g. by taking a semaphore given from a socket event. Returns true if
+ *        woken by data, false on timeout; spurious wake-ups are harmless.
+ */
+typedef bool (*ssl_client_ready_fn)(void *arg, uint32_t timeout_ms);
+
+/**
+ * \brief Backpressure callback: called each time send_ssl_data() finds the transport full,
+ *        with the bytes sent so far in this call and the bytes still to send. Return true
+ *        to keep waiting (up to the send timeout), false to return at once.
+ */
+typedef bool (*ssl_client_backpressure_fn)(void *arg, size_t sent, size_t pending);
+
+/**
+ * \brief Memory held by one connection, in bytes. The record buffers are allocated by
+ *        mbedtls_ssl_setup(); the output batch is caller-supplied and only reported.
+ */
+typedef struct ssl_client_footprint {
+  size_t context;      // the sslclient_context with the mbedtls structs embedded in it
+  size_t in_buffer;    // record input buffer
+  size_t out_buffer;   // record output buffer
+  size_t in_max_frag;  // largest record plaintext accepted from the peer
+  size_t out_max_frag; // largest record plaintext sent
+  size_t out_batch;    // caller-supplied output batch buffer
+  size_t total;        // context + in_buffer + out_buffer
+} ssl_client_footprint;
+
+/**
+ * \brief Time one handshake state took, in milliseconds.
+ */
+typedef struct ssl_handshake_state_time {
+  uint32_t io_ms;       // waiting for the peer, and inside transport reads and writes
+  uint32_t crypto_ms;   // the rest: parsing, certificate verification, key exchange, signing
+  uint16_t steps;       // mbedtls_ssl_handshake_step() calls, more than 1 if the state waited
+} ssl_handshake_state_time;
+
+/**
+ * \brief Where the time of the last handshake went, in milliseconds. states[] is indexed
+ *        by mbedtls_ssl_states, e.g. MBEDTLS_SSL_SERVER_CERTIFICATE for chain verification.
+ */
+typedef struct ssl_handshake_timing {
+  uint32_t connect_ms;  // transport connect()
+  uint32_t setup_ms;    // configuration, certificate parsing and SSL context setup
+  uint32_t io_ms;       // sum of states[].io_ms
+  uint32_t crypto_ms;   // sum of states[].crypto_ms
+  uint32_t finish_ms;   // verification result and session cache update after the last state
+  uint32_t total_ms;    // from connect() until the handshake ended
+  int result;           // 0, an error code, or SSL_CLIENT_HANDSHAKE_IN_PROGRESS while running
+  bool resumed;         // an abbreviated handshake resumed a cached session
+  ssl_handshake_state_time states[SSL_CLIENT_HANDSHAKE_STATES];
+} ssl_handshake_timing;
+
+/**
+ * \brief Handshake timing callback: called once per handshake when it succeeds or fails.
+ */
+typedef void (*ssl_client_timing_fn)(void *arg, const ssl_handshake_timing *timing);
+
+/**
+ * \brief What a client's connections have cost since it was created or its counters were
+ *        reset. Kept across stop() and reconnects.
+ */
+typedef struct ssl_client_counters {
+  uint64_t plaintext_in;          // application bytes handed to the caller
+  uint64_t plaintext_out;         // application bytes taken from the caller
+  uint64_t ciphertext_in;         // bytes read from the transport, handshake included
+  uint64_t ciphertext_out;        // bytes written to the transport, handshake included
+  uint32_t records_in;            // TLS records received
+  uint32_t records_out;           // TLS records sent
+  uint32_t transport_reads;       // Client::read() calls
+  uint32_t transport_writes;      // Client::write() calls
+  uint32_t transport_availables;  // Client::available() calls
+  uint32_t send_retries;          // WANT_READ/WANT_WRITE from mbedtls_ssl_write() in send_ssl_data()
+  uint32_t handshake_retries;     // WANT_READ/WANT_WRITE from handshake steps
+  uint32_t handshakes;            // handshakes completed
+  uint32_t resumed_handshakes;    // of which resumed a cached session
+  uint32_t failed_handshakes;     // handshakes that ended in an error or timed out
+} ssl_client_counters;
+
+/**
+ * Settings of a client, kept for its lifetime. stop_ssl_socket() leaves them alone so that
+ * the next connection uses them too.
+ */
+typedef struct ssl_client_settings {
+  unsigned long handshake_timeout;
+
+  SSLSessionCache *session_cache;
+  SSLCredentials *credentials;
+  SSLConfig *config;
+  bool warm_reconnect;
+
+  ssl_client_ready_fn recv_ready;
+  void *recv_ready_arg;
+
+  unsigned long send_timeout;
+  ssl_client_ready_fn send_ready;
+  void *send_ready_arg;
+  ssl_client_backpressure_fn backpressure;
+  void *backpressure_arg;
+
+  unsigned char max_frag_len; // MBEDTLS_SSL_MAX_FRAG_LEN_* to negotiate, NONE for full records
+  SSLArena *arena;            // serves the mbedtls allocations of this connection, NULL for the heap
+  SSLMemoryTracker *memory;   // counts the mbedtls allocations of this connection, NULL when off
+
+  ssl_client_timing_fn timing_callback;
+  void *timing_callback_arg;
+
+  uint8_t *out_batch;
+  size_t out_batch_size;
+} ssl_client_settings;
+
 typedef struct sslclient_context {
+  // Kept by stop_ssl_socket().
   Client* client;
+  ssl_client_settings settings;
+  ssl_handshake_timing timing; // of the last handshake, still there after it failed
+  ssl_client_counters counters;
 
+  // Per connection, from ssl_ctx to the end; stop_ssl_socket() wipes them.
   mbedtls_ssl_context ssl_ctx;
   mbedtls_ssl_config ssl_conf;
 
-  mbedtls_ctr_drbg_context drbg_ctx;
-  mbedtls_entropy_context entropy_ctx;
-
   mbedtls_x509_crt ca_cert;
   mbedtls_x509_crt client_cert;
   mbedtls_pk_context client_key;
 
-  unsigned long handshake_timeout;
+  unsigned long handshake_start;
+
+  bool full_handshake;
+  bool handshake_want_read;
+  bool credentials_released;              // the parsed credentials the config points to are freed
+  const char *credential_bufs[SSL_CLIENT_CREDENTIAL_PARTS]; // the credential buffers the config was built from
+  size_t credential_lens[SSL_CLIENT_CREDENTIAL_PARTS];       // and their lengths
+
+  unsigned long timing_start; // millis() when connect() was called
+  unsigned long timing_mark;  // millis() when the last handshake step ended
+  unsigned long timing_io;    // transport time inside the current handshake step
+
+  uint8_t out_record_header[5]; // header bytes of the next outgoing record seen so far
+  size_t out_record_header_len;
+  size_t out_record_left;       // body bytes of the current outgoing record still to leave
+
+  unsigned long last_io;      // millis() of the last record sent or received
+  bool buffers_idle;          // record buffers shrunk to SSL_CLIENT_IDLE_BUFFER_SIZE
+  size_t in_buf_active_len;   // sizes to grow back to
+  size_t out_buf_active_len;
+
+  size_t out_batch_len;
+  bool out_batching;
 } sslclient_context;
 
 static int configure_default_ssl(sslclient_context *ssl_client);
@@ -53,11 +221,30 @@ void confirm_protocols(sslclient_context* ssl_client, const char* cli_cert, cons
 int verify_peer_certificate(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key);
 void clean_up_resources(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key);
 void ssl_init(sslclient_context *ssl_client, Client *client);
+int decode_psk(const char *psKey, unsigned char *psk, size_t *psk_len);
+int configure_ssl_defaults(mbedtls_ssl_config *conf);
+int ssl_max_frag_len_code(size_t length);
+void get_ssl_footprint(sslclient_context *ssl_client, ssl_client_footprint *footprint);
+int configure_ssl_credentials(mbedtls_ssl_config *conf, SSLCredentials *creds);
+int begin_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey);
+int poll_ssl_handshake(sslclient_context *ssl_client, const char *host, uint32_t port);
 int start_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port, int timeout, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey);
 void stop_ssl_socket(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key);
+int reset_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port);
+int restart_ssl_client(sslclient_context *ssl_client, const char *host, uint32_t port);
+void close_ssl_socket(sslclient_context *ssl_client);
+bool ssl_client_is_set_up(sslclient_context *ssl_client);
+bool ssl_client_can_restart(sslclient_context *ssl_client, const char *rootCABuff, const char *cli_cert, const char *cli_key, const char *pskIdent, const char *psKey);
+bool release_idle_ssl_buffers(sslclient_context *ssl_client, unsigned long idle_ms);
+int wake_ssl_buffers(sslclient_context *ssl_client);
+int data_decrypted(sslclient_context *ssl_client);
+bool data_incoming(sslclient_context *ssl_client);
 int data_to_read(sslclient_context *ssl_client);
+int flush_ssl_output(sslclient_context *ssl_client);
 int send_ssl_data(sslclient_context *ssl_client, const uint8_t *data, size_t len);
 int get_ssl_receive(sslclient_context *ssl_client, uint8_t *data, int length);
+int peek_ssl_receive(sslclient_context *ssl_client, const uint8_t **data);
+size_t consume_ssl_receive(sslclient_context *ssl_client, size_t length);
 bool verify_ssl_fingerprint(sslclient_context *ssl_client, const char* fp, const char* domain_name);
 bool verify_ssl_dn(sslclient_context *ssl_client, const char* domain_name);
 
@@ -0,0 +1,143 @@
+/* Process-wide CTR-DRBG shared by every SSLClient connection.
+ */
+
+#include "Arduino.h"
+#include <mutex>
+#include <string.h>
+#include "ssl_random.h"
+
+static const char *pers = "esp32-tls";
+
+static std::mutex random_lock;
+static mbedtls_entropy_context entropy_ctx;
+static mbedtls_ctr_drbg_context drbg_ctx;
+static ssl_random_config random_config;
+static bool random_ready = false;
+static uint32_t random_seeds = 0;
+
+/**
+ * \brief           Seed the shared DRBG. Must be called with random_lock held.
+ * 
+ * \return int      0 on success, otherwise the mbedtls error code. 
+ */
+static int seed_locked(void) {
+  log_v("Seeding the shared random number generator");
+  mbedtls_entropy_init(&entropy_ctx);
+  mbedtls_ctr_drbg_init(&drbg_ctx);
+
+  int ret = 0;
+  if (random_config.entropy_source != NULL) {
+    ret = mbedtls_entropy_add_source(&entropy_ctx, random_config.entropy_source, random_config.entropy_source_data,
+                                     random_config.entropy_threshold, MBEDTLS_ENTROPY_SOURCE_STRONG);
+  }
+
+  if (ret == 0) {
+    ret = mbedtls_ctr_drbg_seed(&drbg_ctx, mbedtls_entropy_func, &entropy_ctx,
+                                (const unsigned char *) pers, strlen(pers));
+  }
+
+  if (ret != 0) {
+    log_e("Seeding the random number generator failed (%d)", ret);
+    mbedtls_ctr_drbg_free(&drbg_ctx);
+    mbedtls_entropy_free(&entropy_ctx);
+    return ret;
+  }
+
+  if (random_config.reseed_interval > 0) {
+    mbedtls_ctr_drbg_set_reseed_interval(&drbg_ctx, random_config.reseed_interval);
+  }
+  mbedtls_ctr_drbg_set_prediction_resistance(&drbg_ctx, random_config.prediction_resistance ? MBEDTLS_CTR_DRBG_PR_ON : MBEDTLS_CTR_DRBG_PR_OFF);
+
+  random_ready = true;
+  random_seeds++;
+  return 0;
+}
+
+/**
+ * \brief           Release the DRBG and entropy pool. Must be called with random_lock held.
+ */
+static void free_locked(void) {
+  if (random_ready) {
+    mbedtls_ctr_drbg_free(&drbg_ctx);
+    mbedtls_entropy_free(&entropy_ctx);
+    random_ready = false;
+  }
+}
+
+/**
+ * \brief           Set the reseed policy and entropy source. Takes effect immediately;
+ *                  an already seeded DRBG is torn down and seeded again on next use.
+ * 
+ * \param config    const ssl_random_config* - The policy, or NULL for the defaults. 
+ * \return int      0 on success. 
+ */
+int ssl_random_configure(const ssl_random_config *config) {
+  std::lock_guard<std::mutex> guard(random_lock);
+  free_locked();
+
+  if (config != NULL) {
+    random_config = *config;
+  } else {
+    memset(&random_config, 0, sizeof(random_config));
+  }
+  return 0;
+}
+
+/**
+ * \brief           Random callback for mbedtls_ssl_conf_rng(). Seeds the DRBG on first use.
+ * 
+ * \param ctx       void* - Unused, the DRBG is process-wide. 
+ * \param output    unsigned char* - Buffer to fill. 
+ * \param len       size_t - Number of bytes requested. 
+ * \return int      0 on success, otherwise the mbedtls error code. 
+ */
+int ssl_random(void *ctx, unsigned char *output, size_t len) {
+  (void)ctx;
+  std::lock_guard<std::mutex> guard(random_lock);
+
+  if (!random_ready) {
+    int ret = seed_locked();
+    if (ret != 0) {
+      return ret;
+    }
+  }
+
+  return mbedtls_ctr_drbg_random(&drbg_ctx, output, len);
+}
+
+/**
+ * \brief           Force a reseed from the entropy pool, e.g. after waking from deep sleep.
+ * 
+ * \return int      0 on success, otherwise the mbedtls error code. 
+ */
+int ssl_random_reseed(void) {
+  std::lock_guard<std::mutex> guard(random_lock);
+
+  if (!random_ready) {
+    return seed_locked();
+  }
+
+  int ret = mbedtls_ctr_drbg_reseed(&drbg_ctx, NULL, 0);
+  if (ret == 0) {
+    random_seeds++;
+  }
+  return ret;
+}
+
+/**
+ * \brief           Number of times the DRBG has been seeded or reseeded explicitly.
+ * 
+ * \return uint32_t The seed count. 
+ */
+uint32_t ssl_random_seed_count(void) {
+  std::lock_guard<std::mutex> guard(random_lock);
+  return random_seeds;
+}
+
+/**
+ * \brief           Release the shared DRBG. Only call this once no connection is using it.
+ */
+void ssl_random_free(void) {
+  std::lock_guard<std::mutex> guard(random_lock);
+  free_locked();
+}
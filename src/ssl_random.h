@@ -0,0 +1,30 @@
+/* Process-wide CTR-DRBG shared by every SSLClient connection.
+ *
+ * The DRBG is seeded once, on first use, instead of once per connection.
+ * Access is serialised so that connections driven from different tasks can
+ * share it safely.
+ */
+
+#ifndef SSL_RANDOM_H
+#define SSL_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+
+typedef struct ssl_random_config {
+  int reseed_interval;                          // DRBG requests between reseeds, 0 keeps the mbedtls default
+  bool prediction_resistance;                   // reseed before every request (slow, strongest)
+  mbedtls_entropy_f_source_ptr entropy_source;  // optional strong entropy source, e.g. a hardware RNG
+  void *entropy_source_data;                    // passed to entropy_source
+  size_t entropy_threshold;                     // bytes entropy_source must deliver before the pool is ready
+} ssl_random_config;
+
+int ssl_random_configure(const ssl_random_config *config);
+int ssl_random(void *ctx, unsigned char *output, size_t len);
+int ssl_random_reseed(void);
+uint32_t ssl_random_seed_count(void);
+void ssl_random_free(void);
+
+#endif
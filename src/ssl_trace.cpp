@@ -0,0 +1,149 @@
+/* Lock-free ring buffer behind the SSL_TRACE_* macros.
+ */
+
+#include "Arduino.h"
+#include <atomic>
+#include <string.h>
+#include "ssl_trace.h"
+
+static_assert((SSL_TRACE_BUFFER_EVENTS & (SSL_TRACE_BUFFER_EVENTS - 1)) == 0, "SSL_TRACE_BUFFER_EVENTS must be a power of two");
+static_assert(sizeof(ssl_trace_event) == 16, "trace events are dumped as 16 byte records");
+
+static ssl_trace_event trace_ring[SSL_TRACE_BUFFER_EVENTS];
+static std::atomic<uint32_t> trace_head(0);
+static std::atomic<uint32_t> trace_tail(0);
+
+/**
+ * \brief           Record an event. Safe to call from any task; a writer only reserves its
+ *                  slot with one atomic increment, so it never waits for another.
+ *
+ * \param id        uint16_t - The ssl_trace_id of the event.
+ * \param a         int32_t - First event argument.
+ * \param b         int32_t - Second event argument.
+ */
+void ssl_trace_write(uint16_t id, int32_t a, int32_t b) {
+  uint32_t index = trace_head.fetch_add(1, std::memory_order_relaxed);
+  ssl_trace_event *event = &trace_ring[index & (SSL_TRACE_BUFFER_EVENTS - 1)];
+
+  event->sequence = (uint16_t)(index - 1); // marks the slot as being rewritten
+  std::atomic_thread_fence(std::memory_order_release);
+  event->time_us = (uint32_t)SSL_TRACE_CLOCK();
+  event->id = id;
+  event->a = a;
+  event->b = b;
+  std::atomic_thread_fence(std::memory_order_release);
+  event->sequence = (uint16_t)index;
+}
+
+/**
+ * \brief           Copy the event with the given running number, unless it was overwritten or
+ *                  is still being written.
+ *
+ * \return bool     true if event holds a complete copy.
+ */
+static bool read_event(uint32_t index, ssl_trace_event *event) {
+  const ssl_trace_event *slot = &trace_ring[index & (SSL_TRACE_BUFFER_EVENTS - 1)];
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  memcpy(event, slot, sizeof(*event));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return event->sequence == (uint16_t)index && slot->sequence == (uint16_t)index;
+}
+
+/**
+ * \brief           Running number of the oldest event still in the buffer.
+ */
+static uint32_t oldest_event(uint32_t head) {
+  uint32_t tail = trace_tail.load(std::memory_order_relaxed);
+  uint32_t kept = head - tail;
+
+  if (kept > SSL_TRACE_BUFFER_EVENTS) {
+    return head - SSL_TRACE_BUFFER_EVENTS;
+  }
+  return tail;
+}
+
+/**
+ * \brief           Copy the buffered events, oldest first. Events overwritten while copying
+ *                  are skipped.
+ *
+ * \param events    ssl_trace_event* - Where to copy the events to.
+ * \param max       size_t - Room in events.
+ * \return size_t   The number of events copied.
+ */
+size_t ssl_trace_read(ssl_trace_event *events, size_t max) {
+  uint32_t head = trace_head.load(std::memory_order_acquire);
+  uint32_t index = oldest_event(head);
+  size_t count = 0;
+
+  if (head - index > max) {
+    index = head - (uint32_t)max; // keep the newest
+  }
+
+  for (; index != head && count < max; index++) {
+    if (read_event(index, &events[count])) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * \brief           Number of events recorded since start-up, including overwritten and
+ *                  cleared ones.
+ */
+uint32_t ssl_trace_total(void) {
+  return trace_head.load(std::memory_order_relaxed);
+}
+
+/**
+ * \brief           Forget the buffered events. Later reads and dumps only return events
+ *                  recorded after this call.
+ */
+void ssl_trace_clear(void) {
+  trace_tail.store(trace_head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+/**
+ * \brief           Write the buffered events in the dump format read by tools/decode_trace.py:
+ *                  a 12 byte header ("SSLT", version, event size, event count as uint16,
+ *                  total events recorded as uint32) followed by the events, oldest first.
+ *                  Events are copied one at a time, so no large buffer is needed.
+ *
+ * \param out       Print& - Where to write the dump, e.g. Serial.
+ * \return size_t   The number of bytes written.
+ */
+size_t ssl_trace_dump(Print &out) {
+  uint32_t head = trace_head.load(std::memory_order_acquire);
+  uint32_t first = oldest_event(head);
+  uint16_t count = 0;
+  uint8_t header[12];
+  ssl_trace_event event;
+
+  for (uint32_t index = first; index != head; index++) {
+    if (read_event(index, &event)) {
+      count++;
+    }
+  }
+
+  memcpy(header, SSL_TRACE_DUMP_MAGIC, 4);
+  header[4] = SSL_TRACE_DUMP_VERSION;
+  header[5] = (uint8_t)sizeof(ssl_trace_event);
+  memcpy(&header[6], &count, sizeof(count));
+  memcpy(&header[8], &head, sizeof(head));
+  size_t written = out.write(header, sizeof(header));
+
+  // Events recorded since counting push older ones out; write exactly count events
+  for (uint32_t index = first; index != head && count > 0; index++) {
+    if (read_event(index, &event)) {
+      written += out.write((const uint8_t *)&event, sizeof(event));
+      count--;
+    }
+  }
+  while (count > 0) {
+    memset(&event, 0, sizeof(event)); // lost while dumping, the decoder skips id 0
+    written += out.write((const uint8_t *)&event, sizeof(event));
+    count--;
+  }
+  return written;
+}
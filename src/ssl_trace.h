@@ -0,0 +1,92 @@
+/* Binary event trace for the I/O paths of ssl_client.
+ *
+ * Each event is 16 bytes: a micros() timestamp, an event id and two integers,
+ * written into a process-wide ring buffer without locks or formatting. The
+ * newest SSL_TRACE_BUFFER_EVENTS events are kept; ssl_trace_dump() writes them
+ * to any Print, e.g. Serial or a file, and tools/decode_trace.py turns the dump
+ * into readable lines on the host.
+ *
+ * SSL_TRACE_LEVEL selects at compile time which events are recorded. Events
+ * above the level compile to nothing, arguments included. The default,
+ * SSL_TRACE_LEVEL_NONE, records nothing.
+ */
+
+#ifndef SSL_TRACE_H
+#define SSL_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SSL_TRACE_LEVEL_NONE 0
+#define SSL_TRACE_LEVEL_ERROR 1    // errors returned by mbedtls or the transport
+#define SSL_TRACE_LEVEL_DEBUG 2    // handshake steps
+#define SSL_TRACE_LEVEL_VERBOSE 3  // every transport read and write, every send and receive
+
+#ifndef SSL_TRACE_LEVEL
+#define SSL_TRACE_LEVEL SSL_TRACE_LEVEL_NONE
+#endif
+
+#ifndef SSL_TRACE_BUFFER_EVENTS
+#define SSL_TRACE_BUFFER_EVENTS 256U // must be a power of two
+#endif
+
+#ifndef SSL_TRACE_CLOCK
+#define SSL_TRACE_CLOCK() micros()
+#endif
+
+#define SSL_TRACE_DUMP_MAGIC "SSLT"
+#define SSL_TRACE_DUMP_VERSION 1
+
+/**
+ * \brief Event ids. tools/decode_trace.py reads the names from this enum, so keep the
+ *        "SSL_TRACE_<NAME> = <id>," form and never reuse an id.
+ */
+typedef enum ssl_trace_id {
+  SSL_TRACE_ERROR = 1,              // a: error code, b: source line
+  SSL_TRACE_HANDSHAKE_STEP = 2,     // a: mbedtls_ssl_states after the step, b: result
+  SSL_TRACE_NET_RECV = 3,           // a: bytes read or error, b: bytes asked for
+  SSL_TRACE_NET_SEND = 4,           // a: bytes written or error, b: bytes offered
+  SSL_TRACE_SEND_BEGIN = 5,         // a: bytes to send
+  SSL_TRACE_SEND_END = 6,           // a: bytes sent or error, b: send retries so far
+  SSL_TRACE_RECEIVE_BEGIN = 7,      // a: buffer size
+  SSL_TRACE_RECEIVE_END = 8,        // a: bytes received or error
+} ssl_trace_id;
+
+/**
+ * \brief One recorded event, as stored and as dumped (little-endian on ESP32 and x86).
+ */
+typedef struct ssl_trace_event {
+  uint32_t time_us;   // SSL_TRACE_CLOCK() when recorded
+  uint16_t id;        // ssl_trace_id
+  uint16_t sequence;  // low bits of the running event number, to spot overwritten slots
+  int32_t a;
+  int32_t b;
+} ssl_trace_event;
+
+#if SSL_TRACE_LEVEL >= SSL_TRACE_LEVEL_ERROR
+#define SSL_TRACE_E(id, a, b) ssl_trace_write((id), (int32_t)(a), (int32_t)(b))
+#else
+#define SSL_TRACE_E(id, a, b) do {} while (0)
+#endif
+
+#if SSL_TRACE_LEVEL >= SSL_TRACE_LEVEL_DEBUG
+#define SSL_TRACE_D(id, a, b) ssl_trace_write((id), (int32_t)(a), (int32_t)(b))
+#else
+#define SSL_TRACE_D(id, a, b) do {} while (0)
+#endif
+
+#if SSL_TRACE_LEVEL >= SSL_TRACE_LEVEL_VERBOSE
+#define SSL_TRACE_V(id, a, b) ssl_trace_write((id), (int32_t)(a), (int32_t)(b))
+#else
+#define SSL_TRACE_V(id, a, b) do {} while (0)
+#endif
+
+class Print;
+
+void ssl_trace_write(uint16_t id, int32_t a, int32_t b);
+size_t ssl_trace_read(ssl_trace_event *events, size_t max);
+uint32_t ssl_trace_total(void);
+void ssl_trace_clear(void);
+size_t ssl_trace_dump(Print &out);
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef EMULATEDCLIENT_H
+#define EMULATEDCLIENT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+#include "Client.h"
+
+/**
+ * Shape of one network, in both directions. Bandwidths are in bits per second.
+ */
+struct EmulatedNetwork {
+  const char *name;
+  unsigned long latency_ms;    // one way
+  unsigned long jitter_ms;     // added to the latency, uniformly 0..jitter_ms
+  uint32_t uplink_bps;         // client to server
+  uint32_t downlink_bps;       // server to client
+  size_t mtu;                  // largest segment; each read() returns at most one
+  unsigned int loss_percent;   // segments that are lost once and retransmitted
+  unsigned long retransmit_ms; // extra delay of a retransmitted segment
+};
+
+// Networks the SSL_CLIENT_*_HANDSHAKE_TIMEOUT profiles are meant for.
+static const EmulatedNetwork EMULATED_LAN = { "lan", 1, 0, 100000000, 100000000, 1460, 0, 0 };
+static const EmulatedNetwork EMULATED_LTE = { "lte", 35, 10, 5000000, 20000000, 1400, 0, 200 };
+static const EmulatedNetwork EMULATED_3G = { "3g", 100, 40, 384000, 1000000, 1400, 1, 500 };
+static const EmulatedNetwork EMULATED_GPRS = { "gprs", 300, 100, 20000, 40000, 1400, 2, 1500 };
+static const EmulatedNetwork EMULATED_LOSSY_GPRS = { "lossy-gprs", 400, 300, 10000, 20000, 576, 10, 3000 };
+
+/**
+ * Time shared by both ends of an emulated link. Tests return now from millis() and
+ * advance it from delay(), so slow links cost no real time.
+ */
+struct EmulatedClock {
+  unsigned long now = 0;
+};
+
+/**
+ * One direction of an emulated link. Written bytes are cut into MTU sized segments, queued
+ * behind earlier ones at the link rate, and become readable one latency (plus jitter and any
+ * retransmission) after they left. Segments arrive in order, as on TCP.
+ */
+class EmulatedPath {
+public:
+  EmulatedPath(EmulatedClock &clock) : _clock(clock) {
+    configure(EMULATED_LAN, EMULATED_LAN.downlink_bps, 1);
+  }
+
+  void configure(const EmulatedNetwork &network, uint32_t bps, uint32_t seed) {
+    _network = network;
+    _bps = bps;
+    _random = seed != 0 ? seed : 1;
+    sendBuffer = 8192;
+    _busyUntil = 0;
+    _lastArrival = 0;
+    _stallFrom = 0;
+    _stallUntil = 0;
+    _segments.clear();
+  }
+
+  /**
+   * Hold back every segment that would arrive during [from, from + ms) until the window ends.
+   */
+  void stall(unsigned long from, unsigned long ms) {
+    _stallFrom = from;
+    _stallUntil = from + ms;
+  }
+
+  size_t push(const uint8_t *buf, size_t size) {
+    size_t room = sendBuffer > queued() ? sendBuffer - queued() : 0;
+    size_t accepted = size < room ? size : room;
+
+    for (size_t done = 0; done < accepted;) {
+      size_t len = accepted - done < _network.mtu ? accepted - done : _network.mtu;
+      _queue(&buf[done], len);
+      done += len;
+    }
+    return accepted;
+  }
+
+  /**
+   * Bytes written but not yet on the wire; they still take up the send buffer.
+   */
+  size_t queued() const {
+    size_t total = 0;
+    for (size_t i = 0; i < _segments.size(); i++) {
+      if (_segments[i].leaves > _clock.now) {
+        total += _segments[i].data.size() - _segments[i].pos;
+      }
+    }
+    return total;
+  }
+
+  size_t pending() const {
+    size_t total = 0;
+    for (size_t i = 0; i < _segments.size() && _segments[i].arrives <= _clock.now; i++) {
+      total += _segments[i].data.size() - _segments[i].pos;
+    }
+    return total;
+  }
+
+  /**
+   * Read from the first segment that has arrived, never across segments.
+   */
+  size_t pop(uint8_t *buf, size_t size) {
+    if (_segments.empty() || _segments.front().arrives > _clock.now) {
+      return 0;
+    }
+
+    Segment &segment = _segments.front();
+    size_t len = segment.data.size() - segment.pos;
+    if (len > size) {
+      len = size;
+    }
+    memcpy(buf, &segment.data[segment.pos], len);
+    segment.pos += len;
+    if (segment.pos == segment.data.size()) {
+      _segments.pop_front();
+    }
+    return len;
+  }
+
+  int peek() const {
+    if (_segments.empty() || _segments.front().arrives > _clock.now) {
+      return -1;
+    }
+    return _segments.front().data[_segments.front().pos];
+  }
+
+  /**
+   * Time at which everything written so far will have arrived.
+   */
+  unsigned long drainedAt() const {
+    return _segments.empty() ? _clock.now : _segments.back().arrives;
+  }
+
+  size_t sendBuffer; // bytes that may wait for the wire before write() takes less
+
+private:
+  struct Segment {
+    std::vector<uint8_t> data;
+    size_t pos;
+    unsigned long leaves;
+    unsigned long arrives;
+  };
+
+  uint32_t _next() {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+  }
+
+  void _queue(const uint8_t *buf, size_t len) {
+    Segment segment;
+    segment.data.assign(buf, buf + len);
+    segment.pos = 0;
+
+    unsigned long start = _busyUntil > _clock.now ? _busyUntil : _clock.now;
+    unsigned long wire = (unsigned long)(((uint64_t)len * 8 * 1000 + _bps - 1) / _bps);
+    segment.leaves = start + wire;
+    _busyUntil = segment.leaves;
+
+    unsigned long arrives = segment.leaves + _network.latency_ms;
+    if (_network.jitter_ms > 0) {
+      arrives += _next() % (_network.jitter_ms + 1);
+    }
+    if (_network.loss_percent > 0 && _next() % 100 < _network.loss_percent) {
+      arrives += _network.retransmit_ms;
+    }
+    if (arrives >= _stallFrom && arrives < _stallUntil) {
+      arrives = _stallUntil;
+    }
+    if (arrives < _lastArrival) {
+      arrives = _lastArrival; // in order, a late segment holds back the ones behind it
+    }
+    segment.arrives = arrives;
+    _lastArrival = arrives;
+    _segments.push_back(segment);
+  }
+
+  EmulatedClock &_clock;
+  EmulatedNetwork _network;
+  uint32_t _bps;
+  uint32_t _random;
+  unsigned long _busyUntil;
+  unsigned long _lastArrival;
+  unsigned long _stallFrom;
+  unsigned long _stallUntil;
+  std::deque<Segment> _segments;
+};
+
+/**
+ * One end of an emulated link.
+ */
+class EmulatedClient : public Client {
+public:
+  EmulatedClient(EmulatedClock &clock, EmulatedPath &rx, EmulatedPath &tx) : _clock(clock), _rx(rx), _tx(tx) {
+    _open = false;
+    dropAt = 0;
+    readCalls = 0;
+    writeCalls = 0;
+    bytesWritten = 0;
+  }
+
+  void open() { _open = true; }
+
+  int connect(IPAddress ip, uint16_t port) override {
+    _open = true;
+    return 1;
+  }
+
+  int connect(const char *host, uint16_t port) override {
+    _open = true;
+    return 1;
+  }
+
+  size_t write(uint8_t byte) override {
+    return write(&byte, 1);
+  }
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    writeCalls++;
+    if (!connected()) {
+      return 0;
+    }
+    size = _tx.push(buf, size);
+    bytesWritten += size;
+    return size;
+  }
+
+  int available() override {
+    return _dropped() ? 0 : (int)_rx.pending();
+  }
+
+  int read() override {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+  }
+
+  int read(uint8_t *buf, size_t size) override {
+    readCalls++;
+    if (_dropped()) {
+      return -1;
+    }
+    return (int)_rx.pop(buf, size);
+  }
+
+  int peek() override {
+    return _dropped() ? -1 : _rx.peek();
+  }
+
+  void flush() override {}
+
+  void stop() override {
+    _open = false;
+  }
+
+  uint8_t connected() override {
+    return _open && !_dropped();
+  }
+
+  operator bool() override {
+    return connected();
+  }
+
+  unsigned long dropAt; // virtual time at which the connection breaks, 0 for never
+  unsigned int readCalls;
+  unsigned int writeCalls;
+  size_t bytesWritten;
+
+private:
+  bool _dropped() const {
+    return dropAt != 0 && _clock.now >= dropAt;
+  }
+
+  EmulatedClock &_clock;
+  EmulatedPath &_rx;
+  EmulatedPath &_tx;
+  bool _open;
+};
+
+/**
+ * Both ends of an emulated connection over the given network.
+ */
+struct EmulatedLink {
+  EmulatedLink(const EmulatedNetwork &network, uint32_t seed = 1) : up(clock), down(clock) {
+    up.configure(network, network.uplink_bps, seed);
+    down.configure(network, network.downlink_bps, seed * 2654435761U);
+  }
+
+  EmulatedClock clock;
+  EmulatedPath up;
+  EmulatedPath down;
+  EmulatedClient client{clock, down, up};
+  EmulatedClient server{clock, up, down};
+};
+
+#endif // EMULATEDCLIENT_H
@@ -0,0 +1,185 @@
+#ifndef LOOPBACKCLIENT_H
+#define LOOPBACKCLIENT_H
+
+#include <stdint.h>
+#include <string.h>
+#include "Client.h"
+
+#define LOOPBACK_PIPE_SIZE 32768U
+
+/**
+ * One direction of an in-memory connection.
+ */
+struct LoopbackPipe {
+  uint8_t data[LOOPBACK_PIPE_SIZE];
+  size_t len = 0;
+  size_t pos = 0;
+
+  size_t pending() const { return len - pos; }
+
+  size_t push(const uint8_t *buf, size_t size) {
+    if (pos == len) {
+      pos = 0;
+      len = 0;
+    }
+    if (size > LOOPBACK_PIPE_SIZE - len) {
+      size = LOOPBACK_PIPE_SIZE - len;
+    }
+    memcpy(&data[len], buf, size);
+    len += size;
+    return size;
+  }
+
+  size_t pop(uint8_t *buf, size_t size) {
+    if (size > pending()) {
+      size = pending();
+    }
+    memcpy(buf, &data[pos], size);
+    pos += size;
+    return size;
+  }
+};
+
+/**
+ * One end of an in-memory connection. Counts transport calls and the TLS records it sends,
+ * by following the 5 byte record headers in its outgoing byte stream.
+ */
+class LoopbackClient : public Client {
+public:
+  LoopbackClient(LoopbackPipe &rx, LoopbackPipe &tx) : _rx(rx), _tx(tx) {
+    _open = false;
+    writeBudget = SIZE_MAX;
+    resetCounters();
+  }
+
+  void resetCounters() {
+    availableCalls = 0;
+    readCalls = 0;
+    writeCalls = 0;
+    connectedCalls = 0;
+    bytesWritten = 0;
+    largestWrite = 0;
+    recordsWritten = 0;
+    _headerLen = 0;
+    _recordLeft = 0;
+  }
+
+  void open() { _open = true; }
+  void hangUp() { _open = false; }
+
+  int connect(IPAddress ip, uint16_t port) override {
+    _open = true;
+    return 1;
+  }
+
+  int connect(const char *host, uint16_t port) override {
+    _open = true;
+    return 1;
+  }
+
+  size_t write(uint8_t byte) override {
+    return write(&byte, 1);
+  }
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    writeCalls++;
+    if (!_open) {
+      return 0;
+    }
+
+    if (size > writeBudget) {
+      size = writeBudget;
+    }
+    size = _tx.push(buf, size);
+    if (writeBudget != SIZE_MAX) {
+      writeBudget -= size;
+    }
+    _countRecords(buf, size);
+    bytesWritten += size;
+    if (size > largestWrite) {
+      largestWrite = size;
+    }
+    return size;
+  }
+
+  int available() override {
+    availableCalls++;
+    return (int)_rx.pending();
+  }
+
+  int read() override {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+  }
+
+  int read(uint8_t *buf, size_t size) override {
+    readCalls++;
+    return (int)_rx.pop(buf, size);
+  }
+
+  int peek() override {
+    return _rx.pending() > 0 ? _rx.data[_rx.pos] : -1;
+  }
+
+  void flush() override {}
+
+  void stop() override {
+    _open = false;
+  }
+
+  uint8_t connected() override {
+    connectedCalls++;
+    return _open || _rx.pending() > 0;
+  }
+
+  operator bool() override {
+    return _open;
+  }
+
+  unsigned int availableCalls;
+  unsigned int readCalls;
+  unsigned int writeCalls;
+  unsigned int connectedCalls;
+  size_t bytesWritten;
+  size_t largestWrite;
+  unsigned int recordsWritten;
+  size_t writeBudget; // bytes write() accepts before the send window stalls, SIZE_MAX for no limit
+
+private:
+  void _countRecords(const uint8_t *buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      if (_recordLeft > 0) {
+        size_t skip = size - i < _recordLeft ? size - i : _recordLeft;
+        _recordLeft -= skip;
+        i += skip - 1;
+        continue;
+      }
+
+      _header[_headerLen++] = buf[i];
+      if (_headerLen == sizeof(_header)) {
+        _recordLeft = ((size_t)_header[3] << 8) | _header[4];
+        _headerLen = 0;
+        recordsWritten++;
+      }
+    }
+  }
+
+  LoopbackPipe &_rx;
+  LoopbackPipe &_tx;
+  bool _open;
+  uint8_t _header[5];
+  size_t _headerLen;
+  size_t _recordLeft;
+};
+
+/**
+ * Both ends of an in-memory connection.
+ */
+struct LoopbackLink {
+  LoopbackPipe up;
+  LoopbackPipe down;
+  LoopbackClient client{down, up};
+  LoopbackClient server{up, down};
+};
+
+#endif // LOOPBACKCLIENT_H
@@ -0,0 +1,146 @@
+#ifndef SCRIPTEDCLIENT_H
+#define SCRIPTEDCLIENT_H
+
+#include <string.h>
+#include "Client.h"
+
+#define SCRIPTED_CLIENT_BUFFER_SIZE 8192U
+
+/**
+ * Transport that plays back bytes fed by the test and records what is written to it.
+ * Every call is counted so tests can check how often the TLS layer touches the transport.
+ */
+class ScriptedClient : public Client {
+public:
+  ScriptedClient() {
+    reset();
+  }
+
+  void reset() {
+    _inLen = 0;
+    _inPos = 0;
+    _outLen = 0;
+    _open = false;
+    connectResult = 1;
+    writeLimit = 0;
+    lastWrite = nullptr;
+    resetCounters();
+  }
+
+  void resetCounters() {
+    availableCalls = 0;
+    readCalls = 0;
+    writeCalls = 0;
+    bytesWritten = 0;
+  }
+
+  // Queue bytes the peer sends; returns false if they do not fit.
+  bool feed(const uint8_t *data, size_t len) {
+    if (len > SCRIPTED_CLIENT_BUFFER_SIZE - _inLen) {
+      return false;
+    }
+    memcpy(&_in[_inLen], data, len);
+    _inLen += len;
+    return true;
+  }
+
+  // The peer closes the connection; bytes already queued can still be read.
+  void hangUp() {
+    _open = false;
+  }
+
+  const uint8_t *sent() const { return _out; }
+  size_t sentLength() const { return _outLen; }
+
+  int connect(IPAddress ip, uint16_t port) override {
+    _open = connectResult == 1;
+    return connectResult;
+  }
+
+  int connect(const char *host, uint16_t port) override {
+    _open = connectResult == 1;
+    return connectResult;
+  }
+
+  size_t write(uint8_t byte) override {
+    return write(&byte, 1);
+  }
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    writeCalls++;
+    lastWrite = buf;
+    if (!_open) {
+      return 0;
+    }
+
+    if (writeLimit > 0 && size > writeLimit) {
+      size = writeLimit;
+    }
+
+    size_t keep = size;
+    if (keep > SCRIPTED_CLIENT_BUFFER_SIZE - _outLen) {
+      keep = SCRIPTED_CLIENT_BUFFER_SIZE - _outLen;
+    }
+    memcpy(&_out[_outLen], buf, keep);
+    _outLen += keep;
+    bytesWritten += size;
+    return size;
+  }
+
+  int available() override {
+    availableCalls++;
+    return (int)(_inLen - _inPos);
+  }
+
+  int read() override {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+  }
+
+  int read(uint8_t *buf, size_t size) override {
+    readCalls++;
+    size_t len = _inLen - _inPos;
+    if (len > size) {
+      len = size;
+    }
+    memcpy(buf, &_in[_inPos], len);
+    _inPos += len;
+    return (int)len;
+  }
+
+  int peek() override {
+    return _inPos < _inLen ? _in[_inPos] : -1;
+  }
+
+  void flush() override {}
+
+  void stop() override {
+    _open = false;
+  }
+
+  uint8_t connected() override {
+    return _open || _inPos < _inLen;
+  }
+
+  operator bool() override {
+    return connected();
+  }
+
+  int connectResult;
+  size_t writeLimit; // most bytes taken per write(), 0 for no limit
+  const uint8_t *lastWrite;
+  unsigned int availableCalls;
+  unsigned int readCalls;
+  unsigned int writeCalls;
+  size_t bytesWritten;
+
+private:
+  uint8_t _in[SCRIPTED_CLIENT_BUFFER_SIZE];
+  uint8_t _out[SCRIPTED_CLIENT_BUFFER_SIZE];
+  size_t _inLen;
+  size_t _inPos;
+  size_t _outLen;
+  bool _open;
+};
+
+#endif // SCRIPTEDCLIENT_H
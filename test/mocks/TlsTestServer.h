@@ -0,0 +1,175 @@
+#ifndef TLSTESTSERVER_H
+#define TLSTESTSERVER_H
+
+#include <string.h>
+#include "Client.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "ssl_random.h"
+
+#define TLS_TEST_SERVER_BUFFER_SIZE 16384U
+
+/**
+ * In-process mbedtls server for native tests. It is pumped from the test loop, so client
+ * and server run on one thread over a LoopbackLink without sockets or timers.
+ */
+class TlsTestServer {
+public:
+  TlsTestServer(Client &transport) : _transport(transport) {
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_config_init(&_conf);
+    mbedtls_x509_crt_init(&_cert);
+    mbedtls_pk_init(&_key);
+    mbedtls_ssl_cache_init(&_cache);
+    _cacheSessions = false;
+    received = 0;
+    recordsRead = 0;
+  }
+
+  ~TlsTestServer() {
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_x509_crt_free(&_cert);
+    mbedtls_pk_free(&_key);
+    mbedtls_ssl_cache_free(&_cache);
+  }
+
+  /**
+   * Keep sessions in an mbedtls server cache so clients can resume them. Call before begin*().
+   */
+  void enableSessionCache() {
+    _cacheSessions = true;
+  }
+
+  int beginPsk(const char *identity, const uint8_t *psk, size_t pskLen) {
+    int ret = _configure();
+    if (ret != 0) {
+      return ret;
+    }
+
+    ret = mbedtls_ssl_conf_psk(&_conf, psk, pskLen, (const unsigned char *)identity, strlen(identity));
+    if (ret != 0) {
+      return ret;
+    }
+    return _setup();
+  }
+
+  /**
+   * Serve with a certificate and its private key, both PEM. The key type (RSA or EC) decides
+   * which ciphersuites the server accepts.
+   */
+  int beginCertificate(const char *certPem, const char *keyPem) {
+    int ret = _configure();
+    if (ret != 0) {
+      return ret;
+    }
+
+    ret = mbedtls_x509_crt_parse(&_cert, (const unsigned char *)certPem, strlen(certPem) + 1);
+    if (ret != 0) {
+      return ret;
+    }
+
+    ret = mbedtls_pk_parse_key(&_key, (const unsigned char *)keyPem, strlen(keyPem) + 1, NULL, 0);
+    if (ret != 0) {
+      return ret;
+    }
+
+    ret = mbedtls_ssl_conf_own_cert(&_conf, &_cert, &_key);
+    if (ret != 0) {
+      return ret;
+    }
+    return _setup();
+  }
+
+  /**
+   * Get ready for the next connection with the same configuration. The caller empties the
+   * transport.
+   */
+  int reset() {
+    received = 0;
+    recordsRead = 0;
+    return mbedtls_ssl_session_reset(&_ssl);
+  }
+
+  /**
+   * Advance the handshake or read whatever application data has arrived.
+   * Returns 0 if there is nothing to do right now, a negative mbedtls error otherwise.
+   */
+  int step() {
+    int ret = 0;
+
+    if (_ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+      ret = mbedtls_ssl_handshake_step(&_ssl);
+    } else {
+      ret = mbedtls_ssl_read(&_ssl, &data[received % TLS_TEST_SERVER_BUFFER_SIZE], TLS_TEST_SERVER_BUFFER_SIZE - received % TLS_TEST_SERVER_BUFFER_SIZE);
+      if (ret > 0) {
+        received += ret;
+        recordsRead++;
+        ret = 0;
+      }
+    }
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      return 0;
+    }
+    return ret;
+  }
+
+  int send(const uint8_t *buf, size_t len) {
+    return mbedtls_ssl_write(&_ssl, buf, len);
+  }
+
+  bool handshakeDone() const {
+    return _ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER;
+  }
+
+  uint8_t data[TLS_TEST_SERVER_BUFFER_SIZE];
+  size_t received;
+  unsigned int recordsRead;
+
+private:
+  int _configure() {
+    int ret = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+      return ret;
+    }
+
+    mbedtls_ssl_conf_rng(&_conf, ssl_random, NULL);
+    if (_cacheSessions) {
+      mbedtls_ssl_conf_session_cache(&_conf, &_cache, mbedtls_ssl_cache_get, mbedtls_ssl_cache_set);
+    }
+    return 0;
+  }
+
+  int _setup() {
+    int ret = mbedtls_ssl_setup(&_ssl, &_conf);
+    if (ret != 0) {
+      return ret;
+    }
+
+    mbedtls_ssl_set_bio(&_ssl, &_transport, _send, _recv, NULL);
+    return 0;
+  }
+
+  static int _send(void *ctx, const unsigned char *buf, size_t len) {
+    size_t written = ((Client *)ctx)->write(buf, len);
+    return written > 0 ? (int)written : MBEDTLS_ERR_SSL_WANT_WRITE;
+  }
+
+  static int _recv(void *ctx, unsigned char *buf, size_t len) {
+    int result = ((Client *)ctx)->read(buf, len);
+    return result > 0 ? result : MBEDTLS_ERR_SSL_WANT_READ;
+  }
+
+  Client &_transport;
+  mbedtls_ssl_context _ssl;
+  mbedtls_ssl_config _conf;
+  mbedtls_x509_crt _cert;
+  mbedtls_pk_context _key;
+  mbedtls_ssl_cache_context _cache;
+  bool _cacheSessions;
+};
+
+#endif // TLSTESTSERVER_H
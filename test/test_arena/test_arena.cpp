@@ -0,0 +1,299 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "mbedtls/platform.h"
+
+// Heap blocks mbedtls holds outside any arena; the dispatcher falls back to these.
+static long heapBlocks = 0;
+
+static void *countingCalloc(size_t n, size_t size) {
+  void *ptr = calloc(n, size);
+  heapBlocks += ptr != NULL ? 1 : 0;
+  return ptr;
+}
+
+static void countingFree(void *ptr) {
+  heapBlocks -= ptr != NULL ? 1 : 0;
+  free(ptr);
+}
+
+#undef MBEDTLS_PLATFORM_STD_CALLOC
+#undef MBEDTLS_PLATFORM_STD_FREE
+#define MBEDTLS_PLATFORM_STD_CALLOC countingCalloc
+#define MBEDTLS_PLATFORM_STD_FREE countingFree
+
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+#define SOAK_CYCLES 10000
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+SSLArena *arena = nullptr;
+alignas(SSL_ARENA_ALIGN) uint8_t arenaBuffer[64 * 1024];
+uint8_t payload[256];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  arena = new SSLArena();
+  TEST_ASSERT_TRUE(arena->begin(arenaBuffer, sizeof(arenaBuffer)));
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 3);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+  TEST_ASSERT_TRUE(arena->end());
+  delete arena;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+static void restartServer(void) {
+  delete server;
+  loopback->up.len = 0;
+  loopback->up.pos = 0;
+  loopback->down.len = 0;
+  loopback->down.pos = 0;
+  server = new TlsTestServer(loopback->server);
+}
+
+static void printStats(const char *label, const ssl_arena_stats &stats) {
+  printf("%s: size %zu, used %zu, peak %zu, largest free %zu in %zu blocks, fragmentation %u%%, failures %u\n",
+         label, stats.size, stats.used, stats.peak, stats.largest_free, stats.free_blocks,
+         (unsigned int)stats.fragmentation, (unsigned int)stats.failures);
+}
+
+void test_allocations_are_aligned_and_zeroed(void) {
+  // Arrange
+  memset(arenaBuffer, 0xa5, sizeof(arenaBuffer));
+  TEST_ASSERT_TRUE(arena->end());
+  TEST_ASSERT_TRUE(arena->begin(arenaBuffer, sizeof(arenaBuffer)));
+
+  // Act
+  uint8_t *first = (uint8_t *)arena->allocate(3);
+  uint8_t *second = (uint8_t *)arena->allocate(100);
+
+  // Assert
+  TEST_ASSERT_NOT_NULL(first);
+  TEST_ASSERT_NOT_NULL(second);
+  TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)first % SSL_ARENA_ALIGN);
+  TEST_ASSERT_EQUAL_UINT(0, (uintptr_t)second % SSL_ARENA_ALIGN);
+  TEST_ASSERT_EACH_EQUAL_UINT8(0, second, 100);
+  TEST_ASSERT_EQUAL_UINT(2, arena->stats().allocations);
+  arena->release(first);
+  arena->release(second);
+}
+
+void test_release_coalesces_free_blocks(void) {
+  // Arrange
+  void *a = arena->allocate(1000);
+  void *b = arena->allocate(1000);
+  void *c = arena->allocate(1000);
+
+  // Act
+  arena->release(a);
+  arena->release(c);
+  ssl_arena_stats holes = arena->stats();
+  arena->release(b);
+  ssl_arena_stats merged = arena->stats();
+
+  // Assert
+  printStats("with a hole", holes);
+  TEST_ASSERT_EQUAL_UINT(2, holes.free_blocks);
+  TEST_ASSERT_GREATER_THAN_UINT(0, holes.fragmentation);
+  TEST_ASSERT_EQUAL_UINT(1, merged.free_blocks);
+  TEST_ASSERT_EQUAL_UINT(0, merged.fragmentation);
+  TEST_ASSERT_EQUAL_UINT(merged.size, merged.largest_free);
+  TEST_ASSERT_EQUAL_UINT(0, merged.used);
+}
+
+void test_freed_block_is_reused(void) {
+  // Arrange
+  void *a = arena->allocate(2000);
+  void *b = arena->allocate(16);
+  arena->release(a);
+
+  // Act
+  void *again = arena->allocate(1500);
+
+  // Assert
+  TEST_ASSERT_EQUAL_PTR(a, again);
+  arena->release(again);
+  arena->release(b);
+}
+
+void test_exhaustion_is_reported(void) {
+  // Arrange
+  void *most = arena->allocate(sizeof(arenaBuffer) - 1024);
+  TEST_ASSERT_NOT_NULL(most);
+
+  // Act
+  void *more = arena->allocate(2048);
+  ssl_arena_stats stats = arena->stats();
+
+  // Assert
+  TEST_ASSERT_NULL(more);
+  TEST_ASSERT_EQUAL_UINT(1, stats.failures);
+  TEST_ASSERT_EQUAL_UINT(1, stats.allocations);
+  arena->release(most);
+}
+
+void test_end_is_refused_while_in_use(void) {
+  // Arrange
+  void *block = arena->allocate(64);
+
+  // Act
+  bool ended = arena->end();
+
+  // Assert
+  TEST_ASSERT_FALSE(ended);
+  TEST_ASSERT_TRUE(arena->ready());
+  arena->release(block);
+}
+
+void test_frees_are_routed_by_address(void) {
+  // Arrange
+  void *fromHeap = mbedtls_calloc(1, 64);
+  void *fromArena = NULL;
+  {
+    SSLArenaScope scope(arena);
+    fromArena = mbedtls_calloc(1, 64);
+  }
+
+  // Act
+  mbedtls_free(fromArena);
+  mbedtls_free(fromHeap);
+
+  // Assert
+  TEST_ASSERT_FALSE(arena->contains(fromHeap));
+  TEST_ASSERT_TRUE(arena->contains(fromArena));
+  TEST_ASSERT_EQUAL_UINT(0, arena->stats().allocations);
+  TEST_ASSERT_EQUAL_UINT(64 + SSL_ARENA_ALIGN, arena->stats().peak);
+}
+
+void test_connection_is_served_from_arena(void) {
+  // Arrange
+  client->setArena(arena);
+
+  // Act
+  connectOverLoopback();
+  size_t written = client->write(payload, sizeof(payload));
+  ssl_arena_stats connected = arena->stats();
+  client->stop();
+  ssl_arena_stats stopped = arena->stats();
+
+  // Assert
+  printStats("connected", connected);
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), written);
+  TEST_ASSERT_GREATER_THAN_UINT(0, connected.allocations);
+  TEST_ASSERT_EQUAL_UINT(0, connected.failures);
+  TEST_ASSERT_EQUAL_UINT(0, stopped.used);
+  TEST_ASSERT_EQUAL_UINT(0, stopped.fragmentation);
+}
+
+void test_connect_stop_soak(void) {
+  // Arrange
+  client->setArena(arena);
+  size_t peak = 0;
+  long heap = 0;
+
+  // Act
+  for (int i = 0; i < SOAK_CYCLES; i++) {
+    connectOverLoopback();
+    TEST_ASSERT_EQUAL_UINT(sizeof(payload), client->write(payload, sizeof(payload)));
+    client->stop();
+    restartServer();
+
+    ssl_arena_stats stats = arena->stats();
+    TEST_ASSERT_EQUAL_UINT(0, stats.used);
+    TEST_ASSERT_EQUAL_UINT(0, stats.failures);
+    TEST_ASSERT_EQUAL_UINT(0, stats.fragmentation);
+    if (i == 0) {
+      peak = stats.peak;
+      heap = heapBlocks;
+    }
+    TEST_ASSERT_EQUAL_INT32(heap, heapBlocks);
+  }
+
+  // Assert
+  ssl_arena_stats stats = arena->stats();
+  printStats("after soak", stats);
+  printf("heap blocks held by mbedtls after soak: %ld\n", heapBlocks);
+  TEST_ASSERT_EQUAL_UINT(peak, stats.peak);
+  TEST_ASSERT_EQUAL_INT32(heap, heapBlocks);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_allocations_are_aligned_and_zeroed);
+  RUN_TEST(test_release_coalesces_free_blocks);
+  RUN_TEST(test_freed_block_is_reused);
+  RUN_TEST(test_exhaustion_is_reported);
+  RUN_TEST(test_end_is_refused_while_in_use);
+  RUN_TEST(test_frees_are_routed_by_address);
+  RUN_TEST(test_connection_is_served_from_arena);
+  RUN_TEST(test_connect_stop_soak);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,181 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/ScriptedClient.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+
+using namespace fakeit;
+
+ScriptedClient scriptedClient;
+sslclient_context *testContext = nullptr;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  scriptedClient.reset();
+  testContext = new sslclient_context;
+  ssl_init(testContext, &scriptedClient);
+  testContext->settings.handshake_timeout = 5000;
+}
+
+void tearDown(void) {
+  stop_ssl_socket(testContext, NULL, NULL, NULL);
+  delete testContext;
+}
+
+void test_begin_sends_nothing_until_polled(void) {
+  // Act
+  int ret = begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, ret);
+  TEST_ASSERT_TRUE(ssl_client_is_set_up(testContext));
+  TEST_ASSERT_EQUAL_UINT(0, scriptedClient.sentLength());
+}
+
+void test_begin_fails_when_transport_does_not_connect(void) {
+  // Arrange
+  scriptedClient.connectResult = 0;
+
+  // Act
+  int ret = begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-2, ret);
+}
+
+void test_first_poll_sends_client_hello(void) {
+  // Arrange
+  begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+
+  // Act
+  int status = poll_ssl_handshake(testContext, "example.com", 443);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_IN_PROGRESS, status);
+  TEST_ASSERT_GREATER_THAN_UINT(5, scriptedClient.sentLength());
+  TEST_ASSERT_EQUAL_HEX8(0x16, scriptedClient.sent()[0]); // handshake record
+  TEST_ASSERT_EQUAL_HEX8(0x01, scriptedClient.sent()[5]); // ClientHello
+}
+
+void test_idle_poll_does_not_read_transport(void) {
+  // Arrange
+  begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+  poll_ssl_handshake(testContext, "example.com", 443);
+  scriptedClient.resetCounters();
+
+  // Act
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 10; i++) {
+    status = poll_ssl_handshake(testContext, "example.com", 443);
+  }
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_IN_PROGRESS, status);
+  TEST_ASSERT_EQUAL_UINT(10, scriptedClient.availableCalls);
+  TEST_ASSERT_EQUAL_UINT(0, scriptedClient.readCalls);
+  TEST_ASSERT_EQUAL_UINT(0, scriptedClient.writeCalls);
+}
+
+void test_partial_record_keeps_handshake_in_progress(void) {
+  // Arrange
+  const uint8_t header[] = { 0x16, 0x03, 0x03, 0x00, 0x40 }; // ServerHello record, body still in flight
+  begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+  poll_ssl_handshake(testContext, "example.com", 443);
+  scriptedClient.feed(header, sizeof(header));
+
+  // Act
+  int status = poll_ssl_handshake(testContext, "example.com", 443);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_IN_PROGRESS, status);
+}
+
+void test_garbage_from_peer_is_an_error(void) {
+  // Arrange
+  const char *reply = "HTTP/1.1 400 Bad Request\r\n\r\n";
+  begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+  poll_ssl_handshake(testContext, "example.com", 443);
+  scriptedClient.feed((const uint8_t *)reply, strlen(reply));
+
+  // Act
+  int status = poll_ssl_handshake(testContext, "example.com", 443);
+
+  // Assert
+  TEST_ASSERT_LESS_THAN_INT(0, status);
+}
+
+void test_peer_hang_up_is_an_error(void) {
+  // Arrange
+  begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+  poll_ssl_handshake(testContext, "example.com", 443);
+  scriptedClient.hangUp();
+
+  // Act
+  int status = poll_ssl_handshake(testContext, "example.com", 443);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_NET_CONN_RESET, status);
+}
+
+void test_poll_times_out(void) {
+  // Arrange
+  begin_ssl_client(testContext, "example.com", 443, NULL, NULL, NULL, NULL, NULL);
+  poll_ssl_handshake(testContext, "example.com", 443);
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(5001);
+
+  // Act
+  int status = poll_ssl_handshake(testContext, "example.com", 443);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_TIMEOUT, status);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_sends_nothing_until_polled);
+  RUN_TEST(test_begin_fails_when_transport_does_not_connect);
+  RUN_TEST(test_first_poll_sends_client_hello);
+  RUN_TEST(test_idle_poll_does_not_read_transport);
+  RUN_TEST(test_partial_record_keeps_handshake_in_progress);
+  RUN_TEST(test_garbage_from_peer_is_an_error);
+  RUN_TEST(test_peer_hang_up_is_an_error);
+  RUN_TEST(test_poll_times_out);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,345 @@
+// Throughput and latency of SSLClient against the in-process TlsTestServer. Results are printed
+// as "BENCH {json}" lines; tools/compare_benchmarks.py compares two runs. Run with
+//   pio test -e native_benchmark
+#define log_d(...); // per-call debug output would dominate the timings
+#define log_i(...);
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...);
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "../mocks/TestCertificates.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace fakeit;
+
+#define BULK_BYTES (512U * 1024U)
+#define LATENCY_SAMPLES 2000
+#define LATENCY_MESSAGE_SIZE 32
+
+typedef std::chrono::steady_clock::time_point Instant;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+static const size_t writeSizes[] = { 64, 256, 1024, 4096, 16384 };
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+unsigned long virtualNow = 0;
+uint8_t payload[16384];
+uint8_t received[16384];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  // every call moves the clock on, so no wait loop can spin forever
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return virtualNow++; });
+  When(Method(ArduinoFake(), delay)).AlwaysDo([](unsigned long ms) { virtualNow += ms; });
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 7);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static double secondsSince(Instant start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *benchmark, const char *variant, const char *metric, double value) {
+  printf("BENCH {\"benchmark\":\"%s\",\"variant\":\"%s\",\"metric\":\"%s\",\"value\":%.3f}\n",
+         benchmark, variant, metric, value);
+}
+
+/**
+ * Run one handshake. Returns the seconds spent in the client, leaving out the server.
+ */
+static double connectOverLoopback(void) {
+  loopback->server.open();
+  Instant mark = std::chrono::steady_clock::now();
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+  double clientSeconds = secondsSince(mark);
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    mark = std::chrono::steady_clock::now();
+    status = client->poll();
+    clientSeconds += secondsSince(mark);
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  return clientSeconds;
+}
+
+static void disconnect(void) {
+  client->stop();
+  loopback->up.len = 0;
+  loopback->up.pos = 0;
+  loopback->down.len = 0;
+  loopback->down.pos = 0;
+  TEST_ASSERT_EQUAL_INT(0, server->reset());
+}
+
+static void benchmarkHandshakes(const char *variant, int rounds) {
+  double clientSeconds = 0;
+  Instant start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < rounds; i++) {
+    clientSeconds += connectOverLoopback();
+    disconnect();
+  }
+
+  double seconds = secondsSince(start);
+  report("handshake", variant, "handshakes_per_s", rounds / seconds);
+  report("handshake", variant, "client_ms", clientSeconds * 1e3 / rounds);
+}
+
+static void serverReceive(size_t expected) {
+  for (int i = 0; i < 100 && server->received < expected; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+  }
+  TEST_ASSERT_EQUAL_UINT(expected, server->received);
+}
+
+static void serverSend(const uint8_t *buf, size_t len) {
+  size_t sent = 0;
+  for (int i = 0; i < 100 && sent < len; i++) {
+    int ret = server->send(&buf[sent], len - sent);
+    TEST_ASSERT_GREATER_THAN_INT(0, ret);
+    sent += ret;
+  }
+  TEST_ASSERT_EQUAL_UINT(len, sent);
+}
+
+/**
+ * Write all of buf; write() stops after one record when a record is shorter than len.
+ * Returns the seconds spent in the client.
+ */
+static double clientSend(const uint8_t *buf, size_t len) {
+  size_t sent = 0;
+  Instant mark = std::chrono::steady_clock::now();
+  for (int i = 0; i < 100 && sent < len; i++) {
+    sent += client->write(&buf[sent], len - sent);
+  }
+  double seconds = secondsSince(mark);
+  TEST_ASSERT_EQUAL_UINT(len, sent);
+  return seconds;
+}
+
+/**
+ * Read exactly len bytes. Returns the seconds spent in the client.
+ */
+static double clientReceive(uint8_t *buf, size_t len) {
+  size_t got = 0;
+  Instant mark = std::chrono::steady_clock::now();
+  for (int i = 0; i < 1000 && got < len; i++) {
+    int ret = client->read(&buf[got], len - got);
+    if (ret > 0) {
+      got += ret;
+    }
+  }
+  double seconds = secondsSince(mark);
+  TEST_ASSERT_EQUAL_UINT(len, got);
+  return seconds;
+}
+
+static void reportThroughput(const char *direction, size_t writeSize, double clientSeconds, double seconds) {
+  char variant[32];
+  snprintf(variant, sizeof(variant), "psk-%zu", writeSize);
+  report(direction, variant, "client_mb_per_s", BULK_BYTES / clientSeconds / 1e6);
+  report(direction, variant, "pair_mb_per_s", BULK_BYTES / seconds / 1e6);
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction) {
+  size_t index = (size_t)(fraction * sorted.size());
+  return sorted[index < sorted.size() ? index : sorted.size() - 1];
+}
+
+void test_handshake_psk(void) {
+  // Arrange
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+
+  // Act & Assert
+  benchmarkHandshakes("psk", 200);
+}
+
+void test_handshake_ecdsa_p256(void) {
+  // Arrange
+  TEST_ASSERT_EQUAL_INT(0, server->beginCertificate(ecCert, ecKey));
+  client->setCACert(ecCert);
+
+  // Act & Assert
+  benchmarkHandshakes("ecdsa-p256", 50);
+}
+
+void test_handshake_rsa_2048(void) {
+  // Arrange
+  TEST_ASSERT_EQUAL_INT(0, server->beginCertificate(rsaCert, rsaKey));
+  client->setCACert(rsaCert);
+
+  // Act & Assert
+  benchmarkHandshakes("rsa-2048", 50);
+}
+
+void test_handshake_shared_credentials(void) {
+  // Arrange
+  SSLCredentials credentials;
+  TEST_ASSERT_EQUAL_INT(0, credentials.setCACert(ecCert));
+  TEST_ASSERT_EQUAL_INT(0, server->beginCertificate(ecCert, ecKey));
+  client->setCredentials(&credentials);
+
+  // Act & Assert
+  benchmarkHandshakes("ecdsa-p256-credentials", 50);
+}
+
+void test_handshake_resumed(void) {
+  // Arrange
+  SSLSessionMemoryStore store;
+  SSLSessionCache cache(store);
+  server->enableSessionCache();
+  TEST_ASSERT_EQUAL_INT(0, server->beginCertificate(ecCert, ecKey));
+  client->setCACert(ecCert);
+  client->setSessionCache(&cache);
+  (void)connectOverLoopback();
+  disconnect();
+
+  // Act
+  benchmarkHandshakes("ecdsa-p256-resumed", 50);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(50, client->getCounters().resumed_handshakes);
+}
+
+void test_bulk_upload(void) {
+  // Arrange
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  (void)connectOverLoopback();
+
+  for (size_t s = 0; s < sizeof(writeSizes) / sizeof(writeSizes[0]); s++) {
+    size_t base = server->received;
+    size_t sent = 0;
+    double clientSeconds = 0;
+    Instant start = std::chrono::steady_clock::now();
+
+    // Act
+    while (sent < BULK_BYTES) {
+      clientSeconds += clientSend(payload, writeSizes[s]);
+      sent += writeSizes[s];
+      serverReceive(base + sent);
+    }
+
+    // Assert
+    reportThroughput("upload", writeSizes[s], clientSeconds, secondsSince(start));
+  }
+}
+
+void test_bulk_download(void) {
+  // Arrange
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  (void)connectOverLoopback();
+
+  for (size_t s = 0; s < sizeof(writeSizes) / sizeof(writeSizes[0]); s++) {
+    size_t got = 0;
+    double clientSeconds = 0;
+    Instant start = std::chrono::steady_clock::now();
+
+    // Act
+    while (got < BULK_BYTES) {
+      serverSend(payload, writeSizes[s]);
+      clientSeconds += clientReceive(received, writeSizes[s]);
+      got += writeSizes[s];
+    }
+
+    // Assert
+    TEST_ASSERT_EQUAL_MEMORY(payload, received, writeSizes[s]);
+    reportThroughput("download", writeSizes[s], clientSeconds, secondsSince(start));
+  }
+}
+
+void test_small_message_latency(void) {
+  // Arrange
+  std::vector<double> samples;
+  samples.reserve(LATENCY_SAMPLES);
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  (void)connectOverLoopback();
+  size_t base = server->received;
+
+  // Act
+  for (int i = 0; i < LATENCY_SAMPLES; i++) {
+    Instant start = std::chrono::steady_clock::now();
+    (void)clientSend(payload, LATENCY_MESSAGE_SIZE);
+    serverReceive(base + (i + 1) * LATENCY_MESSAGE_SIZE);
+    serverSend(payload, LATENCY_MESSAGE_SIZE);
+    (void)clientReceive(received, LATENCY_MESSAGE_SIZE);
+    samples.push_back(secondsSince(start) * 1e6);
+  }
+
+  // Assert
+  std::sort(samples.begin(), samples.end());
+  report("round_trip", "psk-32", "p50_us", percentile(samples, 0.50));
+  report("round_trip", "psk-32", "p90_us", percentile(samples, 0.90));
+  report("round_trip", "psk-32", "p99_us", percentile(samples, 0.99));
+  report("round_trip", "psk-32", "max_us", samples.back());
+  TEST_ASSERT_EQUAL_MEMORY(payload, received, LATENCY_MESSAGE_SIZE);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_handshake_psk);
+  RUN_TEST(test_handshake_ecdsa_p256);
+  RUN_TEST(test_handshake_rsa_2048);
+  RUN_TEST(test_handshake_shared_credentials);
+  RUN_TEST(test_handshake_resumed);
+  RUN_TEST(test_bulk_upload);
+  RUN_TEST(test_bulk_download);
+  RUN_TEST(test_small_message_latency);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
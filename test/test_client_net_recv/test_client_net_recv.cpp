@@ -0,0 +1,213 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/ScriptedClient.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+
+using namespace fakeit;
+
+// Slow transport: a record that arrives at a given virtual time.
+ScriptedClient scriptedClient;
+sslclient_context testContext;
+unsigned long virtualNow = 0;
+unsigned int delayCalls = 0;
+unsigned int hookCalls = 0;
+unsigned long arrivalTime = 0;
+bool arrivalPending = false;
+const uint8_t arrivalData[] = { 0x17, 0x03, 0x03, 0x00, 0x20 };
+
+static void deliverIfDue() {
+  if (arrivalPending && virtualNow >= arrivalTime) {
+    scriptedClient.feed(arrivalData, sizeof(arrivalData));
+    arrivalPending = false;
+  }
+}
+
+static void scheduleArrival(unsigned long at) {
+  arrivalTime = at;
+  arrivalPending = true;
+}
+
+static bool readyHook(void *arg, uint32_t timeout_ms) {
+  hookCalls++;
+  if (arrivalPending && arrivalTime <= virtualNow + timeout_ms) {
+    virtualNow = arrivalTime > virtualNow ? arrivalTime : virtualNow;
+  } else {
+    virtualNow += timeout_ms;
+  }
+  deliverIfDue();
+  return !arrivalPending;
+}
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  delayCalls = 0;
+  hookCalls = 0;
+  arrivalPending = false;
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return virtualNow; });
+  When(Method(ArduinoFake(), delay)).AlwaysDo([](unsigned long ms) {
+    delayCalls++;
+    virtualNow += ms;
+    deliverIfDue();
+  });
+  scriptedClient.reset();
+  scriptedClient.connect("example.com", 443);
+  ssl_init(&testContext, &scriptedClient);
+}
+
+void tearDown(void) {}
+
+void test_recv_null_context(void) {
+  unsigned char buf[16];
+  int result = client_net_recv_timeout(NULL, buf, sizeof(buf), 0);
+
+  TEST_ASSERT_EQUAL_INT(-1, result);
+}
+
+void test_recv_returns_partial_data_at_once(void) {
+  // Arrange
+  unsigned char buf[100];
+  scriptedClient.feed(arrivalData, sizeof(arrivalData));
+
+  // Act
+  int result = client_net_recv_timeout(&testContext, buf, sizeof(buf), 1000);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(sizeof(arrivalData), result);
+  TEST_ASSERT_EQUAL_UINT32(0, virtualNow);
+  TEST_ASSERT_EQUAL_UINT(0, delayCalls);
+}
+
+void test_recv_without_timeout_does_not_wait(void) {
+  // Arrange
+  unsigned char buf[16];
+  scheduleArrival(50);
+
+  // Act
+  int result = client_net_recv_timeout(&testContext, buf, sizeof(buf), 0);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_READ, result);
+  TEST_ASSERT_EQUAL_UINT(0, delayCalls);
+}
+
+void test_recv_polls_until_data_arrives(void) {
+  // Arrange
+  unsigned char buf[100];
+  scheduleArrival(50);
+
+  // Act
+  int result = client_net_recv_timeout(&testContext, buf, sizeof(buf), 1000);
+
+  // Assert
+  printf("polling: latency %lums, %u wakeups\n", virtualNow, delayCalls);
+  TEST_ASSERT_EQUAL_INT(sizeof(arrivalData), result);
+  TEST_ASSERT_EQUAL_UINT32(50, virtualNow);
+  TEST_ASSERT_EQUAL_UINT(50 / SSL_CLIENT_RECV_POLL_INTERVAL, delayCalls);
+}
+
+void test_recv_hook_wakes_once_per_arrival(void) {
+  // Arrange
+  unsigned char buf[100];
+  testContext.settings.recv_ready = readyHook;
+  scheduleArrival(50);
+
+  // Act
+  int result = client_net_recv_timeout(&testContext, buf, sizeof(buf), 1000);
+
+  // Assert
+  printf("hook: latency %lums, %u wakeups\n", virtualNow, hookCalls);
+  TEST_ASSERT_EQUAL_INT(sizeof(arrivalData), result);
+  TEST_ASSERT_EQUAL_UINT32(50, virtualNow);
+  TEST_ASSERT_EQUAL_UINT(1, hookCalls);
+  TEST_ASSERT_EQUAL_UINT(0, delayCalls);
+}
+
+void test_recv_honours_read_timeout(void) {
+  // Arrange
+  unsigned char buf[16];
+  testContext.settings.recv_ready = readyHook;
+  scheduleArrival(500);
+
+  // Act
+  int result = client_net_recv_timeout(&testContext, buf, sizeof(buf), 100);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_READ, result);
+  TEST_ASSERT_EQUAL_UINT32(100, virtualNow);
+}
+
+void test_recv_reports_closed_transport(void) {
+  // Arrange
+  unsigned char buf[16];
+  scriptedClient.hangUp();
+
+  // Act
+  int result = client_net_recv_timeout(&testContext, buf, sizeof(buf), 1000);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_NET_CONN_RESET, result);
+  TEST_ASSERT_EQUAL_UINT(0, delayCalls);
+}
+
+void test_recv_drains_closed_transport(void) {
+  // Arrange
+  unsigned char buf[16];
+  scriptedClient.feed(arrivalData, sizeof(arrivalData));
+  scriptedClient.hangUp();
+
+  // Act
+  int result = client_net_recv_timeout(&testContext, buf, sizeof(buf), 0);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(sizeof(arrivalData), result);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_recv_null_context);
+  RUN_TEST(test_recv_returns_partial_data_at_once);
+  RUN_TEST(test_recv_without_timeout_does_not_wait);
+  RUN_TEST(test_recv_polls_until_data_arrives);
+  RUN_TEST(test_recv_hook_wakes_once_per_arrival);
+  RUN_TEST(test_recv_honours_read_timeout);
+  RUN_TEST(test_recv_reports_closed_transport);
+  RUN_TEST(test_recv_drains_closed_transport);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
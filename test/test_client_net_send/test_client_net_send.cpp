@@ -0,0 +1,223 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/TestClient.h"
+#include "../mocks/ScriptedClient.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+
+using namespace fakeit;
+
+TestClient testClient;
+sslclient_context testContext;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  testClient.reset();
+  testClient.returns("connected", (uint8_t)1); // Mock the client to return true for "connected" function
+  ssl_init(&testContext, &testClient);
+}
+
+void tearDown(void) {}
+
+void test_client_null_context(void) {
+  unsigned char buf[100];
+  int result = client_net_send(NULL, buf, sizeof(buf));
+  
+  TEST_ASSERT_EQUAL_INT(-1, result);
+} 
+    
+void test_client_write_succeeds(void) {
+  // Arrange
+  testClient.returns("write", (size_t)1024).then((size_t)1024).then((size_t)1024);
+  unsigned char buf[3072]; // 3 chunks of data
+
+  // Act
+  void* contextPtr = static_cast<void*>(&testContext);
+  int result = client_net_send(contextPtr, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(3072, result);
+}
+
+void test_client_write_stops_midway(void) {
+  // Arrange
+  testClient.returns("write", (size_t)1024).then((size_t)1024).then((size_t)0);
+  unsigned char buf[3000]; // 3 chunks of data, but the 3rd chunk is not taken
+
+  // Act
+  int result = client_net_send(&testContext, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(2048, result); // progress is reported, mbedtls retries the rest
+}
+
+void test_client_write_would_block(void) {
+  // Arrange
+  testClient.returns("write", (size_t)0);
+  unsigned char buf[1000];
+
+  // Act
+  int result = client_net_send(&testContext, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_WRITE, result);
+}
+
+void test_client_write_fails(void) {
+  // Arrange
+  testClient.returns("write", (size_t)0);
+  testClient.returns("connected", (uint8_t)1).then((uint8_t)0); // connection drops during the write
+  unsigned char buf[1000];
+
+  // Act
+  int result = client_net_send(&testContext, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_NET_SEND_FAILED, result);
+}
+
+void test_zero_length_buffer(void) {
+  // Arrange
+  unsigned char buf[1];
+
+  // Act
+  int result = client_net_send(&testContext, buf, 0);
+  
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, result);
+}
+
+void test_single_chunk_exact(void) {
+  // Arrange
+  unsigned char buf[1024];
+  testClient.returns("write", (size_t)1024);
+
+  // Act
+  int result = client_net_send(&testContext, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(1024, result);
+}
+
+void test_partial_write(void) {
+  // Arrange
+  unsigned char buf[3000];
+  testClient.returns("write", (size_t)500).then((size_t)500).then((size_t)500);
+
+  // Act
+  int result = client_net_send(&testContext, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(500, result); // The short write ends the call
+}
+
+void test_write_is_zero_copy(void) {
+  // Arrange
+  ScriptedClient scriptedClient;
+  sslclient_context context;
+  ssl_init(&context, &scriptedClient);
+  scriptedClient.connect("example.com", 443);
+  unsigned char buf[2000];
+
+  // Act
+  int result = client_net_send(&context, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(2000, result);
+  TEST_ASSERT_EQUAL_UINT(2, scriptedClient.writeCalls);
+  TEST_ASSERT_EQUAL_PTR(&buf[SSL_CLIENT_SEND_BUFFER_SIZE], scriptedClient.lastWrite);
+}
+
+void test_bytes_copied_per_megabyte(void) {
+  // Arrange
+  static unsigned char record[16384]; // largest TLS record mbedtls hands to the BIO
+  ScriptedClient scriptedClient;
+  sslclient_context context;
+  ssl_init(&context, &scriptedClient);
+  scriptedClient.connect("example.com", 443);
+  scriptedClient.writeLimit = 1460; // one TCP segment per write
+  size_t copied = 0;
+  size_t total = 0;
+
+  // Act
+  while (total < 1024 * 1024) {
+    size_t offset = 0;
+    while (offset < sizeof(record)) {
+      int result = client_net_send(&context, &record[offset], sizeof(record) - offset);
+      TEST_ASSERT_GREATER_THAN_INT(0, result);
+      if (scriptedClient.lastWrite < record || scriptedClient.lastWrite >= record + sizeof(record)) {
+        copied += result;
+      }
+      offset += result;
+    }
+    total += sizeof(record);
+  }
+
+  // Assert
+  printf("client_net_send: %zu bytes copied per MB sent (was %zu)\n", copied, total);
+  TEST_ASSERT_EQUAL_UINT(0, copied);
+}
+
+void test_disconnected_client(void) {
+  // Arrange
+  unsigned char buf[1000];
+  testClient.reset(); // Reset the mock client
+  testClient.returns("connected", (uint8_t)0); // Mock the client to return false for "connected" function
+
+  // Act
+  int result = client_net_send(&testContext, buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-2, result); // -2 indicates disconnected client
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_client_null_context);
+  RUN_TEST(test_client_write_succeeds);
+  RUN_TEST(test_client_write_stops_midway);
+  RUN_TEST(test_client_write_would_block);
+  RUN_TEST(test_client_write_fails);
+  RUN_TEST(test_zero_length_buffer);
+  RUN_TEST(test_single_chunk_exact);
+  RUN_TEST(test_partial_write);
+  RUN_TEST(test_write_is_zero_copy);
+  RUN_TEST(test_bytes_copied_per_megabyte);
+  RUN_TEST(test_disconnected_client);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
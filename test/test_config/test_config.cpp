@@ -0,0 +1,143 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_begin_freezes_config(void) {
+  // Arrange
+  SSLConfig config;
+  config.setReadTimeout(5000);
+
+  // Act
+  int result = config.begin();
+  bool changed = config.setReadTimeout(100);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_TRUE(config.ready());
+  TEST_ASSERT_FALSE(changed);
+  TEST_ASSERT_EQUAL_UINT32(5000, config.conf()->read_timeout);
+}
+
+void test_begin_uses_shared_credentials(void) {
+  // Arrange
+  SSLCredentials credentials;
+  credentials.setPreSharedKey("device-1", "00112233");
+  SSLConfig config;
+  config.setCredentials(&credentials);
+
+  // Act
+  int result = config.begin();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_TRUE(config.conf()->f_rng == ssl_random);
+}
+
+void test_end_refused_while_referenced(void) {
+  // Arrange
+  SSLConfig config;
+  config.begin();
+  config.retain();
+  config.retain();
+
+  // Act
+  bool endedWhileUsed = config.end();
+  config.release();
+  config.release();
+  bool endedWhenFree = config.end();
+
+  // Assert
+  TEST_ASSERT_FALSE(endedWhileUsed);
+  TEST_ASSERT_TRUE(endedWhenFree);
+  TEST_ASSERT_FALSE(config.ready());
+  TEST_ASSERT_EQUAL_UINT32(0, config.references());
+}
+
+void test_release_does_not_underflow(void) {
+  // Arrange
+  SSLConfig config;
+
+  // Act
+  config.release();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT32(0, config.references());
+}
+
+void test_max_fragment_length_is_applied(void) {
+  // Arrange
+  SSLConfig config;
+  bool accepted = config.setMaxFragmentLength(1024);
+
+  // Act
+  int result = config.begin();
+
+  // Assert
+  TEST_ASSERT_TRUE(accepted);
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_EQUAL_UINT(MBEDTLS_SSL_MAX_FRAG_LEN_1024, config.conf()->mfl_code);
+}
+
+void test_max_fragment_length_rejects_other_sizes(void) {
+  // Arrange
+  SSLConfig config;
+
+  // Act
+  bool accepted = config.setMaxFragmentLength(3000);
+
+  // Assert
+  TEST_ASSERT_FALSE(accepted);
+  TEST_ASSERT_EQUAL_INT(0, config.begin());
+  TEST_ASSERT_EQUAL_UINT(MBEDTLS_SSL_MAX_FRAG_LEN_NONE, config.conf()->mfl_code);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_freezes_config);
+  RUN_TEST(test_begin_uses_shared_credentials);
+  RUN_TEST(test_end_refused_while_referenced);
+  RUN_TEST(test_release_does_not_underflow);
+  RUN_TEST(test_max_fragment_length_is_applied);
+  RUN_TEST(test_max_fragment_length_rejects_other_sizes);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
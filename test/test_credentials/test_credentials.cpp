@@ -0,0 +1,147 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_decode_psk(void) {
+  // Arrange
+  unsigned char psk[MBEDTLS_PSK_MAX_LEN];
+  size_t len = 0;
+  const unsigned char expected[] = { 0x01, 0xab, 0xCD, 0xef };
+
+  // Act
+  int result = decode_psk("01abCDef", psk, &len);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_EQUAL_UINT(sizeof(expected), len);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, psk, sizeof(expected));
+}
+
+void test_decode_psk_rejects_odd_length(void) {
+  // Arrange
+  unsigned char psk[MBEDTLS_PSK_MAX_LEN];
+  size_t len = 0;
+
+  // Act
+  int result = decode_psk("abc", psk, &len);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-1, result);
+}
+
+void test_decode_psk_rejects_invalid_hex(void) {
+  // Arrange
+  unsigned char psk[MBEDTLS_PSK_MAX_LEN];
+  size_t len = 0;
+
+  // Act
+  int result = decode_psk("0g", psk, &len);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-1, result);
+}
+
+void test_credentials_keep_decoded_psk(void) {
+  // Arrange
+  SSLCredentials credentials;
+
+  // Act
+  int result = credentials.setPreSharedKey("device-1", "00112233");
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_TRUE(credentials.hasPreSharedKey());
+  TEST_ASSERT_EQUAL_UINT(4, credentials.pskLength());
+  TEST_ASSERT_EQUAL_UINT8(0x33, credentials.psk()[3]);
+  TEST_ASSERT_EQUAL_STRING("device-1", credentials.pskIdentity());
+}
+
+void test_credentials_reject_bad_psk(void) {
+  // Arrange
+  SSLCredentials credentials;
+
+  // Act
+  int result = credentials.setPreSharedKey("device-1", "xyz");
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-1, result);
+  TEST_ASSERT_FALSE(credentials.hasPreSharedKey());
+}
+
+void test_credentials_reject_bad_ca(void) {
+  // Arrange
+  SSLCredentials credentials;
+
+  // Act
+  int result = credentials.setCACert("-----BEGIN CERTIFICATE-----\nnot a cert\n-----END CERTIFICATE-----\n");
+
+  // Assert
+  TEST_ASSERT_TRUE(result < 0);
+  TEST_ASSERT_FALSE(credentials.hasCACert());
+}
+
+void test_credentials_clear(void) {
+  // Arrange
+  SSLCredentials credentials;
+  credentials.setPreSharedKey("device-1", "00112233");
+
+  // Act
+  credentials.clear();
+
+  // Assert
+  TEST_ASSERT_FALSE(credentials.hasPreSharedKey());
+  TEST_ASSERT_FALSE(credentials.hasCACert());
+  TEST_ASSERT_FALSE(credentials.hasCertificate());
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_decode_psk);
+  RUN_TEST(test_decode_psk_rejects_odd_length);
+  RUN_TEST(test_decode_psk_rejects_invalid_hex);
+  RUN_TEST(test_credentials_keep_decoded_psk);
+  RUN_TEST(test_credentials_reject_bad_psk);
+  RUN_TEST(test_credentials_reject_bad_ca);
+  RUN_TEST(test_credentials_clear);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
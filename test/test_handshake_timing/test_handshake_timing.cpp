@@ -0,0 +1,186 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+#define PEER_LATENCY_MS 20
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+unsigned long virtualNow = 0;
+unsigned long clockTick = 0;
+int callbackCalls = 0;
+ssl_handshake_timing reported;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  clockTick = 0;
+  callbackCalls = 0;
+  memset(&reported, 0, sizeof(reported));
+  // clockTick > 0 makes every millis() call take that long, so computation shows up too
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { virtualNow += clockTick; return virtualNow; });
+  When(Method(ArduinoFake(), delay)).AlwaysDo([](unsigned long ms) { virtualNow += ms; });
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void onHandshake(void *arg, const ssl_handshake_timing *timing) {
+  callbackCalls++;
+  reported = *timing;
+}
+
+// Handshake in which every flight of the server takes PEER_LATENCY_MS to arrive.
+static int handshakeWithLatency(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    virtualNow += PEER_LATENCY_MS;
+    status = client->poll();
+  }
+  return status;
+}
+
+static void printTiming(const ssl_handshake_timing &timing) {
+  printf("connect %u, setup %u, io %u, crypto %u, finish %u, total %u ms, result %d\n",
+         (unsigned int)timing.connect_ms, (unsigned int)timing.setup_ms, (unsigned int)timing.io_ms,
+         (unsigned int)timing.crypto_ms, (unsigned int)timing.finish_ms, (unsigned int)timing.total_ms, timing.result);
+  for (int i = 0; i < SSL_CLIENT_HANDSHAKE_STATES; i++) {
+    if (timing.states[i].steps > 0) {
+      printf("  state %2d: io %4u ms, crypto %4u ms, %u steps\n", i, (unsigned int)timing.states[i].io_ms,
+             (unsigned int)timing.states[i].crypto_ms, (unsigned int)timing.states[i].steps);
+    }
+  }
+}
+
+void test_waiting_for_the_peer_is_io_time(void) {
+  // Act
+  int status = handshakeWithLatency();
+  ssl_handshake_timing timing = client->getHandshakeTiming();
+
+  // Assert
+  printTiming(timing);
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  TEST_ASSERT_EQUAL_INT(0, timing.result);
+  TEST_ASSERT_FALSE(timing.resumed);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT(2, timing.states[MBEDTLS_SSL_SERVER_HELLO].steps);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT(PEER_LATENCY_MS, timing.states[MBEDTLS_SSL_SERVER_HELLO].io_ms);
+  TEST_ASSERT_EQUAL_UINT(0, timing.crypto_ms);
+  TEST_ASSERT_EQUAL_UINT(timing.connect_ms + timing.setup_ms + timing.io_ms + timing.crypto_ms + timing.finish_ms, timing.total_ms);
+}
+
+void test_computation_is_kept_apart_from_io(void) {
+  // Arrange
+  clockTick = 1;
+
+  // Act
+  int status = handshakeWithLatency();
+  ssl_handshake_timing timing = client->getHandshakeTiming();
+
+  // Assert
+  printTiming(timing);
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  TEST_ASSERT_GREATER_THAN_UINT(0, timing.crypto_ms);
+  TEST_ASSERT_GREATER_THAN_UINT(timing.crypto_ms, timing.io_ms);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT(timing.connect_ms + timing.setup_ms + timing.io_ms + timing.crypto_ms + timing.finish_ms, timing.total_ms);
+}
+
+void test_callback_reports_each_handshake(void) {
+  // Arrange
+  client->setHandshakeTimingCallback(onHandshake, NULL);
+
+  // Act
+  int status = handshakeWithLatency();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  TEST_ASSERT_EQUAL_INT(1, callbackCalls);
+  TEST_ASSERT_EQUAL_INT(0, reported.result);
+  TEST_ASSERT_EQUAL_UINT(client->getHandshakeTiming().total_ms, reported.total_ms);
+}
+
+void test_timed_out_handshake_is_kept_after_stop(void) {
+  // Arrange
+  client->setHandshakeTimingCallback(onHandshake, NULL);
+  client->setHandshakeTimeout(5);
+  loopback->server.open();
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_IN_PROGRESS, client->poll());
+
+  // Act
+  virtualNow += 6000;
+  int status = client->poll();
+  ssl_handshake_timing timing = client->getHandshakeTiming();
+
+  // Assert
+  printTiming(timing);
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_ERROR, status);
+  TEST_ASSERT_EQUAL_INT(1, callbackCalls);
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_TIMEOUT, timing.result);
+  TEST_ASSERT_EQUAL_UINT(6000, timing.states[MBEDTLS_SSL_SERVER_HELLO].io_ms);
+  TEST_ASSERT_EQUAL_UINT(6000, timing.total_ms);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_waiting_for_the_peer_is_io_time);
+  RUN_TEST(test_computation_is_kept_apart_from_io);
+  RUN_TEST(test_callback_reports_each_handshake);
+  RUN_TEST(test_timed_out_handshake_is_kept_after_stop);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
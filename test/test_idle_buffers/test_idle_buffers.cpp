@@ -0,0 +1,251 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "mbedtls/platform.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t payload[1024];
+unsigned long virtualNow = 0;
+size_t heapLive = 0;
+size_t heapPeak = 0;
+
+// Counts what mbedtls has allocated; a size header in front of each block makes free() exact.
+static void *countingCalloc(size_t n, size_t size) {
+  size_t bytes = n * size;
+  size_t *block = (size_t *)calloc(1, bytes + 2 * sizeof(size_t));
+  if (block == NULL) {
+    return NULL;
+  }
+  block[0] = bytes;
+  heapLive += bytes;
+  if (heapLive > heapPeak) {
+    heapPeak = heapLive;
+  }
+  return block + 2;
+}
+
+static void countingFree(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  size_t *block = (size_t *)ptr - 2;
+  heapLive -= block[0];
+  free(block);
+}
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return virtualNow; });
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 11);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+static void goIdle(void) {
+  virtualNow += 1000;
+  TEST_ASSERT_EQUAL_INT(0, client->available());
+  TEST_ASSERT_EQUAL_UINT(SSL_CLIENT_IDLE_BUFFER_SIZE, client->getFootprint().in_buffer);
+}
+
+void test_idle_connection_releases_buffers(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setIdleBufferRelease(1000));
+  connectOverLoopback();
+  ssl_client_footprint active = client->getFootprint();
+  size_t liveActive = heapLive;
+
+  // Act
+  virtualNow += 1000;
+  int avail = client->available();
+
+  // Assert
+  ssl_client_footprint idle = client->getFootprint();
+  printf("record buffers %zu + %zu bytes active, %zu + %zu idle; heap %zu -> %zu bytes\n",
+         active.in_buffer, active.out_buffer, idle.in_buffer, idle.out_buffer, liveActive, heapLive);
+  TEST_ASSERT_EQUAL_INT(0, avail);
+  TEST_ASSERT_EQUAL_UINT(SSL_CLIENT_IDLE_BUFFER_SIZE, idle.in_buffer);
+  TEST_ASSERT_EQUAL_UINT(SSL_CLIENT_IDLE_BUFFER_SIZE, idle.out_buffer);
+  TEST_ASSERT_EQUAL_UINT(active.in_buffer + active.out_buffer - 2 * SSL_CLIENT_IDLE_BUFFER_SIZE, liveActive - heapLive);
+}
+
+void test_buffers_kept_before_idle_time(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setIdleBufferRelease(1000));
+  connectOverLoopback();
+  size_t active = client->getFootprint().in_buffer;
+
+  // Act
+  virtualNow += 999;
+  (void)client->available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(active, client->getFootprint().in_buffer);
+}
+
+void test_buffers_kept_by_default(void) {
+  // Arrange
+  connectOverLoopback();
+  size_t active = client->getFootprint().in_buffer;
+
+  // Act
+  virtualNow += 600000;
+  (void)client->available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(active, client->getFootprint().in_buffer);
+}
+
+void test_incoming_data_regrows_buffers(void) {
+  // Arrange
+  uint8_t buf[sizeof(payload)];
+  TEST_ASSERT_TRUE(client->setIdleBufferRelease(1000));
+  connectOverLoopback();
+  size_t active = client->getFootprint().in_buffer;
+  goIdle();
+  size_t liveIdle = heapLive;
+  heapPeak = heapLive;
+
+  // Act
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), server->send(payload, sizeof(payload)));
+  int avail = client->available();
+  int read = client->read(buf, sizeof(buf));
+
+  // Assert
+  printf("regrow: heap high-water %zu bytes above the idle level\n", heapPeak - liveIdle);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), avail);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), read);
+  TEST_ASSERT_EQUAL_MEMORY(payload, buf, sizeof(payload));
+  TEST_ASSERT_EQUAL_UINT(active, client->getFootprint().in_buffer);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT(2 * active, heapPeak - liveIdle);
+}
+
+void test_write_regrows_buffers(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setIdleBufferRelease(1000));
+  connectOverLoopback();
+  size_t active = client->getFootprint().out_buffer;
+  goIdle();
+
+  // Act
+  size_t written = client->write(payload, sizeof(payload));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), written);
+  TEST_ASSERT_EQUAL_UINT(active, client->getFootprint().out_buffer);
+  for (int i = 0; i < 100 && server->received < sizeof(payload); i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+  }
+  TEST_ASSERT_EQUAL_MEMORY(payload, server->data, sizeof(payload));
+}
+
+void test_traffic_restarts_idle_time(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setIdleBufferRelease(1000));
+  connectOverLoopback();
+  size_t active = client->getFootprint().in_buffer;
+  goIdle();
+  (void)client->write(payload, 10);
+
+  // Act
+  virtualNow += 500;
+  (void)client->available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(active, client->getFootprint().in_buffer);
+}
+
+void test_stop_while_idle(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setIdleBufferRelease(1000));
+  connectOverLoopback();
+  goIdle();
+
+  // Act
+  client->stop();
+
+  // Assert
+  TEST_ASSERT_FALSE(client->connected());
+  TEST_ASSERT_EQUAL_UINT(0, client->getFootprint().in_buffer);
+}
+
+void run_all_tests(void) {
+  mbedtls_platform_set_calloc_free(countingCalloc, countingFree);
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_connection_releases_buffers);
+  RUN_TEST(test_buffers_kept_before_idle_time);
+  RUN_TEST(test_buffers_kept_by_default);
+  RUN_TEST(test_incoming_data_regrows_buffers);
+  RUN_TEST(test_write_regrows_buffers);
+  RUN_TEST(test_traffic_restarts_idle_time);
+  RUN_TEST(test_stop_while_idle);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+unsigned long virtualNow = 0;
+uint8_t payload[1000];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return virtualNow; });
+  When(Method(ArduinoFake(), delay)).AlwaysDo([](unsigned long ms) { virtualNow += ms; });
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 13);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+static bool giveUp(void *arg, size_t sent, size_t pending) {
+  return false;
+}
+
+void test_counters_match_the_transport(void) {
+  // Arrange
+  uint8_t buf[sizeof(payload)];
+  connectOverLoopback();
+
+  // Act
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), client->write(payload, sizeof(payload)));
+  TEST_ASSERT_EQUAL_INT(500, server->send(payload, 500));
+  TEST_ASSERT_EQUAL_INT(500, client->read(buf, sizeof(buf)));
+  ssl_client_counters counters = client->getCounters();
+
+  // Assert
+  printf("plaintext %u in / %u out, ciphertext %u in / %u out, %u records in / %u out\n",
+         (unsigned int)counters.plaintext_in, (unsigned int)counters.plaintext_out,
+         (unsigned int)counters.ciphertext_in, (unsigned int)counters.ciphertext_out,
+         (unsigned int)counters.records_in, (unsigned int)counters.records_out);
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), counters.plaintext_out);
+  TEST_ASSERT_EQUAL_UINT(500, counters.plaintext_in);
+  TEST_ASSERT_EQUAL_UINT(loopback->client.bytesWritten, counters.ciphertext_out);
+  TEST_ASSERT_EQUAL_UINT(loopback->server.bytesWritten, counters.ciphertext_in);
+  TEST_ASSERT_EQUAL_UINT(loopback->client.recordsWritten, counters.records_out);
+  TEST_ASSERT_EQUAL_UINT(loopback->server.recordsWritten, counters.records_in);
+  TEST_ASSERT_EQUAL_UINT(loopback->client.writeCalls, counters.transport_writes);
+  TEST_ASSERT_EQUAL_UINT(loopback->client.readCalls, counters.transport_reads);
+  TEST_ASSERT_EQUAL_UINT(loopback->client.availableCalls, counters.transport_availables);
+}
+
+void test_handshakes_are_counted(void) {
+  // Act
+  connectOverLoopback();
+  ssl_client_counters counters = client->getCounters();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(1, counters.handshakes);
+  TEST_ASSERT_EQUAL_UINT(0, counters.resumed_handshakes);
+  TEST_ASSERT_EQUAL_UINT(0, counters.failed_handshakes);
+  TEST_ASSERT_GREATER_THAN_UINT(0, counters.handshake_retries);
+}
+
+void test_failed_handshake_is_counted(void) {
+  // Arrange
+  client->setHandshakeTimeout(5);
+  loopback->server.open();
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_IN_PROGRESS, client->poll());
+
+  // Act
+  virtualNow += 6000;
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_ERROR, client->poll());
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, client->getCounters().handshakes);
+  TEST_ASSERT_EQUAL_UINT(1, client->getCounters().failed_handshakes);
+}
+
+void test_send_retries_are_counted(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setBackpressureCallback(giveUp, NULL);
+  loopback->client.writeBudget = 0;
+  uint32_t before = client->getCounters().send_retries;
+
+  // Act
+  size_t written = client->write(payload, sizeof(payload));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, written);
+  TEST_ASSERT_EQUAL_UINT(before + 1, client->getCounters().send_retries);
+}
+
+void test_counters_survive_stop_until_reset(void) {
+  // Arrange
+  connectOverLoopback();
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), client->write(payload, sizeof(payload)));
+
+  // Act
+  client->stop();
+  ssl_client_counters stopped = client->getCounters();
+  client->resetCounters();
+  ssl_client_counters reset = client->getCounters();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), stopped.plaintext_out);
+  TEST_ASSERT_EQUAL_UINT(1, stopped.handshakes);
+  TEST_ASSERT_EQUAL_UINT(0, reset.plaintext_out);
+  TEST_ASSERT_EQUAL_UINT(0, reset.handshakes);
+  TEST_ASSERT_EQUAL_UINT(0, reset.transport_writes);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_counters_match_the_transport);
+  RUN_TEST(test_handshakes_are_counted);
+  RUN_TEST(test_failed_handshake_is_counted);
+  RUN_TEST(test_send_retries_are_counted);
+  RUN_TEST(test_counters_survive_stop_until_reset);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,212 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+
+// Self-signed P-256 certificate, only parsed here.
+static const char testCA[] =
+  "-----BEGIN CERTIFICATE-----\n"
+  "MIIBjjCCATWgAwIBAgIUWYmB0iCEion7RQr7Pzchzui0cjcwCgYIKoZIzj0EAwIw\n"
+  "HDEaMBgGA1UEAwwRU1NMQ2xpZW50IFRlc3QgQ0EwIBcNMjYxMDE2MTczNzA3WhgP\n"
+  "MjEyNjA5MjIxNzM3MDdaMBwxGjAYBgNVBAMMEVNTTENsaWVudCBUZXN0IENBMFkw\n"
+  "EwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAE+tynves4tcs1jdtRKDjbMNQ1R1u7DMZz\n"
+  "lIAM5/LRbfOJna/DSHde10ZMoQjNg8P8hq9wIpj8a1y19Ag4tu8LRaNTMFEwHQYD\n"
+  "VR0OBBYEFJSUrjYjTZ3F3+t5+x0v8aPjYeYzMB8GA1UdIwQYMBaAFJSUrjYjTZ3F\n"
+  "3+t5+x0v8aPjYeYzMA8GA1UdEwEB/wQFMAMBAf8wCgYIKoZIzj0EAwIDRwAwRAIg\n"
+  "PGCGXmFdcQU3dKMfsZnKTxf6+ecst1ryemEFSknC1UUCIBLj4Cz5H424TyCAu3Uy\n"
+  "/KsrOl/g5qYSomT2SS+LY/xj\n"
+  "-----END CERTIFICATE-----\n";
+
+static const char *phaseNames[SSL_MEMORY_PHASES] = { "config", "cert parse", "handshake", "steady" };
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+SSLMemoryTracker *tracker = nullptr;
+uint8_t payload[1024];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  tracker = new SSLMemoryTracker();
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 5);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete tracker;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+static void printStats(const char *label, const ssl_memory_stats &stats) {
+  printf("%s: live %zu, peak %zu, %u allocations\n", label, stats.live, stats.peak, (unsigned int)stats.allocations);
+  for (int i = 0; i < SSL_MEMORY_PHASES; i++) {
+    printf("  %-10s live %6zu, peak %6zu, %4u allocations\n", phaseNames[i], stats.phases[i].live,
+           stats.phases[i].peak, (unsigned int)stats.phases[i].allocations);
+  }
+}
+
+void test_stats_are_zero_when_off(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  ssl_memory_stats stats = client->getMemoryStats();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, stats.live);
+  TEST_ASSERT_EQUAL_UINT(0, stats.peak);
+  TEST_ASSERT_EQUAL_UINT(0, stats.allocations);
+}
+
+void test_phases_of_a_psk_connection(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setMemoryStats(tracker));
+
+  // Act
+  connectOverLoopback();
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), client->write(payload, sizeof(payload)));
+  ssl_memory_stats stats = client->getMemoryStats();
+
+  // Assert
+  printStats("PSK connection", stats);
+  TEST_ASSERT_GREATER_THAN_UINT(MBEDTLS_SSL_IN_CONTENT_LEN, stats.phases[SSL_MEMORY_PHASE_CONFIG].live);
+  TEST_ASSERT_GREATER_THAN_UINT(0, stats.phases[SSL_MEMORY_PHASE_HANDSHAKE].allocations);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT(stats.live, stats.peak);
+  TEST_ASSERT_EQUAL_UINT(0, stats.untracked);
+}
+
+void test_certificate_parse_is_counted(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setMemoryStats(tracker));
+  client->setCACert(testCA);
+
+  // Act
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+  ssl_memory_stats stats = client->getMemoryStats();
+
+  // Assert
+  printStats("CA certificate parsed", stats);
+  TEST_ASSERT_GREATER_THAN_UINT(0, stats.phases[SSL_MEMORY_PHASE_CERT_PARSE].allocations);
+  TEST_ASSERT_GREATER_THAN_UINT(0, stats.phases[SSL_MEMORY_PHASE_CERT_PARSE].live);
+}
+
+void test_stop_releases_everything(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setMemoryStats(tracker));
+  connectOverLoopback();
+
+  // Act
+  client->stop();
+  ssl_memory_stats stats = client->getMemoryStats();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, stats.live);
+  for (int i = 0; i < SSL_MEMORY_PHASES; i++) {
+    TEST_ASSERT_EQUAL_UINT(0, stats.phases[i].live);
+  }
+  TEST_ASSERT_GREATER_THAN_UINT(0, stats.peak);
+}
+
+void test_reset_keeps_live_bytes(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setMemoryStats(tracker));
+  connectOverLoopback();
+  size_t live = client->getMemoryStats().live;
+
+  // Act
+  client->resetMemoryStats();
+  ssl_memory_stats stats = client->getMemoryStats();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(live, stats.live);
+  TEST_ASSERT_EQUAL_UINT(live, stats.peak);
+  TEST_ASSERT_EQUAL_UINT(0, stats.allocations);
+}
+
+void test_disabling_drops_the_figures(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setMemoryStats(tracker));
+  connectOverLoopback();
+
+  // Act
+  TEST_ASSERT_TRUE(client->setMemoryStats(nullptr));
+  client->stop();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, client->getMemoryStats().peak);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stats_are_zero_when_off);
+  RUN_TEST(test_phases_of_a_psk_connection);
+  RUN_TEST(test_certificate_parse_is_counted);
+  RUN_TEST(test_stop_releases_everything);
+  RUN_TEST(test_reset_keeps_live_bytes);
+  RUN_TEST(test_disabling_drops_the_figures);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
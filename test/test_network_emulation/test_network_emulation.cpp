@@ -0,0 +1,355 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...);
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/EmulatedClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "../mocks/TestCertificates.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+#define TICK_MS 5
+#define TRANSFER_BYTES (32U * 1024U)
+
+struct Profile {
+  const EmulatedNetwork *network;
+  unsigned long timeout_ms; // the SSL_CLIENT_*_HANDSHAKE_TIMEOUT meant for it
+};
+
+static const Profile profiles[] = {
+  { &EMULATED_LAN, SSL_CLIENT_LOW_LATENCY_NETWORK_HANDSHAKE_TIMEOUT },
+  { &EMULATED_LTE, SSL_CLIENT_LOW_LATENCY_NETWORK_HANDSHAKE_TIMEOUT },
+  { &EMULATED_3G, SSL_CLIENT_DEFAULT_HANDSHAKE_TIMEOUT },
+  { &EMULATED_GPRS, SSL_CLIENT_SLOW_NETWORK_HANDSHAKE_TIMEOUT },
+  { &EMULATED_LOSSY_GPRS, SSL_CLIENT_UNRELIABLE_NETWORK_HANDSHAKE_TIMEOUT },
+};
+
+static const EmulatedNetwork steadyGprs = { "steady-gprs", 300, 0, 20000, 40000, 576, 0, 0 };
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+EmulatedLink *net = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t payload[4096];
+uint8_t received[4096];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return net->clock.now; });
+  When(Method(ArduinoFake(), delay)).AlwaysDo([](unsigned long ms) { net->clock.now += ms; });
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 17);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete net;
+  client = nullptr;
+  server = nullptr;
+  net = nullptr;
+}
+
+static void begin(const EmulatedNetwork &network) {
+  net = new EmulatedLink(network);
+  server = new TlsTestServer(net->server);
+  client = new SSLClient(&net->client);
+  net->server.open();
+}
+
+/**
+ * Run an ECDSA P-256 handshake with the given timeout. Returns the final poll() status and
+ * sets elapsed to the virtual time it took.
+ */
+static int handshake(unsigned long timeout_ms, unsigned long *elapsed) {
+  TEST_ASSERT_EQUAL_INT(0, server->beginCertificate(ecCert, ecKey));
+  client->setCACert(ecCert);
+  client->setHandshakeTimeout(timeout_ms / 1000);
+
+  unsigned long start = net->clock.now;
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 20000 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+    net->clock.now += TICK_MS;
+  }
+  *elapsed = net->clock.now - start;
+  return status;
+}
+
+static void connectPsk(void) {
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  client->setHandshakeTimeout(SSL_CLIENT_UNRELIABLE_NETWORK_HANDSHAKE_TIMEOUT / 1000);
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 20000 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+    net->clock.now += TICK_MS;
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+/**
+ * Virtual milliseconds to send TRANSFER_BYTES from the server to the client.
+ */
+static unsigned long download(void) {
+  unsigned long start = net->clock.now;
+  size_t sent = 0;
+  size_t got = 0;
+
+  for (int i = 0; i < 100000 && got < TRANSFER_BYTES; i++) {
+    if (sent < TRANSFER_BYTES) {
+      size_t len = TRANSFER_BYTES - sent < sizeof(payload) ? TRANSFER_BYTES - sent : sizeof(payload);
+      int ret = server->send(payload, len);
+      if (ret > 0) {
+        sent += ret;
+      } else {
+        TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_WRITE, ret);
+      }
+    }
+    int ret = client->read(received, sizeof(received));
+    if (ret > 0) {
+      got += ret;
+    } else {
+      net->clock.now += TICK_MS;
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT(TRANSFER_BYTES, got);
+  return net->clock.now - start;
+}
+
+/**
+ * Virtual milliseconds to send TRANSFER_BYTES from the client to the server.
+ */
+static unsigned long upload(void) {
+  unsigned long start = net->clock.now;
+  size_t base = server->received;
+  size_t sent = 0;
+
+  for (int i = 0; i < 100000 && server->received < base + TRANSFER_BYTES; i++) {
+    if (sent < TRANSFER_BYTES) {
+      size_t len = TRANSFER_BYTES - sent < sizeof(payload) ? TRANSFER_BYTES - sent : sizeof(payload);
+      sent += client->write(payload, len);
+    }
+    for (int k = 0; k < 16; k++) {
+      TEST_ASSERT_EQUAL_INT(0, server->step());
+    }
+    net->clock.now += TICK_MS;
+  }
+  TEST_ASSERT_EQUAL_UINT(base + TRANSFER_BYTES, server->received);
+  return net->clock.now - start;
+}
+
+void test_latency_delays_delivery(void) {
+  // Arrange
+  begin(steadyGprs);
+  uint8_t buf[100];
+
+  // Act
+  TEST_ASSERT_EQUAL_UINT(100, net->client.write(payload, 100));
+  net->clock.now = 339; // 40 ms on the wire, 300 ms latency
+  int early = net->server.available();
+  net->clock.now = 340;
+  int late = net->server.available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, early);
+  TEST_ASSERT_EQUAL_INT(100, late);
+  TEST_ASSERT_EQUAL_INT(100, net->server.read(buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_MEMORY(payload, buf, 100);
+}
+
+void test_bandwidth_queues_segments(void) {
+  // Arrange
+  begin(steadyGprs);
+
+  // Act
+  TEST_ASSERT_EQUAL_UINT(2000, net->client.write(payload, 2000));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(802 + 300, net->up.drainedAt()); // 3 x 231 ms + 109 ms on the wire
+  net->clock.now = 400;
+  TEST_ASSERT_EQUAL_UINT(2000 - 576, net->up.queued());
+}
+
+void test_reads_are_cut_at_the_mtu(void) {
+  // Arrange
+  begin(steadyGprs);
+  uint8_t buf[2000];
+  TEST_ASSERT_EQUAL_UINT(1500, net->client.write(payload, 1500));
+  net->clock.now = net->up.drainedAt();
+
+  // Act
+  int first = net->server.read(buf, sizeof(buf));
+  int second = net->server.read(buf, sizeof(buf));
+  int third = net->server.read(buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(576, first);
+  TEST_ASSERT_EQUAL_INT(576, second);
+  TEST_ASSERT_EQUAL_INT(348, third);
+}
+
+void test_full_send_buffer_takes_less(void) {
+  // Arrange
+  begin(steadyGprs);
+  net->up.sendBuffer = 1000;
+
+  // Act
+  size_t first = net->client.write(payload, 1500);
+  size_t second = net->client.write(payload, 100);
+  net->clock.now = 231; // the first segment has left
+  size_t third = net->client.write(payload, 1000);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(1000, first);
+  TEST_ASSERT_EQUAL_UINT(0, second);
+  TEST_ASSERT_EQUAL_UINT(576, third);
+}
+
+void test_stall_holds_back_segments(void) {
+  // Arrange
+  begin(steadyGprs);
+  net->up.stall(0, 5000);
+
+  // Act
+  TEST_ASSERT_EQUAL_UINT(100, net->client.write(payload, 100));
+  net->clock.now = 4999;
+  int stalled = net->server.available();
+  net->clock.now = 5000;
+  int resumed = net->server.available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, stalled);
+  TEST_ASSERT_EQUAL_INT(100, resumed);
+}
+
+void test_drop_breaks_the_connection(void) {
+  // Arrange
+  begin(steadyGprs);
+  net->client.open();
+  net->client.dropAt = 1000;
+
+  // Act
+  net->clock.now = 1000;
+
+  // Assert
+  TEST_ASSERT_FALSE(net->client.connected());
+  TEST_ASSERT_EQUAL_UINT(0, net->client.write(payload, 10));
+  TEST_ASSERT_EQUAL_INT(-1, net->client.read(received, 10));
+}
+
+void test_handshake_fits_each_profile(void) {
+  printf("network       timeout  handshake\n");
+  for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+    // Arrange
+    begin(*profiles[i].network);
+    unsigned long elapsed = 0;
+
+    // Act
+    int status = handshake(profiles[i].timeout_ms, &elapsed);
+
+    // Assert
+    printf("%-12s %6lu ms %7lu ms\n", profiles[i].network->name, profiles[i].timeout_ms, elapsed);
+    TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+    TEST_ASSERT_LESS_THAN_UINT32(profiles[i].timeout_ms, elapsed);
+    tearDown();
+  }
+}
+
+void test_stall_outlasts_the_low_latency_timeout(void) {
+  // Arrange
+  unsigned long shortRun = 0;
+  unsigned long longRun = 0;
+  begin(EMULATED_GPRS);
+  net->down.stall(0, 8000);
+
+  // Act
+  int withShortTimeout = handshake(SSL_CLIENT_LOW_LATENCY_NETWORK_HANDSHAKE_TIMEOUT, &shortRun);
+  tearDown();
+  begin(EMULATED_GPRS);
+  net->down.stall(0, 8000);
+  int withSlowTimeout = handshake(SSL_CLIENT_SLOW_NETWORK_HANDSHAKE_TIMEOUT, &longRun);
+
+  // Assert
+  printf("8 s stall on gprs: %lu ms with the low latency timeout, %lu ms with the slow one\n", shortRun, longRun);
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_ERROR, withShortTimeout);
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, withSlowTimeout);
+  TEST_ASSERT_GREATER_THAN_UINT32(8000, longRun);
+}
+
+void test_throughput_of_each_network(void) {
+  printf("network       download kbit/s  upload kbit/s\n");
+  for (size_t i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+    // Arrange
+    const EmulatedNetwork &network = *profiles[i].network;
+    begin(network);
+    connectPsk();
+
+    // Act
+    unsigned long down_ms = download();
+    unsigned long up_ms = upload();
+
+    // Assert
+    double down = TRANSFER_BYTES * 8.0 / (down_ms > 0 ? down_ms : 1);
+    double up = TRANSFER_BYTES * 8.0 / (up_ms > 0 ? up_ms : 1);
+    printf("%-12s %15.1f %14.1f\n", network.name, down, up);
+    TEST_ASSERT_TRUE(down <= network.downlink_bps / 1000.0);
+    TEST_ASSERT_TRUE(up <= network.uplink_bps / 1000.0);
+    tearDown();
+  }
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_latency_delays_delivery);
+  RUN_TEST(test_bandwidth_queues_segments);
+  RUN_TEST(test_reads_are_cut_at_the_mtu);
+  RUN_TEST(test_full_send_buffer_takes_less);
+  RUN_TEST(test_stall_holds_back_segments);
+  RUN_TEST(test_drop_breaks_the_connection);
+  RUN_TEST(test_handshake_fits_each_profile);
+  RUN_TEST(test_stall_outlasts_the_low_latency_timeout);
+  RUN_TEST(test_throughput_of_each_network);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+sslclient_context *testContext = nullptr;
+uint8_t payload[4096];
+uint8_t batch[8192];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  testContext = new sslclient_context;
+  ssl_init(testContext, &loopback->client);
+  testContext->settings.handshake_timeout = 5000;
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)i;
+  }
+}
+
+void tearDown(void) {
+  stop_ssl_socket(testContext, NULL, NULL, NULL);
+  delete testContext;
+  delete server;
+  delete loopback;
+}
+
+// Handshake with 512 byte records, so that a 4 KiB upload takes 8 records.
+static void connectWithSmallRecords(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  TEST_ASSERT_EQUAL_INT(0, begin_ssl_client(testContext, "localhost", 443, NULL, NULL, NULL, "client", "1a2b3c4d5e6f7081"));
+  TEST_ASSERT_EQUAL_INT(0, mbedtls_ssl_conf_max_frag_len(&testContext->ssl_conf, MBEDTLS_SSL_MAX_FRAG_LEN_512));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = poll_ssl_handshake(testContext, "localhost", 443);
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  loopback->client.resetCounters();
+}
+
+static size_t upload(void) {
+  size_t sent = 0;
+  for (int i = 0; i < 64 && sent < sizeof(payload); i++) {
+    int ret = send_ssl_data(testContext, &payload[sent], sizeof(payload) - sent);
+    TEST_ASSERT_GREATER_THAN_INT(0, ret);
+    sent += ret;
+  }
+  return sent;
+}
+
+static void assertServerReceivedPayload(void) {
+  for (int i = 0; i < 100 && server->received < sizeof(payload); i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+  }
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), server->received);
+  TEST_ASSERT_EQUAL_MEMORY(payload, server->data, sizeof(payload));
+}
+
+void test_upload_without_batch(void) {
+  // Arrange
+  connectWithSmallRecords();
+
+  // Act
+  size_t sent = upload();
+
+  // Assert
+  printf("unbatched: %u records in %u transport writes\n", loopback->client.recordsWritten, loopback->client.writeCalls);
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), sent);
+  TEST_ASSERT_EQUAL_UINT(8, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(8, loopback->client.writeCalls);
+  assertServerReceivedPayload();
+}
+
+void test_upload_with_batch(void) {
+  // Arrange
+  connectWithSmallRecords();
+  testContext->settings.out_batch = batch;
+  testContext->settings.out_batch_size = sizeof(batch);
+
+  // Act
+  int sent = send_ssl_data(testContext, payload, sizeof(payload));
+
+  // Assert
+  printf("batched: %u records in %u transport writes\n", loopback->client.recordsWritten, loopback->client.writeCalls);
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), sent);
+  TEST_ASSERT_EQUAL_UINT(8, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.writeCalls);
+  TEST_ASSERT_EQUAL_UINT(0, testContext->out_batch_len);
+  assertServerReceivedPayload();
+}
+
+void test_batch_size_bounds_held_back_bytes(void) {
+  // Arrange
+  connectWithSmallRecords();
+  testContext->settings.out_batch = batch;
+  testContext->settings.out_batch_size = 2048;
+
+  // Act
+  int sent = send_ssl_data(testContext, payload, sizeof(payload));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(sizeof(payload), sent);
+  TEST_ASSERT_GREATER_THAN_UINT(1, loopback->client.writeCalls);
+  TEST_ASSERT_LESS_THAN_UINT(8, loopback->client.writeCalls);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT(2048, loopback->client.largestWrite);
+  assertServerReceivedPayload();
+}
+
+void test_batch_reports_closed_transport(void) {
+  // Arrange
+  connectWithSmallRecords();
+  testContext->settings.out_batch = batch;
+  testContext->settings.out_batch_size = sizeof(batch);
+  loopback->client.hangUp();
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, 100);
+
+  // Assert
+  TEST_ASSERT_LESS_THAN_INT(0, ret);
+  TEST_ASSERT_EQUAL_UINT(0, testContext->out_batch_len);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_upload_without_batch);
+  RUN_TEST(test_upload_with_batch);
+  RUN_TEST(test_batch_size_bounds_held_back_bytes);
+  RUN_TEST(test_batch_reports_closed_transport);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
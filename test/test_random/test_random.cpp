@@ -0,0 +1,116 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+
+#include "unity.h"
+#include "Arduino.h"
+#include "ssl_random.cpp"
+
+static int sourceCalls = 0;
+
+static int countingSource(void *data, unsigned char *output, size_t len, size_t *olen) {
+  sourceCalls++;
+  memset(output, 0x5a, len);
+  *olen = len;
+  return 0;
+}
+
+void setUp(void) {
+  sourceCalls = 0;
+  ssl_random_configure(NULL);
+}
+
+void tearDown(void) {
+  ssl_random_free();
+}
+
+void test_seeds_once_for_many_connections(void) {
+  // Arrange
+  unsigned char out[32];
+  uint32_t seedsBefore = ssl_random_seed_count();
+
+  // Act
+  for (int i = 0; i < 50; i++) {
+    TEST_ASSERT_EQUAL_INT(0, ssl_random(NULL, out, sizeof(out)));
+  }
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT32(1, ssl_random_seed_count() - seedsBefore);
+}
+
+void test_output_differs_between_calls(void) {
+  // Arrange
+  unsigned char first[32];
+  unsigned char second[32];
+
+  // Act
+  ssl_random(NULL, first, sizeof(first));
+  ssl_random(NULL, second, sizeof(second));
+
+  // Assert
+  TEST_ASSERT_TRUE(memcmp(first, second, sizeof(first)) != 0);
+}
+
+void test_explicit_reseed_is_counted(void) {
+  // Arrange
+  unsigned char out[16];
+  ssl_random(NULL, out, sizeof(out));
+  uint32_t seedsBefore = ssl_random_seed_count();
+
+  // Act
+  int result = ssl_random_reseed();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_EQUAL_UINT32(1, ssl_random_seed_count() - seedsBefore);
+}
+
+void test_custom_entropy_source_is_used(void) {
+  // Arrange
+  ssl_random_config config = {};
+  config.entropy_source = countingSource;
+  config.entropy_threshold = 32;
+  config.reseed_interval = 1000;
+  ssl_random_configure(&config);
+  unsigned char out[16];
+
+  // Act
+  int result = ssl_random(NULL, out, sizeof(out));
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, result);
+  TEST_ASSERT_TRUE(sourceCalls > 0);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_seeds_once_for_many_connections);
+  RUN_TEST(test_output_differs_between_calls);
+  RUN_TEST(test_explicit_reseed_is_counted);
+  RUN_TEST(test_custom_entropy_source_is_used);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
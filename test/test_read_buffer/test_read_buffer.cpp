@@ -0,0 +1,197 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include <chrono>
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t readBuffer[2048];
+uint8_t payload[16384];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 7);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+// Read rounds * sizeof(payload) bytes one at a time, returns bytes per second.
+static double readBytewise(int rounds) {
+  size_t total = 0;
+  double seconds = 0;
+
+  for (int r = 0; r < rounds; r++) {
+    TEST_ASSERT_EQUAL_INT(sizeof(payload), server->send(payload, sizeof(payload)));
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < sizeof(payload); i++) {
+      int c = client->read();
+      TEST_ASSERT_EQUAL_INT(payload[i], c);
+    }
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    total += sizeof(payload);
+  }
+  return seconds > 0 ? total / seconds : 0;
+}
+
+void test_bytewise_read_throughput(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  double direct = readBytewise(8);
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+  double buffered = readBytewise(8);
+
+  // Assert
+  printf("byte-wise read: %.0f B/s direct, %.0f B/s with read-ahead buffer\n", direct, buffered);
+  TEST_ASSERT_EQUAL_INT(0, client->available());
+}
+
+void test_available_is_served_from_buffer(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+  server->send(payload, 100);
+  TEST_ASSERT_EQUAL_INT(100, client->available());
+  loopback->client.resetCounters();
+
+  // Act
+  int avail = 0;
+  for (int i = 0; i < 50; i++) {
+    avail = client->available();
+    (void)client->read();
+  }
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(51, avail);
+  TEST_ASSERT_EQUAL_UINT(0, loopback->client.availableCalls);
+  TEST_ASSERT_EQUAL_UINT(0, loopback->client.readCalls);
+}
+
+void test_peek_does_not_consume(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+  server->send(payload, 10);
+
+  // Act
+  int peeked = client->peek();
+  int read = client->read();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(payload[0], peeked);
+  TEST_ASSERT_EQUAL_INT(payload[0], read);
+  TEST_ASSERT_EQUAL_INT(payload[1], client->peek());
+}
+
+void test_bulk_read_drains_buffer_then_record(void) {
+  // Arrange
+  uint8_t buf[sizeof(payload)];
+  connectOverLoopback();
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+  server->send(payload, 4000);
+  (void)client->read();
+
+  // Act
+  int first = client->read(buf, sizeof(buf));
+  int second = client->read(buf + first, sizeof(buf) - first);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(sizeof(readBuffer) - 1, first);
+  TEST_ASSERT_EQUAL_INT(4000 - sizeof(readBuffer), second);
+  TEST_ASSERT_EQUAL_MEMORY(&payload[1], buf, 3999);
+}
+
+void test_stop_drops_buffered_data(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+  server->send(payload, 100);
+  (void)client->available();
+
+  // Act
+  client->stop();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, client->available());
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bytewise_read_throughput);
+  RUN_TEST(test_available_is_served_from_buffer);
+  RUN_TEST(test_peek_does_not_consume);
+  RUN_TEST(test_bulk_read_drains_buffer_then_record);
+  RUN_TEST(test_stop_drops_buffered_data);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
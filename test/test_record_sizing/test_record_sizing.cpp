@@ -0,0 +1,197 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t payload[4096];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)i;
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  loopback->client.resetCounters();
+}
+
+static void printFootprint(const char *label, const ssl_client_footprint &footprint) {
+  printf("%s: context %zu, in %zu (records up to %zu), out %zu (records up to %zu), total %zu bytes, %zu connections per 100 KiB\n",
+         label, footprint.context, footprint.in_buffer, footprint.in_max_frag, footprint.out_buffer, footprint.out_max_frag,
+         footprint.total, footprint.total > 0 ? (size_t)102400 / footprint.total : 0);
+}
+
+void test_footprint_with_full_records(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  ssl_client_footprint footprint = client->getFootprint();
+
+  // Assert
+  printFootprint("full records", footprint);
+  TEST_ASSERT_EQUAL_UINT(MBEDTLS_SSL_IN_CONTENT_LEN, footprint.in_max_frag);
+  TEST_ASSERT_EQUAL_UINT(MBEDTLS_SSL_OUT_CONTENT_LEN, footprint.out_max_frag);
+  TEST_ASSERT_GREATER_THAN_UINT(footprint.in_max_frag, footprint.in_buffer);
+  TEST_ASSERT_EQUAL_UINT(footprint.context + footprint.in_buffer + footprint.out_buffer, footprint.total);
+}
+
+void test_negotiated_fragment_length(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setMaxFragmentLength(512));
+  connectOverLoopback();
+
+  // Act
+  ssl_client_footprint footprint = client->getFootprint();
+  size_t written = client->write(payload, sizeof(payload));
+
+  // Assert
+  printFootprint("512 byte records", footprint);
+  TEST_ASSERT_EQUAL_UINT(512, footprint.in_max_frag);
+  TEST_ASSERT_EQUAL_UINT(512, footprint.out_max_frag);
+  TEST_ASSERT_EQUAL_UINT(512, written);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+}
+
+void test_large_server_records_are_split(void) {
+  // Arrange
+  uint8_t buf[sizeof(payload)];
+  size_t got = 0;
+  TEST_ASSERT_TRUE(client->setMaxFragmentLength(1024));
+  connectOverLoopback();
+
+  // Act
+  int sent = 0;
+  while (sent < (int)sizeof(payload)) {
+    int ret = server->send(&payload[sent], sizeof(payload) - sent);
+    TEST_ASSERT_GREATER_THAN_INT(0, ret);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(1024, ret);
+    sent += ret;
+  }
+  for (int i = 0; i < 16 && got < sizeof(buf); i++) {
+    int ret = client->read(&buf[got], sizeof(buf) - got);
+    TEST_ASSERT_GREATER_THAN_INT(0, ret);
+    got += ret;
+  }
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), got);
+  TEST_ASSERT_EQUAL_MEMORY(payload, buf, sizeof(payload));
+}
+
+void test_unsupported_fragment_length_is_rejected(void) {
+  // Act
+  bool accepted = client->setMaxFragmentLength(8192);
+
+  // Assert
+  TEST_ASSERT_FALSE(accepted);
+}
+
+void test_no_record_buffers_while_disconnected(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  client->stop();
+  ssl_client_footprint footprint = client->getFootprint();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, footprint.in_buffer);
+  TEST_ASSERT_EQUAL_UINT(0, footprint.out_buffer);
+  TEST_ASSERT_EQUAL_UINT(sizeof(sslclient_context), footprint.total);
+}
+
+void test_fragment_length_survives_stop(void) {
+  // Arrange
+  TEST_ASSERT_TRUE(client->setMaxFragmentLength(2048));
+  connectOverLoopback();
+  client->stop();
+  delete server;
+  loopback->up = LoopbackPipe();
+  loopback->down = LoopbackPipe();
+  server = new TlsTestServer(loopback->server);
+
+  // Act
+  connectOverLoopback();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(2048, client->getFootprint().out_max_frag);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_footprint_with_full_records);
+  RUN_TEST(test_negotiated_fragment_length);
+  RUN_TEST(test_large_server_records_are_split);
+  RUN_TEST(test_unsupported_fragment_length_is_rejected);
+  RUN_TEST(test_no_record_buffers_while_disconnected);
+  RUN_TEST(test_fragment_length_survives_stop);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,327 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+sslclient_context *testContext = nullptr;
+uint8_t payload[4096];
+uint8_t batch[1024];
+unsigned long virtualNow = 0;
+unsigned int delayCalls = 0;
+unsigned int hookCalls = 0;
+unsigned int backpressureCalls = 0;
+size_t lastSent = 0;
+size_t lastPending = 0;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  delayCalls = 0;
+  hookCalls = 0;
+  backpressureCalls = 0;
+  lastSent = 0;
+  lastPending = 0;
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return virtualNow; });
+  When(Method(ArduinoFake(), delay)).AlwaysDo([](unsigned long ms) { virtualNow += ms; delayCalls++; });
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  testContext = new sslclient_context;
+  ssl_init(testContext, &loopback->client);
+  testContext->settings.handshake_timeout = 5000;
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 5);
+  }
+}
+
+void tearDown(void) {
+  stop_ssl_socket(testContext, NULL, NULL, NULL);
+  delete testContext;
+  delete server;
+  delete loopback;
+}
+
+static void connectContext(bool smallRecords) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  TEST_ASSERT_EQUAL_INT(0, begin_ssl_client(testContext, "localhost", 443, NULL, NULL, NULL, "client", "1a2b3c4d5e6f7081"));
+  if (smallRecords) {
+    TEST_ASSERT_EQUAL_INT(0, mbedtls_ssl_conf_max_frag_len(&testContext->ssl_conf, MBEDTLS_SSL_MAX_FRAG_LEN_512));
+  }
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = poll_ssl_handshake(testContext, "localhost", 443);
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  loopback->client.resetCounters();
+  delayCalls = 0;
+}
+
+static void assertServerReceived(size_t len) {
+  for (int i = 0; i < 100 && server->received < len; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+  }
+  TEST_ASSERT_EQUAL_UINT(len, server->received);
+  TEST_ASSERT_EQUAL_MEMORY(payload, server->data, len);
+}
+
+static bool recordBackpressure(void *arg, size_t sent, size_t pending) {
+  backpressureCalls++;
+  lastSent = sent;
+  lastPending = pending;
+  return arg == NULL; // a non-NULL arg asks to give up
+}
+
+static bool giveUpAndReopen(void *arg, size_t sent, size_t pending) {
+  (void)recordBackpressure(NULL, sent, pending);
+  loopback->client.writeBudget = SIZE_MAX; // lets the batched records out
+  return false;
+}
+
+static bool reopenHook(void *arg, uint32_t timeout_ms) {
+  hookCalls++;
+  virtualNow += 10;
+  loopback->client.writeBudget = SIZE_MAX;
+  return true;
+}
+
+static bool waitHook(void *arg, uint32_t timeout_ms) {
+  hookCalls++;
+  virtualNow += timeout_ms; // nothing wakes it, so it sleeps the whole timeout
+  return false;
+}
+
+void test_stalled_send_returns_at_deadline(void) {
+  // Arrange
+  connectContext(false);
+  testContext->settings.send_timeout = 100;
+  loopback->client.writeBudget = 0;
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, 100);
+
+  // Assert
+  printf("stalled for %lu ms: %u transport writes, %u sleeps\n", virtualNow, loopback->client.writeCalls, delayCalls);
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_WRITE, ret);
+  TEST_ASSERT_EQUAL_UINT(100, virtualNow);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT(100 / SSL_CLIENT_SEND_POLL_INTERVAL + 2, loopback->client.writeCalls);
+  TEST_ASSERT_EQUAL_UINT(100 / SSL_CLIENT_SEND_POLL_INTERVAL, delayCalls);
+}
+
+void test_stalled_send_resumes_with_same_data(void) {
+  // Arrange
+  connectContext(false);
+  testContext->settings.send_timeout = 10;
+  loopback->client.writeBudget = 0;
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_WRITE, send_ssl_data(testContext, payload, 100));
+
+  // Act
+  loopback->client.writeBudget = SIZE_MAX;
+  int ret = send_ssl_data(testContext, payload, 100);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(100, ret);
+  assertServerReceived(100);
+}
+
+void test_partial_progress_is_reported(void) {
+  // Arrange
+  connectContext(true);
+  testContext->settings.out_batch = batch;
+  testContext->settings.out_batch_size = sizeof(batch);
+  testContext->settings.send_timeout = 50;
+  testContext->settings.backpressure = giveUpAndReopen;
+  loopback->client.writeBudget = 1500;
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, sizeof(payload));
+
+  // Assert
+  TEST_ASSERT_GREATER_THAN_INT(0, ret);
+  TEST_ASSERT_LESS_THAN_INT(sizeof(payload), ret);
+  TEST_ASSERT_EQUAL_UINT(ret, lastSent);
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload) - ret, lastPending);
+
+  size_t sent = ret;
+  loopback->client.writeBudget = SIZE_MAX;
+  for (int i = 0; i < 16 && sent < sizeof(payload); i++) {
+    ret = send_ssl_data(testContext, &payload[sent], sizeof(payload) - sent);
+    TEST_ASSERT_GREATER_THAN_INT(0, ret);
+    sent += ret;
+  }
+  assertServerReceived(sizeof(payload));
+}
+
+void test_backpressure_callback_can_give_up(void) {
+  // Arrange
+  connectContext(false);
+  testContext->settings.backpressure = recordBackpressure;
+  testContext->settings.backpressure_arg = testContext;
+  loopback->client.writeBudget = 0;
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, 100);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_WRITE, ret);
+  TEST_ASSERT_EQUAL_UINT(1, backpressureCalls);
+  TEST_ASSERT_EQUAL_UINT(0, lastSent);
+  TEST_ASSERT_EQUAL_UINT(100, lastPending);
+  TEST_ASSERT_EQUAL_UINT(0, delayCalls);
+}
+
+void test_send_ready_hook_replaces_sleep(void) {
+  // Arrange
+  connectContext(false);
+  testContext->settings.send_timeout = 100;
+  testContext->settings.send_ready = waitHook;
+  loopback->client.writeBudget = 0;
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, 100);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_WRITE, ret);
+  TEST_ASSERT_EQUAL_UINT(1, hookCalls);
+  TEST_ASSERT_EQUAL_UINT(0, delayCalls);
+}
+
+void test_zero_timeout_never_waits(void) {
+  // Arrange
+  connectContext(false);
+  testContext->settings.send_timeout = 0;
+  loopback->client.writeBudget = 0;
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, 100);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(MBEDTLS_ERR_SSL_WANT_WRITE, ret);
+  TEST_ASSERT_EQUAL_UINT(0, delayCalls);
+  TEST_ASSERT_EQUAL_UINT(0, virtualNow);
+}
+
+void test_final_flush_waits_for_transport(void) {
+  // Arrange
+  connectContext(false);
+  testContext->settings.out_batch = batch;
+  testContext->settings.out_batch_size = sizeof(batch);
+  testContext->settings.send_timeout = 100;
+  testContext->settings.send_ready = reopenHook;
+  loopback->client.writeBudget = 0; // the record fits the batch, so only the final flush stalls
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, 500);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(500, ret);
+  TEST_ASSERT_EQUAL_UINT(1, hookCalls);
+  TEST_ASSERT_EQUAL_UINT(0, testContext->out_batch_len);
+  assertServerReceived(500);
+}
+
+void test_final_flush_stalled_past_deadline_fails(void) {
+  // Arrange
+  connectContext(false);
+  testContext->settings.out_batch = batch;
+  testContext->settings.out_batch_size = sizeof(batch);
+  testContext->settings.send_timeout = 100;
+  loopback->client.writeBudget = 0;
+
+  // Act
+  int ret = send_ssl_data(testContext, payload, 500);
+
+  // Assert
+  TEST_ASSERT_LESS_THAN_INT(0, ret);
+  TEST_ASSERT_NOT_EQUAL(MBEDTLS_ERR_SSL_WANT_WRITE, ret);
+  TEST_ASSERT_NOT_EQUAL(MBEDTLS_ERR_SSL_WANT_READ, ret);
+  TEST_ASSERT_EQUAL_UINT(100, virtualNow);
+  TEST_ASSERT_EQUAL_UINT(0, testContext->out_batch_len);
+  TEST_ASSERT_EQUAL_UINT(0, loopback->client.bytesWritten);
+}
+
+void test_client_write_returns_zero_when_stalled(void) {
+  // Arrange
+  SSLClient client(&loopback->client);
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client.setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  client.setSendTimeout(50);
+  TEST_ASSERT_EQUAL_INT(1, client.connectAsync("localhost", 443));
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client.poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  loopback->client.writeBudget = 0;
+
+  // Act
+  size_t stalled = client.write(payload, 100);
+  loopback->client.writeBudget = SIZE_MAX;
+  size_t resumed = client.write(payload, 100);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, stalled);
+  TEST_ASSERT_EQUAL_UINT(100, resumed);
+  TEST_ASSERT_TRUE(client.connected());
+  assertServerReceived(100);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_stalled_send_returns_at_deadline);
+  RUN_TEST(test_stalled_send_resumes_with_same_data);
+  RUN_TEST(test_partial_progress_is_reported);
+  RUN_TEST(test_backpressure_callback_can_give_up);
+  RUN_TEST(test_send_ready_hook_replaces_sleep);
+  RUN_TEST(test_zero_timeout_never_waits);
+  RUN_TEST(test_final_flush_waits_for_transport);
+  RUN_TEST(test_final_flush_stalled_past_deadline_fails);
+  RUN_TEST(test_client_write_returns_zero_when_stalled);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,182 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+
+#include "unity.h"
+#include "Arduino.h"
+#include "SSLSessionCache.cpp"
+
+SSLSessionMemoryStore memoryStore;
+
+void setUp(void) {
+  memoryStore.clear();
+}
+
+void tearDown(void) {}
+
+void test_memory_store_round_trip(void) {
+  // Arrange
+  const uint8_t session[] = { 1, 2, 3, 4, 5 };
+  uint8_t buf[16];
+
+  // Act
+  bool saved = memoryStore.save("example.com:443", session, sizeof(session));
+  size_t len = memoryStore.load("example.com:443", buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_TRUE(saved);
+  TEST_ASSERT_EQUAL_UINT(sizeof(session), len);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(session, buf, sizeof(session));
+}
+
+void test_memory_store_miss(void) {
+  // Arrange
+  const uint8_t session[] = { 1, 2, 3 };
+  uint8_t buf[16];
+  memoryStore.save("example.com:443", session, sizeof(session));
+
+  // Act
+  size_t len = memoryStore.load("example.com:8883", buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, len);
+}
+
+void test_memory_store_does_not_overflow_caller_buffer(void) {
+  // Arrange
+  const uint8_t session[32] = { 0 };
+  uint8_t buf[8];
+  memoryStore.save("example.com:443", session, sizeof(session));
+
+  // Act
+  size_t len = memoryStore.load("example.com:443", buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, len);
+}
+
+void test_memory_store_evicts_least_recently_used(void) {
+  // Arrange
+  const uint8_t session[] = { 7 };
+  uint8_t buf[4];
+  char key[SSL_CLIENT_SESSION_KEY_SIZE];
+  for (unsigned int i = 0; i < SSL_CLIENT_SESSION_CACHE_SLOTS; i++) {
+    snprintf(key, sizeof(key), "host%u:443", i);
+    memoryStore.save(key, session, sizeof(session));
+  }
+  memoryStore.load("host0:443", buf, sizeof(buf)); // host1 is now the oldest entry
+
+  // Act
+  memoryStore.save("new.host:443", session, sizeof(session));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(1, memoryStore.load("host0:443", buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_UINT(0, memoryStore.load("host1:443", buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_UINT(1, memoryStore.load("new.host:443", buf, sizeof(buf)));
+}
+
+void test_memory_store_remove(void) {
+  // Arrange
+  const uint8_t session[] = { 1 };
+  uint8_t buf[4];
+  memoryStore.save("example.com:443", session, sizeof(session));
+
+  // Act
+  memoryStore.remove("example.com:443");
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, memoryStore.load("example.com:443", buf, sizeof(buf)));
+}
+
+void test_file_store_round_trip(void) {
+  // Arrange
+  SSLSessionFileStore fileStore(".");
+  const uint8_t session[] = { 9, 8, 7, 6 };
+  uint8_t buf[16];
+
+  // Act
+  bool saved = fileStore.save("example.com:443", session, sizeof(session));
+  size_t len = fileStore.load("example.com:443", buf, sizeof(buf));
+  fileStore.remove("example.com:443");
+
+  // Assert
+  TEST_ASSERT_TRUE(saved);
+  TEST_ASSERT_EQUAL_UINT(sizeof(session), len);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(session, buf, sizeof(session));
+  TEST_ASSERT_EQUAL_UINT(0, fileStore.load("example.com:443", buf, sizeof(buf)));
+}
+
+void test_cache_counts_hits_and_misses(void) {
+  // Arrange
+  SSLSessionCache cache(memoryStore);
+
+  // Act
+  cache.recordHandshake(false);
+  cache.recordHandshake(true);
+  cache.recordHandshake(true);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT32(2, cache.hits());
+  TEST_ASSERT_EQUAL_UINT32(1, cache.misses());
+}
+
+void test_cache_skips_hosts_too_long_for_a_key(void) {
+  // Arrange
+  SSLSessionCache cache(memoryStore);
+  const uint8_t session[] = { 1, 2, 3 };
+  uint8_t buf[16];
+  char host[SSL_CLIENT_SESSION_KEY_SIZE + 8];
+  memset(host, 'a', sizeof(host) - 1);
+  host[sizeof(host) - 1] = '\0';
+  char truncated[SSL_CLIENT_SESSION_KEY_SIZE];
+  snprintf(truncated, sizeof(truncated), "%s", host); // what a truncating key would have been
+  memoryStore.save(truncated, session, sizeof(session));
+  mbedtls_ssl_context ssl;
+  mbedtls_ssl_init(&ssl);
+
+  // Act
+  bool restored = cache.restore(host, 443, &ssl);
+  cache.remove(host, 8883);
+
+  // Assert
+  TEST_ASSERT_FALSE(restored);
+  TEST_ASSERT_EQUAL_UINT(sizeof(session), memoryStore.load(truncated, buf, sizeof(buf)));
+  mbedtls_ssl_free(&ssl);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_memory_store_round_trip);
+  RUN_TEST(test_memory_store_miss);
+  RUN_TEST(test_memory_store_does_not_overflow_caller_buffer);
+  RUN_TEST(test_memory_store_evicts_least_recently_used);
+  RUN_TEST(test_memory_store_remove);
+  RUN_TEST(test_file_store_round_trip);
+  RUN_TEST(test_cache_counts_hits_and_misses);
+  RUN_TEST(test_cache_skips_hosts_too_long_for_a_key);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,132 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/TestClient.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+
+using namespace fakeit;
+
+TestClient testClient;
+sslclient_context *testContext = nullptr;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  testClient.reset();
+  testClient.returns("connected", (uint8_t)1);
+  testContext = new sslclient_context;
+  ssl_init(testContext, &testClient);
+}
+
+void tearDown(void) {
+  stop_ssl_socket(testContext, NULL, NULL, NULL);
+  delete testContext;
+}
+
+void test_context_not_set_up_after_init(void) {
+  // Act
+  bool isSetUp = ssl_client_is_set_up(testContext);
+
+  // Assert
+  TEST_ASSERT_FALSE(isSetUp);
+}
+
+void test_context_set_up_after_ssl_setup(void) {
+  // Arrange
+  configure_ssl_defaults(&testContext->ssl_conf);
+
+  // Act
+  int ret = mbedtls_ssl_setup(&testContext->ssl_ctx, &testContext->ssl_conf);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, ret);
+  TEST_ASSERT_TRUE(ssl_client_is_set_up(testContext));
+}
+
+void test_stop_keeps_transport_and_settings(void) {
+  // Arrange
+  SSLSessionMemoryStore store;
+  SSLSessionCache cache(store);
+  testContext->settings.handshake_timeout = 5000;
+  testContext->settings.session_cache = &cache;
+  testContext->settings.warm_reconnect = true;
+  testContext->out_batch_len = 12;
+  configure_ssl_defaults(&testContext->ssl_conf);
+  mbedtls_ssl_setup(&testContext->ssl_ctx, &testContext->ssl_conf);
+
+  // Act
+  stop_ssl_socket(testContext, NULL, NULL, NULL);
+
+  // Assert
+  TEST_ASSERT_FALSE(ssl_client_is_set_up(testContext));
+  TEST_ASSERT_EQUAL_PTR(&testClient, testContext->client);
+  TEST_ASSERT_EQUAL_UINT32(5000, testContext->settings.handshake_timeout);
+  TEST_ASSERT_EQUAL_PTR(&cache, testContext->settings.session_cache);
+  TEST_ASSERT_TRUE(testContext->settings.warm_reconnect);
+  TEST_ASSERT_EQUAL_UINT(0, testContext->out_batch_len);
+}
+
+void test_restart_requires_set_up_context(void) {
+  // Act
+  int ret = restart_ssl_client(testContext, "example.com", 443);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(-1, ret);
+}
+
+void test_close_keeps_context(void) {
+  // Arrange
+  testClient.returns("connected", (uint8_t)0);
+  configure_ssl_defaults(&testContext->ssl_conf);
+  mbedtls_ssl_setup(&testContext->ssl_ctx, &testContext->ssl_conf);
+
+  // Act
+  close_ssl_socket(testContext);
+
+  // Assert
+  TEST_ASSERT_TRUE(ssl_client_is_set_up(testContext));
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_context_not_set_up_after_init);
+  RUN_TEST(test_context_set_up_after_ssl_setup);
+  RUN_TEST(test_stop_keeps_transport_and_settings);
+  RUN_TEST(test_restart_requires_set_up_context);
+  RUN_TEST(test_close_keeps_context);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
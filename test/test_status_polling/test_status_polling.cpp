@@ -0,0 +1,192 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t readBuffer[1024];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  loopback->client.resetCounters();
+}
+
+// The loop of a typical MQTT client while nothing happens: a few connected() checks and one available().
+static void idleLoop(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    TEST_ASSERT_TRUE(client->connected());
+    TEST_ASSERT_TRUE(client->connected());
+    TEST_ASSERT_TRUE(client->connected());
+    TEST_ASSERT_EQUAL_INT(0, client->available());
+  }
+}
+
+void test_idle_loop_does_not_read(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  idleLoop(1000);
+
+  // Assert
+  printf("idle loop x1000: %u connected(), %u available(), %u read() on the transport\n", loopback->client.connectedCalls, loopback->client.availableCalls, loopback->client.readCalls);
+  TEST_ASSERT_EQUAL_UINT(0, loopback->client.readCalls);
+  TEST_ASSERT_EQUAL_UINT(3000, loopback->client.connectedCalls);
+  TEST_ASSERT_EQUAL_UINT(1000, loopback->client.availableCalls);
+}
+
+void test_idle_loop_with_read_buffer_does_not_read(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+
+  // Act
+  idleLoop(1000);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, loopback->client.readCalls);
+  TEST_ASSERT_EQUAL_UINT(1000, loopback->client.availableCalls);
+}
+
+void test_available_reports_arrived_data(void) {
+  // Arrange
+  const uint8_t message[] = "hello";
+  connectOverLoopback();
+  server->send(message, 5);
+
+  // Act
+  int first = client->available();
+  int second = client->available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(5, first);
+  TEST_ASSERT_EQUAL_INT(5, second);
+  TEST_ASSERT_EQUAL_INT('h', client->read());
+}
+
+void test_connected_does_not_consume_data(void) {
+  // Arrange
+  const uint8_t message[] = "hello";
+  connectOverLoopback();
+  server->send(message, 5);
+
+  // Act
+  bool up = client->connected();
+
+  // Assert
+  TEST_ASSERT_TRUE(up);
+  TEST_ASSERT_EQUAL_UINT(0, loopback->client.readCalls);
+  TEST_ASSERT_EQUAL_INT(5, client->available());
+}
+
+void test_connected_until_data_after_hang_up_is_read(void) {
+  // Arrange
+  uint8_t buf[8];
+  const uint8_t message[] = "bye";
+  connectOverLoopback();
+  server->send(message, 3);
+  loopback->client.hangUp();
+  loopback->server.hangUp();
+
+  // Act
+  bool beforeRead = client->connected();
+  int read = client->read(buf, sizeof(buf));
+  bool afterRead = client->connected();
+
+  // Assert
+  TEST_ASSERT_TRUE(beforeRead);
+  TEST_ASSERT_EQUAL_INT(3, read);
+  TEST_ASSERT_FALSE(afterRead);
+}
+
+void test_not_connected_after_stop(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  client->stop();
+
+  // Assert
+  TEST_ASSERT_FALSE(client->connected());
+  TEST_ASSERT_EQUAL_INT(0, client->available());
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_idle_loop_does_not_read);
+  RUN_TEST(test_idle_loop_with_read_buffer_does_not_read);
+  RUN_TEST(test_available_reports_arrived_data);
+  RUN_TEST(test_connected_does_not_consume_data);
+  RUN_TEST(test_connected_until_data_after_hang_up_is_read);
+  RUN_TEST(test_not_connected_after_stop);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
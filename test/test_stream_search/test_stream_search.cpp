@@ -0,0 +1,293 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include <chrono>
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+static const char *httpResponse =
+  "HTTP/1.1 200 OK\r\n"
+  "Date: Mon, 27 Jul 2009 12:28:53 GMT\r\n"
+  "Server: Apache/2.2.14 (Win32)\r\n"
+  "Last-Modified: Wed, 22 Jul 2009 19:15:56 GMT\r\n"
+  "ETag: \"34aa387-d-1568eb00\"\r\n"
+  "Accept-Ranges: bytes\r\n"
+  "Cache-Control: no-cache, no-store, must-revalidate\r\n"
+  "Pragma: no-cache\r\n"
+  "Expires: 0\r\n"
+  "Strict-Transport-Security: max-age=31536000; includeSubDomains\r\n"
+  "X-Content-Type-Options: nosniff\r\n"
+  "X-Frame-Options: DENY\r\n"
+  "Vary: Accept-Encoding\r\n"
+  "Content-Type: application/json; charset=utf-8\r\n"
+  "Content-Length: 13\r\n"
+  "Connection: close\r\n"
+  "\r\n"
+  "{\"ok\":true}\r\n";
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+unsigned long virtualNow = 0;
+unsigned long virtualStep = 0;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  virtualStep = 0;
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return virtualNow += virtualStep; });
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+static void serverSend(const char *text) {
+  TEST_ASSERT_EQUAL_INT(strlen(text), server->send((const uint8_t *)text, strlen(text)));
+}
+
+// What Stream::readStringUntil() does: one read() per byte.
+static String readLineBytewise(void) {
+  String line;
+  int c = client->read();
+  while (c >= 0 && c != '\n') {
+    line += (char)c;
+    c = client->read();
+  }
+  return line;
+}
+
+// Parses the header block line by line, returns the number of header lines.
+static int parseHeaders(bool bytewise, unsigned int *contentLength) {
+  int lines = 0;
+  for (int i = 0; i < 64; i++) {
+    String line = bytewise ? readLineBytewise() : client->readStringUntil('\n');
+    if (line.length() <= 1) {
+      break;
+    }
+    if (strncmp(line.c_str(), "Content-Length: ", 16) == 0) {
+      *contentLength = atoi(line.c_str() + 16);
+    }
+    lines++;
+  }
+  return lines;
+}
+
+static double benchmarkHeaders(bool bytewise, int rounds) {
+  uint8_t body[32];
+  double seconds = 0;
+
+  for (int r = 0; r < rounds; r++) {
+    unsigned int contentLength = 0;
+    serverSend(httpResponse);
+
+    auto start = std::chrono::steady_clock::now();
+    int lines = parseHeaders(bytewise, &contentLength);
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    TEST_ASSERT_EQUAL_INT(16, lines);
+    TEST_ASSERT_EQUAL_UINT(13, contentLength);
+    TEST_ASSERT_EQUAL_INT(13, client->read(body, contentLength));
+  }
+  return seconds * 1e6 / rounds;
+}
+
+void test_header_parsing_benchmark(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  double bytewise = benchmarkHeaders(true, 200);
+  double spans = benchmarkHeaders(false, 200);
+
+  // Assert
+  printf("HTTP header block: %.1f us byte-wise, %.1f us with readStringUntil()\n", bytewise, spans);
+  TEST_ASSERT_EQUAL_INT(0, client->available());
+}
+
+void test_read_bytes_until_drops_terminator(void) {
+  // Arrange
+  char buf[32] = { 0 };
+  connectOverLoopback();
+  serverSend("key=value;rest");
+
+  // Act
+  size_t len = client->readBytesUntil(';', buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(9, len);
+  TEST_ASSERT_EQUAL_MEMORY("key=value", buf, 9);
+  TEST_ASSERT_EQUAL_INT('r', client->read());
+}
+
+void test_read_bytes_until_stops_at_length(void) {
+  // Arrange
+  char buf[4];
+  connectOverLoopback();
+  serverSend("abcdef;");
+
+  // Act
+  size_t len = client->readBytesUntil(';', buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(4, len);
+  TEST_ASSERT_EQUAL_MEMORY("abcd", buf, 4);
+  TEST_ASSERT_EQUAL_INT('e', client->read());
+}
+
+void test_read_string_until_spans_records(void) {
+  // Arrange
+  connectOverLoopback();
+  serverSend("first half, ");
+  serverSend("second half\nnext");
+
+  // Act
+  String line = client->readStringUntil('\n');
+
+  // Assert
+  TEST_ASSERT_EQUAL_STRING("first half, second half", line.c_str());
+  TEST_ASSERT_EQUAL_INT('n', client->read());
+}
+
+void test_read_string_until_times_out(void) {
+  // Arrange
+  connectOverLoopback();
+  serverSend("no newline");
+  virtualStep = 10;
+
+  // Act
+  String line = client->readStringUntil('\n');
+
+  // Assert
+  TEST_ASSERT_EQUAL_STRING("no newline", line.c_str());
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT(1000, virtualNow); // the default Stream timeout
+}
+
+void test_find_across_records(void) {
+  // Arrange
+  connectOverLoopback();
+  serverSend("HTTP/1.1 200 OK\r\nContent-Le");
+  serverSend("ngth: 42\r\n");
+
+  // Act
+  bool found = client->find("Content-Length:");
+
+  // Assert
+  TEST_ASSERT_TRUE(found);
+  TEST_ASSERT_EQUAL_INT(' ', client->read());
+  TEST_ASSERT_EQUAL_INT('4', client->read());
+}
+
+void test_find_overlapping_prefix(void) {
+  // Arrange
+  connectOverLoopback();
+  serverSend("xaaabz");
+
+  // Act
+  bool found = client->find("aab");
+
+  // Assert
+  TEST_ASSERT_TRUE(found);
+  TEST_ASSERT_EQUAL_INT('z', client->read());
+}
+
+void test_find_until_stops_at_terminator(void) {
+  // Arrange
+  connectOverLoopback();
+  serverSend("Server: x\r\n\r\nbody with Location: y");
+
+  // Act
+  bool found = client->findUntil("Location:", "\r\n\r\n");
+
+  // Assert
+  TEST_ASSERT_FALSE(found);
+  TEST_ASSERT_EQUAL_INT('b', client->read());
+}
+
+void test_find_times_out(void) {
+  // Arrange
+  connectOverLoopback();
+  serverSend("nothing to see");
+  virtualStep = 10;
+
+  // Act
+  bool found = client->find("needle");
+
+  // Assert
+  TEST_ASSERT_FALSE(found);
+  TEST_ASSERT_EQUAL_INT(0, client->available());
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_header_parsing_benchmark);
+  RUN_TEST(test_read_bytes_until_drops_terminator);
+  RUN_TEST(test_read_bytes_until_stops_at_length);
+  RUN_TEST(test_read_string_until_spans_records);
+  RUN_TEST(test_read_string_until_times_out);
+  RUN_TEST(test_find_across_records);
+  RUN_TEST(test_find_overlapping_prefix);
+  RUN_TEST(test_find_until_stops_at_terminator);
+  RUN_TEST(test_find_times_out);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
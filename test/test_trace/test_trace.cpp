@@ -0,0 +1,222 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+#define SSL_TRACE_LEVEL SSL_TRACE_LEVEL_VERBOSE
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_trace.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+unsigned long virtualMicros = 0;
+ssl_trace_event events[SSL_TRACE_BUFFER_EVENTS];
+uint8_t payload[300];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualMicros = 0;
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  When(Method(ArduinoFake(), micros)).AlwaysDo([]() -> unsigned long { return virtualMicros += 10; });
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  ssl_trace_clear();
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 11);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+static size_t countEvents(const ssl_trace_event *list, size_t count, uint16_t id) {
+  size_t found = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (list[i].id == id) {
+      found++;
+    }
+  }
+  return found;
+}
+
+void test_connection_is_traced(void) {
+  // Arrange
+  uint8_t buf[sizeof(payload)];
+  connectOverLoopback();
+
+  // Act
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), client->write(payload, sizeof(payload)));
+  TEST_ASSERT_EQUAL_INT(100, server->send(payload, 100));
+  TEST_ASSERT_EQUAL_INT(100, client->read(buf, sizeof(buf)));
+  size_t count = ssl_trace_read(events, SSL_TRACE_BUFFER_EVENTS);
+
+  // Assert
+  TEST_ASSERT_GREATER_THAN_UINT(0, countEvents(events, count, SSL_TRACE_HANDSHAKE_STEP));
+  TEST_ASSERT_GREATER_THAN_UINT(0, countEvents(events, count, SSL_TRACE_NET_RECV));
+  TEST_ASSERT_GREATER_THAN_UINT(0, countEvents(events, count, SSL_TRACE_NET_SEND));
+  TEST_ASSERT_EQUAL_UINT(1, countEvents(events, count, SSL_TRACE_SEND_BEGIN));
+  TEST_ASSERT_EQUAL_UINT(1, countEvents(events, count, SSL_TRACE_SEND_END));
+  TEST_ASSERT_EQUAL_UINT(0, countEvents(events, count, SSL_TRACE_ERROR));
+  for (size_t i = 1; i < count; i++) {
+    TEST_ASSERT_GREATER_THAN_UINT32(events[i - 1].time_us, events[i].time_us);
+  }
+}
+
+void test_send_events_carry_their_arguments(void) {
+  // Arrange
+  connectOverLoopback();
+  ssl_trace_clear();
+
+  // Act
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload), client->write(payload, sizeof(payload)));
+  size_t count = ssl_trace_read(events, SSL_TRACE_BUFFER_EVENTS);
+
+  // Assert
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT(3, count);
+  TEST_ASSERT_EQUAL_UINT16(SSL_TRACE_SEND_BEGIN, events[0].id);
+  TEST_ASSERT_EQUAL_INT32(sizeof(payload), events[0].a);
+  TEST_ASSERT_EQUAL_UINT16(SSL_TRACE_NET_SEND, events[1].id);
+  TEST_ASSERT_EQUAL_INT32(events[1].b, events[1].a);
+  TEST_ASSERT_EQUAL_UINT16(SSL_TRACE_SEND_END, events[count - 1].id);
+  TEST_ASSERT_EQUAL_INT32(sizeof(payload), events[count - 1].a);
+}
+
+void test_ring_keeps_the_newest_events(void) {
+  // Arrange
+  uint32_t total = ssl_trace_total();
+
+  // Act
+  for (int i = 0; i < (int)SSL_TRACE_BUFFER_EVENTS + 10; i++) {
+    ssl_trace_write(SSL_TRACE_ERROR, i, -i);
+  }
+  size_t count = ssl_trace_read(events, SSL_TRACE_BUFFER_EVENTS);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(SSL_TRACE_BUFFER_EVENTS, count);
+  TEST_ASSERT_EQUAL_UINT32(total + SSL_TRACE_BUFFER_EVENTS + 10, ssl_trace_total());
+  TEST_ASSERT_EQUAL_INT32(10, events[0].a);
+  TEST_ASSERT_EQUAL_INT32(SSL_TRACE_BUFFER_EVENTS + 9, events[count - 1].a);
+  TEST_ASSERT_EQUAL_INT32(-(int32_t)(SSL_TRACE_BUFFER_EVENTS + 9), events[count - 1].b);
+}
+
+void test_read_returns_the_newest_that_fit(void) {
+  // Arrange
+  for (int i = 0; i < 5; i++) {
+    ssl_trace_write(SSL_TRACE_ERROR, i, 0);
+  }
+
+  // Act
+  size_t count = ssl_trace_read(events, 2);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(2, count);
+  TEST_ASSERT_EQUAL_INT32(3, events[0].a);
+  TEST_ASSERT_EQUAL_INT32(4, events[1].a);
+}
+
+void test_dump_format(void) {
+  // Arrange
+  LoopbackLink *sink = new LoopbackLink();
+  sink->client.open();
+  ssl_trace_write(SSL_TRACE_NET_SEND, 5, 7);
+  ssl_trace_write(SSL_TRACE_NET_RECV, -1, 9);
+
+  // Act
+  size_t written = ssl_trace_dump(sink->client);
+
+  // Assert
+  uint16_t count;
+  ssl_trace_event last;
+  TEST_ASSERT_EQUAL_UINT(12 + 2 * sizeof(ssl_trace_event), written);
+  TEST_ASSERT_EQUAL_MEMORY(SSL_TRACE_DUMP_MAGIC, sink->up.data, 4);
+  TEST_ASSERT_EQUAL_UINT8(SSL_TRACE_DUMP_VERSION, sink->up.data[4]);
+  TEST_ASSERT_EQUAL_UINT8(sizeof(ssl_trace_event), sink->up.data[5]);
+  memcpy(&count, &sink->up.data[6], sizeof(count));
+  memcpy(&last, &sink->up.data[12 + sizeof(ssl_trace_event)], sizeof(last));
+  TEST_ASSERT_EQUAL_UINT16(2, count);
+  TEST_ASSERT_EQUAL_UINT16(SSL_TRACE_NET_RECV, last.id);
+  TEST_ASSERT_EQUAL_INT32(-1, last.a);
+  TEST_ASSERT_EQUAL_INT32(9, last.b);
+  delete sink;
+}
+
+void test_clear_empties_the_buffer(void) {
+  // Arrange
+  ssl_trace_write(SSL_TRACE_ERROR, 1, 2);
+
+  // Act
+  ssl_trace_clear();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, ssl_trace_read(events, SSL_TRACE_BUFFER_EVENTS));
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connection_is_traced);
+  RUN_TEST(test_send_events_carry_their_arguments);
+  RUN_TEST(test_ring_keeps_the_newest_events);
+  RUN_TEST(test_read_returns_the_newest_that_fit);
+  RUN_TEST(test_dump_format);
+  RUN_TEST(test_clear_empties_the_buffer);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "../mocks/TestCertificates.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+sslclient_context *testContext = nullptr;
+SSLClient *client = nullptr;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  testContext = new sslclient_context;
+  ssl_init(testContext, &loopback->client);
+  testContext->settings.handshake_timeout = 5000;
+  client = new SSLClient(&loopback->client);
+}
+
+void tearDown(void) {
+  delete client;
+  stop_ssl_socket(testContext, NULL, NULL, NULL);
+  delete testContext;
+  delete server;
+  delete loopback;
+}
+
+// A fresh server for the next connection; whatever the last one left in the pipes is dropped.
+static void serve(const char *certPem, const char *keyPem) {
+  delete server;
+  loopback->up.pos = loopback->up.len;
+  loopback->down.pos = loopback->down.len;
+  loopback->server.open();
+  server = new TlsTestServer(loopback->server);
+  TEST_ASSERT_EQUAL_INT(0, server->beginCertificate(certPem, keyPem));
+}
+
+static void handshakeContext(const char *rootCA) {
+  TEST_ASSERT_EQUAL_INT(0, begin_ssl_client(testContext, "localhost", 443, rootCA, NULL, NULL, NULL, NULL));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = poll_ssl_handshake(testContext, "localhost", 443);
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+static int handshakeClient(void) {
+  if (client->connectAsync("localhost", 443) != 1) {
+    return SSL_CLIENT_HANDSHAKE_ERROR;
+  }
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    (void)server->step();
+    status = client->poll();
+  }
+  return status;
+}
+
+void test_kept_context_can_restart_with_same_credentials(void) {
+  // Arrange
+  serve(rsaCert, rsaKey);
+  testContext->settings.warm_reconnect = true;
+  handshakeContext(rsaCert);
+  close_ssl_socket(testContext);
+
+  // Act
+  bool same = ssl_client_can_restart(testContext, rsaCert, NULL, NULL, NULL, NULL);
+  bool other = ssl_client_can_restart(testContext, ecCert, NULL, NULL, NULL, NULL);
+
+  // Assert
+  TEST_ASSERT_TRUE(same);
+  TEST_ASSERT_FALSE(other);
+}
+
+void test_restart_refused_after_credentials_released(void) {
+  // Arrange
+  serve(rsaCert, rsaKey);
+  handshakeContext(rsaCert);
+  testContext->settings.warm_reconnect = true; // too late, the handshake has freed the parsed CA
+  close_ssl_socket(testContext);
+
+  // Act
+  bool canRestart = ssl_client_can_restart(testContext, rsaCert, NULL, NULL, NULL, NULL);
+  int ret = reset_ssl_client(testContext, "localhost", 443);
+
+  // Assert
+  TEST_ASSERT_TRUE(testContext->credentials_released);
+  TEST_ASSERT_FALSE(canRestart);
+  TEST_ASSERT_EQUAL_INT(-1, ret);
+}
+
+void test_warm_reconnect_enabled_while_connected_reconnects_cold(void) {
+  // Arrange
+  serve(rsaCert, rsaKey);
+  client->setCACert(rsaCert);
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, handshakeClient());
+  client->setWarmReconnect(true);
+  client->stop();
+  serve(rsaCert, rsaKey);
+
+  // Act
+  int status = handshakeClient();
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  TEST_ASSERT_TRUE(client->connected());
+}
+
+void test_changed_credentials_reconnect_cold(void) {
+  // Arrange
+  client->setWarmReconnect(true);
+  serve(rsaCert, rsaKey);
+  client->setCACert(rsaCert);
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, handshakeClient());
+  client->stop();
+  serve(ecCert, ecKey);
+  client->setCACert(ecCert);
+
+  // Act
+  int status = handshakeClient(); // the kept context only trusts rsaCert
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  TEST_ASSERT_TRUE(client->connected());
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_kept_context_can_restart_with_same_credentials);
+  RUN_TEST(test_restart_refused_after_credentials_released);
+  RUN_TEST(test_warm_reconnect_enabled_while_connected_reconnects_cold);
+  RUN_TEST(test_changed_credentials_reconnect_cold);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
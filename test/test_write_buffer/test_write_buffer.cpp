@@ -0,0 +1,292 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+static const char *httpRequest[] = {
+  "GET /index.html HTTP/1.1\r\n",
+  "Host: example.com\r\n",
+  "User-Agent: ESP32\r\n",
+  "Connection: close\r\n",
+  "\r\n"
+};
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t writeBuffer[512];
+uint8_t readBuffer[256];
+unsigned long virtualNow = 0;
+
+void setUp(void) {
+  ArduinoFakeReset();
+  virtualNow = 0;
+  When(Method(ArduinoFake(), millis)).AlwaysDo([]() -> unsigned long { return virtualNow; });
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  loopback->client.resetCounters();
+}
+
+static size_t pumpServer(size_t expected) {
+  for (int i = 0; i < 100 && server->received < expected; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+  }
+  return server->received;
+}
+
+static size_t writePieces(const char **pieces, size_t count) {
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    total += client->write((const uint8_t *)pieces[i], strlen(pieces[i]));
+  }
+  return total;
+}
+
+static size_t writeMqttPublish(void) {
+  // the way many MQTT clients send a PUBLISH: fixed header, topic and payload one by one
+  const uint8_t topicLength[] = { 0x00, 0x0c };
+  const char *topic = "sensors/temp";
+  const char *payload = "{\"t\":21.5}";
+  size_t total = 0;
+
+  total += client->write((uint8_t)0x30);
+  total += client->write((uint8_t)(sizeof(topicLength) + strlen(topic) + strlen(payload)));
+  total += client->write(topicLength, sizeof(topicLength));
+  total += client->write((const uint8_t *)topic, strlen(topic));
+  total += client->write((const uint8_t *)payload, strlen(payload));
+  return total;
+}
+
+void test_http_request_without_buffer(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  size_t total = writePieces(httpRequest, 5);
+
+  // Assert
+  printf("HTTP request unbuffered: %u records, %zu bytes on the wire for %zu bytes\n", loopback->client.recordsWritten, loopback->client.bytesWritten, total);
+  TEST_ASSERT_EQUAL_UINT(5, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(total, pumpServer(total));
+}
+
+void test_http_request_with_buffer(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+
+  // Act
+  size_t total = writePieces(httpRequest, 5);
+  unsigned int recordsBeforeFlush = loopback->client.recordsWritten;
+  client->flush();
+
+  // Assert
+  printf("HTTP request buffered: %u records, %zu bytes on the wire for %zu bytes\n", loopback->client.recordsWritten, loopback->client.bytesWritten, total);
+  TEST_ASSERT_EQUAL_UINT(0, recordsBeforeFlush);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(total, pumpServer(total));
+  TEST_ASSERT_EQUAL_MEMORY(httpRequest[0], server->data, strlen(httpRequest[0]));
+}
+
+void test_mqtt_publish_without_buffer(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  size_t total = writeMqttPublish();
+
+  // Assert
+  printf("MQTT publish unbuffered: %u records, %zu bytes on the wire for %zu bytes\n", loopback->client.recordsWritten, loopback->client.bytesWritten, total);
+  TEST_ASSERT_EQUAL_UINT(5, loopback->client.recordsWritten);
+}
+
+void test_mqtt_publish_with_buffer(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+
+  // Act
+  size_t total = writeMqttPublish();
+  client->flush();
+
+  // Assert
+  printf("MQTT publish buffered: %u records, %zu bytes on the wire for %zu bytes\n", loopback->client.recordsWritten, loopback->client.bytesWritten, total);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(total, pumpServer(total));
+  TEST_ASSERT_EQUAL_HEX8(0x30, server->data[0]);
+}
+
+void test_full_buffer_is_sent(void) {
+  // Arrange
+  uint8_t chunk[100] = { 0 };
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, 256);
+
+  // Act
+  client->write(chunk, sizeof(chunk));
+  client->write(chunk, sizeof(chunk));
+  client->write(chunk, sizeof(chunk)); // does not fit, the first 200 bytes go out
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(200, pumpServer(200));
+}
+
+void test_large_write_bypasses_buffer(void) {
+  // Arrange
+  uint8_t chunk[1024] = { 0 };
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+
+  // Act
+  size_t written = client->write(chunk, sizeof(chunk));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(sizeof(chunk), written);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+}
+
+void test_write_delay_sends_stale_data(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+  client->setWriteDelay(20);
+  client->write((const uint8_t *)"a", 1);
+
+  // Act
+  virtualNow = 25;
+  client->write((const uint8_t *)"b", 1);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(2, pumpServer(2));
+}
+
+void test_available_sends_buffered_data(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+  writePieces(httpRequest, 5);
+
+  // Act
+  client->available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+}
+
+void test_connected_leaves_stale_data_to_available(void) {
+  // Arrange
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+  client->setWriteDelay(20);
+  client->write((const uint8_t *)"a", 1);
+  virtualNow = 25;
+
+  // Act
+  uint8_t up = client->connected();
+  unsigned int afterConnected = loopback->client.recordsWritten;
+  (void)client->available();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT8(1, up);
+  TEST_ASSERT_EQUAL_UINT(0, afterConnected);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(1, pumpServer(1));
+}
+
+void test_buffered_read_sends_stale_data(void) {
+  // Arrange
+  uint8_t buf[16];
+  connectOverLoopback();
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+  client->setWriteDelay(20);
+  client->write((const uint8_t *)"a", 1);
+
+  // Act
+  virtualNow = 25;
+  (void)client->read(buf, sizeof(buf));
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(1, pumpServer(1));
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_http_request_without_buffer);
+  RUN_TEST(test_http_request_with_buffer);
+  RUN_TEST(test_mqtt_publish_without_buffer);
+  RUN_TEST(test_mqtt_publish_with_buffer);
+  RUN_TEST(test_full_buffer_is_sent);
+  RUN_TEST(test_large_write_bypasses_buffer);
+  RUN_TEST(test_write_delay_sends_stale_data);
+  RUN_TEST(test_available_sends_buffered_data);
+  RUN_TEST(test_connected_leaves_stale_data_to_available);
+  RUN_TEST(test_buffered_read_sends_stale_data);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,212 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+static const uint8_t publishHeader[] = { 0x30, 0x18, 0x00, 0x0c };
+static const char *topic = "sensors/temp";
+static const char *message = "{\"t\":21.5}";
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t writeBuffer[512];
+uint8_t payload[4096];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 3);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+  loopback->client.resetCounters();
+}
+
+static size_t pumpServer(size_t expected) {
+  for (int i = 0; i < 100 && server->received < expected; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+  }
+  return server->received;
+}
+
+void test_publish_with_writes(void) {
+  // Arrange
+  connectOverLoopback();
+
+  // Act
+  size_t total = client->write(publishHeader, sizeof(publishHeader));
+  total += client->write((const uint8_t *)topic, strlen(topic));
+  total += client->write((const uint8_t *)message, strlen(message));
+
+  // Assert
+  printf("publish with write(): %u records, %zu bytes on the wire for %zu bytes\n", loopback->client.recordsWritten, loopback->client.bytesWritten, total);
+  TEST_ASSERT_EQUAL_UINT(3, loopback->client.recordsWritten);
+}
+
+void test_publish_with_writev(void) {
+  // Arrange
+  const ssl_iovec iov[] = {
+    { publishHeader, sizeof(publishHeader) },
+    { topic, strlen(topic) },
+    { message, strlen(message) },
+  };
+  connectOverLoopback();
+
+  // Act
+  size_t total = client->writev(iov, 3);
+
+  // Assert
+  printf("publish with writev(): %u records, %zu bytes on the wire for %zu bytes\n", loopback->client.recordsWritten, loopback->client.bytesWritten, total);
+  TEST_ASSERT_EQUAL_UINT(sizeof(publishHeader) + strlen(topic) + strlen(message), total);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(total, pumpServer(total));
+  TEST_ASSERT_EQUAL_MEMORY(publishHeader, server->data, sizeof(publishHeader));
+  TEST_ASSERT_EQUAL_MEMORY(topic, &server->data[sizeof(publishHeader)], strlen(topic));
+}
+
+void test_large_piece_is_sent_in_place(void) {
+  // Arrange
+  const ssl_iovec iov[] = {
+    { publishHeader, sizeof(publishHeader) },
+    { payload, 2000 },
+    { message, strlen(message) },
+  };
+  size_t expected = sizeof(publishHeader) + 2000 + strlen(message);
+  connectOverLoopback();
+
+  // Act
+  size_t total = client->writev(iov, 3);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(expected, total);
+  TEST_ASSERT_EQUAL_UINT(3, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(expected, pumpServer(expected));
+  TEST_ASSERT_EQUAL_MEMORY(payload, &server->data[sizeof(publishHeader)], 2000);
+}
+
+void test_pieces_overflowing_stage_are_split(void) {
+  // Arrange
+  const ssl_iovec iov[] = {
+    { payload, 300 },
+    { &payload[300], 300 },
+    { &payload[600], 10 },
+  };
+  connectOverLoopback();
+
+  // Act
+  size_t total = client->writev(iov, 3);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(610, total);
+  TEST_ASSERT_EQUAL_UINT(2, loopback->client.recordsWritten);
+  TEST_ASSERT_EQUAL_UINT(610, pumpServer(610));
+  TEST_ASSERT_EQUAL_MEMORY(payload, server->data, 610);
+}
+
+void test_writev_goes_through_write_buffer(void) {
+  // Arrange
+  const ssl_iovec iov[] = {
+    { publishHeader, sizeof(publishHeader) },
+    { topic, strlen(topic) },
+  };
+  connectOverLoopback();
+  client->setWriteBuffer(writeBuffer, sizeof(writeBuffer));
+
+  // Act
+  size_t total = client->writev(iov, 2);
+  unsigned int recordsBeforeFlush = loopback->client.recordsWritten;
+  client->flush();
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(sizeof(publishHeader) + strlen(topic), total);
+  TEST_ASSERT_EQUAL_UINT(0, recordsBeforeFlush);
+  TEST_ASSERT_EQUAL_UINT(1, loopback->client.recordsWritten);
+}
+
+void test_writev_when_not_connected(void) {
+  // Arrange
+  const ssl_iovec iov[] = { { topic, strlen(topic) } };
+
+  // Act
+  size_t total = client->writev(iov, 1);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(0, total);
+  TEST_ASSERT_EQUAL_UINT(0, loopback->client.writeCalls);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_publish_with_writes);
+  RUN_TEST(test_publish_with_writev);
+  RUN_TEST(test_large_piece_is_sent_in_place);
+  RUN_TEST(test_pieces_overflowing_stage_are_split);
+  RUN_TEST(test_writev_goes_through_write_buffer);
+  RUN_TEST(test_writev_when_not_connected);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
@@ -0,0 +1,294 @@
+#define log_d(...); printf(__VA_ARGS__); printf("\n");
+#define log_i(...); printf(__VA_ARGS__); printf("\n");
+#define log_w(...); printf(__VA_ARGS__); printf("\n");
+#define log_e(...); printf(__VA_ARGS__); printf("\n");
+#define log_v(...); printf(__VA_ARGS__); printf("\n");
+#define portTICK_PERIOD_MS 1
+#define vTaskDelay(x) delay(x)
+
+#include <chrono>
+#include "unity.h"
+#include "Arduino.h"
+#include "../mocks/ESPClass.hpp"
+#include "../mocks/LoopbackClient.h"
+#include "../mocks/TlsTestServer.h"
+#include "SSLSessionCache.cpp"
+#include "SSLCredentials.cpp"
+#include "SSLArena.cpp"
+#include "ssl_random.cpp"
+#include "SSLConfig.cpp"
+#include "ssl_client.cpp"
+#include "SSLClient.cpp"
+
+using namespace fakeit;
+
+static const uint8_t testPsk[] = { 0x1a, 0x2b, 0x3c, 0x4d, 0x5e, 0x6f, 0x70, 0x81 };
+
+LoopbackLink *loopback = nullptr;
+TlsTestServer *server = nullptr;
+SSLClient *client = nullptr;
+uint8_t readBuffer[1024];
+uint8_t payload[16384];
+uint8_t sink[16384];
+
+void setUp(void) {
+  ArduinoFakeReset();
+  When(Method(ArduinoFake(), millis)).AlwaysReturn(0);
+  When(Method(ArduinoFake(), delay)).AlwaysReturn();
+  loopback = new LoopbackLink();
+  server = new TlsTestServer(loopback->server);
+  client = new SSLClient(&loopback->client);
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 13);
+  }
+}
+
+void tearDown(void) {
+  delete client;
+  delete server;
+  delete loopback;
+}
+
+static void connectOverLoopback(void) {
+  loopback->server.open();
+  TEST_ASSERT_EQUAL_INT(0, server->beginPsk("client", testPsk, sizeof(testPsk)));
+  client->setPreSharedKey("client", "1a2b3c4d5e6f7081");
+  TEST_ASSERT_EQUAL_INT(1, client->connectAsync("localhost", 443));
+
+  int status = SSL_CLIENT_HANDSHAKE_IN_PROGRESS;
+  for (int i = 0; i < 200 && status == SSL_CLIENT_HANDSHAKE_IN_PROGRESS; i++) {
+    TEST_ASSERT_EQUAL_INT(0, server->step());
+    status = client->poll();
+  }
+  TEST_ASSERT_EQUAL_INT(SSL_CLIENT_HANDSHAKE_DONE, status);
+}
+
+// A sink that has to look at every byte, like a flash writer computing a checksum.
+static uint32_t checksum(const uint8_t *data, size_t len, uint32_t sum) {
+  for (size_t i = 0; i < len; i++) {
+    sum = sum * 31 + data[i];
+  }
+  return sum;
+}
+
+static uint32_t expectedChecksum(int rounds) {
+  uint32_t sum = 0;
+  for (int r = 0; r < rounds; r++) {
+    sum = checksum(payload, sizeof(payload), sum);
+  }
+  return sum;
+}
+
+// Download rounds * sizeof(payload) bytes with read(buf, size), returns bytes per second.
+static double downloadCopying(int rounds, uint32_t *sum) {
+  double seconds = 0;
+  *sum = 0;
+
+  for (int r = 0; r < rounds; r++) {
+    TEST_ASSERT_EQUAL_INT(sizeof(payload), server->send(payload, sizeof(payload)));
+
+    auto start = std::chrono::steady_clock::now();
+    size_t got = 0;
+    while (got < sizeof(payload)) {
+      int len = client->read(sink, 1024);
+      TEST_ASSERT_GREATER_THAN_INT(0, len);
+      *sum = checksum(sink, len, *sum);
+      got += len;
+    }
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  return seconds > 0 ? rounds * sizeof(payload) / seconds : 0;
+}
+
+// Same download with peekSpan() and consume(), returns bytes per second.
+static double downloadSpans(int rounds, uint32_t *sum) {
+  double seconds = 0;
+  *sum = 0;
+
+  for (int r = 0; r < rounds; r++) {
+    TEST_ASSERT_EQUAL_INT(sizeof(payload), server->send(payload, sizeof(payload)));
+
+    auto start = std::chrono::steady_clock::now();
+    size_t got = 0;
+    while (got < sizeof(payload)) {
+      const uint8_t *data = nullptr;
+      int len = client->peekSpan(&data);
+      TEST_ASSERT_GREATER_THAN_INT(0, len);
+      *sum = checksum(data, len, *sum);
+      got += client->consume(len);
+    }
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  return seconds > 0 ? rounds * sizeof(payload) / seconds : 0;
+}
+
+void test_download_throughput(void) {
+  // Arrange
+  uint32_t copied = 0;
+  uint32_t spanned = 0;
+  connectOverLoopback();
+
+  // Act
+  double copying = downloadCopying(32, &copied);
+  double spans = downloadSpans(32, &spanned);
+
+  // Assert
+  printf("read(buf, 1024): %.1f MB/s, 1024 bytes of caller buffer\n", copying / 1e6);
+  printf("peekSpan/consume: %.1f MB/s, 0 bytes of caller buffer\n", spans / 1e6);
+  TEST_ASSERT_EQUAL_UINT32(expectedChecksum(32), copied);
+  TEST_ASSERT_EQUAL_UINT32(expectedChecksum(32), spanned);
+}
+
+void test_span_covers_whole_record(void) {
+  // Arrange
+  const uint8_t *data = nullptr;
+  connectOverLoopback();
+  server->send(payload, 3000);
+
+  // Act
+  int len = client->peekSpan(&data);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(3000, len);
+  TEST_ASSERT_EQUAL_MEMORY(payload, data, 3000);
+}
+
+void test_peek_span_does_not_consume(void) {
+  // Arrange
+  const uint8_t *first = nullptr;
+  const uint8_t *second = nullptr;
+  connectOverLoopback();
+  server->send(payload, 100);
+
+  // Act
+  int firstLen = client->peekSpan(&first);
+  int secondLen = client->peekSpan(&second);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(100, firstLen);
+  TEST_ASSERT_EQUAL_INT(firstLen, secondLen);
+  TEST_ASSERT_EQUAL_PTR(first, second);
+  TEST_ASSERT_EQUAL_INT(100, client->available());
+}
+
+void test_consume_advances_span(void) {
+  // Arrange
+  uint8_t rest[60];
+  const uint8_t *data = nullptr;
+  connectOverLoopback();
+  server->send(payload, 100);
+  (void)client->peekSpan(&data);
+
+  // Act
+  size_t dropped = client->consume(40);
+  int len = client->peekSpan(&data);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(40, dropped);
+  TEST_ASSERT_EQUAL_INT(60, len);
+  TEST_ASSERT_EQUAL_HEX8(payload[40], data[0]);
+  TEST_ASSERT_EQUAL_INT(60, client->read(rest, sizeof(rest)));
+  TEST_ASSERT_EQUAL_MEMORY(&payload[40], rest, sizeof(rest));
+}
+
+void test_consume_is_clamped(void) {
+  // Arrange
+  const uint8_t *data = nullptr;
+  connectOverLoopback();
+  server->send(payload, 10);
+  (void)client->peekSpan(&data);
+
+  // Act
+  size_t dropped = client->consume(50);
+
+  // Assert
+  TEST_ASSERT_EQUAL_UINT(10, dropped);
+  TEST_ASSERT_EQUAL_INT(0, client->peekSpan(&data));
+  TEST_ASSERT_NULL(data);
+}
+
+void test_span_from_read_buffer(void) {
+  // Arrange
+  const uint8_t *data = nullptr;
+  connectOverLoopback();
+  client->setReadBuffer(readBuffer, sizeof(readBuffer));
+  server->send(payload, 100);
+
+  // Act
+  int len = client->peekSpan(&data);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(100, len);
+  TEST_ASSERT_EQUAL_PTR(readBuffer, data);
+  TEST_ASSERT_EQUAL_UINT(100, client->consume(100));
+  TEST_ASSERT_EQUAL_INT(0, client->available());
+}
+
+void test_peeked_byte_comes_first(void) {
+  // Arrange
+  const uint8_t *data = nullptr;
+  connectOverLoopback();
+  server->send(payload, 10);
+  int peeked = client->peek();
+
+  // Act
+  int first = client->peekSpan(&data);
+  uint8_t firstByte = data[0];
+  (void)client->consume(1);
+  int second = client->peekSpan(&data);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(payload[0], peeked);
+  TEST_ASSERT_EQUAL_INT(1, first);
+  TEST_ASSERT_EQUAL_HEX8(payload[0], firstByte);
+  TEST_ASSERT_EQUAL_INT(9, second);
+  TEST_ASSERT_EQUAL_HEX8(payload[1], data[0]);
+}
+
+void test_span_is_empty_when_idle(void) {
+  // Arrange
+  const uint8_t *data = payload;
+  connectOverLoopback();
+
+  // Act
+  int len = client->peekSpan(&data);
+
+  // Assert
+  TEST_ASSERT_EQUAL_INT(0, len);
+  TEST_ASSERT_NULL(data);
+}
+
+void run_all_tests(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_download_throughput);
+  RUN_TEST(test_span_covers_whole_record);
+  RUN_TEST(test_peek_span_does_not_consume);
+  RUN_TEST(test_consume_advances_span);
+  RUN_TEST(test_consume_is_clamped);
+  RUN_TEST(test_span_from_read_buffer);
+  RUN_TEST(test_peeked_byte_comes_first);
+  RUN_TEST(test_span_is_empty_when_idle);
+  UNITY_END();
+}
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+void setup() {
+  delay(2000); // If using Serial, allow time for serial monitor to open
+  run_all_tests();
+}
+
+void loop() {
+  // Empty loop
+}
+
+#else
+
+int main(int argc, char **argv) {
+  run_all_tests();
+  return 0;
+}
+
+#endif
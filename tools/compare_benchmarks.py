@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Compare two runs of the native benchmark suite and flag regressions.
+
+    pio test -e native_benchmark -v > new.txt
+    python3 tools/compare_benchmarks.py old.txt new.txt --threshold 10
+
+Each input is the test output; only lines of the form "BENCH {json}" are read. Metrics
+ending in _per_s are better when higher, _ms and _us ones when lower. Exits with 1 if any
+metric got worse by more than the threshold.
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = "BENCH "
+
+
+def load(path):
+    results = {}
+    with open(path, "r", encoding="utf-8", errors="replace") as log:
+        for line in log:
+            start = line.find(PREFIX)
+            if start < 0:
+                continue
+            entry = json.loads(line[start + len(PREFIX):])
+            results[(entry["benchmark"], entry["variant"], entry["metric"])] = entry["value"]
+    return results
+
+
+def higher_is_better(metric):
+    return metric.endswith("_per_s")
+
+
+def change_percent(metric, old, new):
+    """Positive when new is better than old."""
+    if old == 0:
+        return 0.0
+    change = (new - old) / old * 100.0
+    return change if higher_is_better(metric) else -change
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old", help="output of the baseline run")
+    parser.add_argument("new", help="output of the run to check")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    args = parser.parse_args()
+
+    old = load(args.old)
+    new = load(args.new)
+    regressions = 0
+
+    print("%-10s %-24s %-16s %12s %12s %8s" % ("benchmark", "variant", "metric", "old", "new", "change"))
+    for key in sorted(set(old) | set(new)):
+        benchmark, variant, metric = key
+        if key not in old or key not in new:
+            print("%-10s %-24s %-16s %s" % (benchmark, variant, metric, "only in " + ("new" if key in new else "old")))
+            continue
+        change = change_percent(metric, old[key], new[key])
+        flag = ""
+        if change < -args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-10s %-24s %-16s %12.3f %12.3f %+7.1f%%%s" % (benchmark, variant, metric, old[key], new[key], change, flag))
+
+    if regressions > 0:
+        print("%d metric(s) worse than %.1f%%" % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
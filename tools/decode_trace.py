@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Decode a binary trace written by ssl_trace_dump() into one line per event.
+
+    python3 tools/decode_trace.py dump.bin
+    python3 tools/decode_trace.py --serial-log monitor.txt   # dump embedded in other output
+
+Event names are read from the ssl_trace_id enum in src/ssl_trace.h, so the decoder
+stays in step with the firmware it was built from.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = b"SSLT"
+VERSION = 1
+HEADER = struct.Struct("<4sBBHI")
+EVENT = struct.Struct("<IHHii")
+
+DEFAULT_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "ssl_trace.h")
+
+# Meaning of the two arguments, per event; events without an entry print "a b".
+ARGUMENTS = {
+    "ERROR": ("err", "line"),
+    "HANDSHAKE_STEP": ("state", "ret"),
+    "NET_RECV": ("ret", "len"),
+    "NET_SEND": ("ret", "len"),
+    "SEND_BEGIN": ("len", None),
+    "SEND_END": ("ret", "retries"),
+    "RECEIVE_BEGIN": ("len", None),
+    "RECEIVE_END": ("ret", None),
+}
+
+
+def read_event_names(path):
+    names = {}
+    with open(path, "r", encoding="utf-8") as header:
+        for match in re.finditer(r"^\s*SSL_TRACE_(\w+)\s*=\s*(\d+)\s*,", header.read(), re.MULTILINE):
+            names[int(match.group(2))] = match.group(1)
+    return names
+
+
+def find_dump(data):
+    start = data.find(MAGIC)
+    if start < 0:
+        raise ValueError("no trace dump found (missing %r header)" % MAGIC)
+    return data[start:]
+
+
+def parse(data):
+    if len(data) < HEADER.size:
+        raise ValueError("dump shorter than its header")
+    magic, version, event_size, count, total = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("unsupported dump: magic %r version %d" % (magic, version))
+    if event_size != EVENT.size:
+        raise ValueError("unexpected event size %d" % event_size)
+
+    events = []
+    offset = HEADER.size
+    for _ in range(count):
+        if offset + EVENT.size > len(data):
+            print("warning: dump truncated after %d events" % len(events), file=sys.stderr)
+            break
+        time_us, event_id, sequence, a, b = EVENT.unpack_from(data, offset)
+        offset += EVENT.size
+        if event_id != 0:  # id 0 marks a slot lost while dumping
+            events.append((time_us, event_id, sequence, a, b))
+    return total, events
+
+
+def format_arguments(name, a, b):
+    labels = ARGUMENTS.get(name)
+    if labels is None:
+        return "%d %d" % (a, b)
+    parts = ["%s=%d" % (labels[0], a)]
+    if labels[1] is not None:
+        parts.append("%s=%d" % (labels[1], b))
+    return " ".join(parts)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="file holding the dump, or '-' for stdin")
+    parser.add_argument("--header", default=DEFAULT_HEADER, help="ssl_trace.h to read event names from")
+    parser.add_argument("--serial-log", action="store_true", help="skip any bytes before the dump header")
+    args = parser.parse_args()
+
+    if args.dump == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.dump, "rb") as dump:
+            data = dump.read()
+    if args.serial_log:
+        data = find_dump(data)
+    names = read_event_names(args.header)
+    total, events = parse(data)
+
+    print("%d events (of %d recorded)" % (len(events), total))
+    previous = None
+    for time_us, event_id, sequence, a, b in events:
+        name = names.get(event_id, "EVENT_%d" % event_id)
+        delta = 0 if previous is None else (time_us - previous) & 0xFFFFFFFF
+        previous = time_us
+        print("%12u us %+9d  #%-5u %-16s %s" % (time_us, delta, sequence, name, format_arguments(name, a, b)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())